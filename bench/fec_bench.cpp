@@ -0,0 +1,227 @@
+// Throughput of the zfec encoder/decoder, SIMD kernel vs the scalar reference.
+//
+// Usage: fec_bench [iterations]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "wifibroadcast.hpp"
+
+extern "C" {
+#include "fec.h"
+}
+
+namespace {
+
+struct FecCase {
+    unsigned short k;
+    unsigned short n;
+};
+
+constexpr FecCase FEC_CASES[] = {{1, 5}, {2, 3}, {4, 8}, {8, 12}};
+
+constexpr size_t PAYLOAD_SIZES[] = {256, 1024, 1446, MAX_FEC_PAYLOAD};
+
+class Blocks {
+public:
+    Blocks(size_t count, size_t size) : storage_(count * size), ptrs_(count) {
+        for (size_t i = 0; i < count; i++) {
+            ptrs_[i] = storage_.data() + i * size;
+        }
+    }
+
+    gf **data() {
+        return ptrs_.data();
+    }
+
+    const gf **constData() {
+        return const_cast<const gf **>(ptrs_.data());
+    }
+
+    std::vector<gf> &storage() {
+        return storage_;
+    }
+
+private:
+    std::vector<gf> storage_;
+    std::vector<gf *> ptrs_;
+};
+
+struct Result {
+    double encodeMBps;
+    double decodeMBps;
+    std::vector<gf> parity;
+    std::vector<gf> recovered;
+};
+
+Result run(const FecCase &fecCase, size_t size, int iterations, bool simd) {
+    fec_set_simd_enabled(simd);
+
+    fec_t *fec = fec_new(fecCase.k, fecCase.n);
+
+    const unsigned parityCount = fecCase.n - fecCase.k;
+
+    Blocks primary(fecCase.k, size);
+    Blocks parity(parityCount, size);
+
+    std::mt19937 rng(1234);
+    for (auto &b : primary.storage()) {
+        b = static_cast<gf>(rng());
+    }
+
+    const auto encodeStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        fec_encode(fec, primary.constData(), parity.data(), size);
+    }
+    const std::chrono::duration<double> encodeTime = std::chrono::steady_clock::now() - encodeStart;
+
+    // Worst case: lose as many primary fragments as the parity can recover.
+    const unsigned lost = std::min<unsigned>(parityCount, fecCase.k);
+
+    std::vector<const gf *> in(fecCase.k);
+    std::vector<unsigned> index(fecCase.k);
+    for (unsigned i = 0; i < fecCase.k; i++) {
+        if (i < lost) {
+            in[i] = parity.data()[i];
+            index[i] = fecCase.k + i;
+        } else {
+            in[i] = primary.data()[i];
+            index[i] = i;
+        }
+    }
+
+    Blocks out(lost, size);
+
+    const auto decodeStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        fec_decode(fec, in.data(), out.data(), index.data(), size);
+    }
+    const std::chrono::duration<double> decodeTime = std::chrono::steady_clock::now() - decodeStart;
+
+    if (lost > 0 && std::memcmp(out.storage().data(), primary.storage().data(), lost * size) != 0) {
+        std::fprintf(stderr, "FEC %u/%u size %zu: recovered data does not match\n", fecCase.k, fecCase.n, size);
+        std::exit(1);
+    }
+
+    fec_free(fec);
+
+    // Throughput is counted in source bytes per block, like a link would see it.
+    const double megabytes = double(fecCase.k) * size * iterations / 1e6;
+
+    return {megabytes / encodeTime.count(), megabytes / decodeTime.count(), parity.storage(), out.storage()};
+}
+
+struct StreamResult {
+    /// fec_encode() over the whole block once the last primary fragment is in
+    double blockCloseUs;
+    /// fec_encode_add() of the last primary fragment, the rest was folded in while the block filled up
+    double streamCloseUs;
+};
+
+StreamResult runStreaming(const FecCase &fecCase, size_t size, int iterations) {
+    fec_set_simd_enabled(true);
+
+    fec_t *fec = fec_new(fecCase.k, fecCase.n);
+
+    const unsigned parityCount = fecCase.n - fecCase.k;
+
+    Blocks primary(fecCase.k, size);
+    Blocks parity(parityCount, size);
+    Blocks streamed(parityCount, size);
+
+    // Fragments of different lengths, the encoder has to treat the shorter ones as zero-padded.
+    std::mt19937 rng(1234);
+    std::vector<size_t> lengths(fecCase.k);
+    for (unsigned i = 0; i < fecCase.k; i++) {
+        lengths[i] = i == 0 ? size : 1 + rng() % size;
+        gf *fragment = primary.data()[i];
+        for (size_t j = 0; j < size; j++) {
+            fragment[j] = j < lengths[i] ? static_cast<gf>(rng()) : 0;
+        }
+    }
+
+    fec_encode(fec, primary.constData(), parity.data(), size);
+    for (unsigned i = 0; i < fecCase.k; i++) {
+        fec_encode_add(fec, primary.data()[i], i, streamed.data(), lengths[i]);
+    }
+    if (streamed.storage() != parity.storage()) {
+        std::fprintf(stderr, "FEC %u/%u size %zu: streamed parity differs from fec_encode()\n", fecCase.k, fecCase.n, size);
+        std::exit(1);
+    }
+
+    const auto blockStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        fec_encode(fec, primary.constData(), parity.data(), size);
+    }
+    const std::chrono::duration<double, std::micro> blockTime = std::chrono::steady_clock::now() - blockStart;
+
+    const unsigned last = fecCase.k - 1;
+    const auto streamStart = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        fec_encode_add(fec, primary.data()[last], last, streamed.data(), size);
+    }
+    const std::chrono::duration<double, std::micro> streamTime = std::chrono::steady_clock::now() - streamStart;
+
+    fec_free(fec);
+
+    return {blockTime.count() / iterations, streamTime.count() / iterations};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const int iterations = argc > 1 ? std::atoi(argv[1]) : 20000;
+
+    std::printf("SIMD kernel: %s, %d iterations\n", fec_simd_name(), iterations);
+    std::printf("Decoding repeats one erasure pattern, so it runs from the decode-matrix cache after the first block.\n\n");
+    std::printf("%-8s %-8s %14s %14s %14s %14s %8s\n",
+                "k/n",
+                "size",
+                "enc scalar",
+                "enc simd",
+                "dec scalar",
+                "dec simd",
+                "speedup");
+
+    for (const auto &fecCase : FEC_CASES) {
+        for (const size_t size : PAYLOAD_SIZES) {
+            const Result scalar = run(fecCase, size, iterations, false);
+            const Result simd = run(fecCase, size, iterations, true);
+
+            if (scalar.parity != simd.parity || scalar.recovered != simd.recovered) {
+                std::fprintf(stderr, "FEC %u/%u size %zu: SIMD output differs from scalar\n", fecCase.k, fecCase.n, size);
+                return 1;
+            }
+
+            char name[16];
+            std::snprintf(name, sizeof(name), "%u/%u", fecCase.k, fecCase.n);
+            std::printf("%-8s %-8zu %9.1f MB/s %9.1f MB/s %9.1f MB/s %9.1f MB/s %7.1fx\n",
+                        name,
+                        size,
+                        scalar.encodeMBps,
+                        simd.encodeMBps,
+                        scalar.decodeMBps,
+                        simd.decodeMBps,
+                        simd.encodeMBps / scalar.encodeMBps);
+        }
+    }
+
+    std::printf("\nBlock close: time from the last primary fragment to parity ready (SIMD).\n\n");
+    std::printf("%-8s %-8s %14s %14s\n", "k/n", "size", "fec_encode", "streaming");
+
+    for (const auto &fecCase : FEC_CASES) {
+        for (const size_t size : PAYLOAD_SIZES) {
+            const StreamResult r = runStreaming(fecCase, size, iterations);
+
+            char name[16];
+            std::snprintf(name, sizeof(name), "%u/%u", fecCase.k, fecCase.n);
+            std::printf("%-8s %-8zu %11.2f us %11.2f us\n", name, size, r.blockCloseUs, r.streamCloseUs);
+        }
+    }
+
+    return 0;
+}
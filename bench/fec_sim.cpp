@@ -0,0 +1,332 @@
+// Offline simulator of the adaptive-link FEC controllers. A channel trace is replayed through FEC blocks sized by
+// the controller, with the controller fed the same one-second stats the alink thread sees every 100 ms.
+// Reports the redundancy each controller spent against the primary packets it still lost.
+//
+// Usage: fec_sim [trace] [packets/s] [seed] [runs]
+//   trace:     "<seconds>@<loss model>;<seconds>@<loss model>;..." with loss models as in loopback_bench,
+//              or a wfb-ng rx log, whose PKT lines are replayed as one second of i.i.d. loss each
+//   packets/s: primary video packets per second
+//   runs:      how many times the trace is replayed with consecutive seeds. A few seconds of heavy loss
+//              make single runs noisy, so the default is 20, and the table shows the mean of one run.
+// Without a trace, a built-in scenario of a clean, a noisy and a bursty stretch is replayed.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "fec_controller.h"
+#include "loss_model.h"
+
+namespace {
+
+constexpr std::chrono::milliseconds TICK{100};
+constexpr int TICKS_PER_SECOND = 10;
+
+constexpr const char *DEFAULT_TRACE =
+    "30@none;30@iid:0.02;20@ge:0.01,0.25,0.005,0.6;20@iid:0.08;10@ge:0.05,0.1,0.01,0.8;30@none";
+
+/// Some seconds of a channel
+struct Segment {
+    int seconds;
+    LossModel loss;
+};
+
+bool parseSpec(const std::string &spec, std::vector<Segment> &trace) {
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t end = spec.find(';', start);
+        if (end == std::string::npos) {
+            end = spec.size();
+        }
+
+        const std::string item = spec.substr(start, end - start);
+        const size_t at = item.find('@');
+        Segment segment;
+        if (at == std::string::npos || !LossModel::parse(item.substr(at + 1), segment.loss)) {
+            return false;
+        }
+        segment.seconds = atoi(item.c_str());
+        if (segment.seconds <= 0) {
+            return false;
+        }
+        trace.push_back(segment);
+
+        start = end + 1;
+    }
+    return !trace.empty();
+}
+
+/// The PKT lines of a wfb-ng rx log, one per second. The log knows how many primary packets were erased but not
+/// how they were spread, so each second becomes i.i.d. loss at that rate.
+bool readWfbLog(const std::string &path, std::vector<Segment> &trace) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        const size_t pos = line.find("\tPKT\t");
+        if (pos == std::string::npos) {
+            continue;
+        }
+
+        unsigned all, bytes, decErr, session, data, uniq, recovered, lost, bad, out, outBytes;
+        if (sscanf(line.c_str() + pos + 5,
+                   "%u:%u:%u:%u:%u:%u:%u:%u:%u:%u:%u",
+                   &all,
+                   &bytes,
+                   &decErr,
+                   &session,
+                   &data,
+                   &uniq,
+                   &recovered,
+                   &lost,
+                   &bad,
+                   &out,
+                   &outBytes) != 11) {
+            continue;
+        }
+
+        // Primary packets sent are the ones delivered plus the ones lost, the erased ones FEC saw or gave up on.
+        const double primaries = double(out) + lost;
+        const double erased = double(recovered) + lost;
+
+        Segment segment;
+        segment.seconds = 1;
+        char model[32];
+        snprintf(model, sizeof(model), "iid:%.5f", primaries > 0 ? erased / primaries : 0.0);
+        LossModel::parse(model, segment.loss);
+        trace.push_back(segment);
+    }
+    return !trace.empty();
+}
+
+/// Always asks for the same fec_change, the baselines to compare against.
+class FixedFecController : public FecController {
+public:
+    explicit FixedFecController(int level) : level_(level), name_("fixed:" + std::to_string(level)) {}
+
+    int update(const FecStats &, Clock::time_point) override {
+        return level_;
+    }
+
+    int value(Clock::time_point) override {
+        return level_;
+    }
+
+    const char *name() const override {
+        return name_.c_str();
+    }
+
+private:
+    int level_;
+    std::string name_;
+};
+
+struct SimResult {
+    uint64_t primaries = 0;
+    uint64_t parity = 0;
+    /// Primary packets FEC couldn't restore
+    uint64_t lost = 0;
+    uint64_t lossEvents = 0;
+    /// 100 ms slices with at least one lost packet, i.e. a visible glitch
+    uint64_t glitchTicks = 0;
+    uint64_t levelChanges = 0;
+    uint64_t levelSum = 0;
+    uint64_t ticks = 0;
+};
+
+SimResult simulate(FecController &controller,
+                   const std::vector<Segment> &trace,
+                   uint32_t packetsPerSecond,
+                   uint32_t seed) {
+    const FecLevels levels;
+    const int k = levels.k;
+
+    std::mt19937 rng(seed);
+    SimResult result;
+
+    auto now = FecController::Clock::time_point{} + std::chrono::hours(1);
+    int level = controller.value(now);
+
+    // The last second of stats, as SignalQualityCalculator keeps it
+    std::deque<FecStats> window;
+
+    // Primaries waiting for a full block, packets arrive at the same pace whatever the block size.
+    double primariesDue = 0;
+    bool previousLost = false;
+    bool previousFragmentLost = false;
+
+    for (const auto &segment : trace) {
+        LossModel loss = segment.loss;
+
+        for (int tick = 0; tick < segment.seconds * TICKS_PER_SECOND; tick++) {
+            FecStats tickStats;
+            bool glitch = false;
+
+            primariesDue += double(packetsPerSecond) / TICKS_PER_SECOND;
+            while (primariesDue >= k) {
+                primariesDue -= k;
+
+                const int n = levels.n[level];
+                bool primaryLost[256] = {};
+                int erased = 0;
+                int erasedPrimaries = 0;
+                for (int i = 0; i < n; i++) {
+                    const bool fragmentLost = loss.lost(rng);
+                    if (fragmentLost) {
+                        erased++;
+                        if (i < k) {
+                            erasedPrimaries++;
+                            primaryLost[i] = true;
+                        }
+                        // Gaps in the fragment sequence, as the aggregator sees them before FEC
+                        tickStats.fragmentLossEvents += !previousFragmentLost;
+                    }
+                    previousFragmentLost = fragmentLost;
+                }
+
+                result.primaries += k;
+                result.parity += n - k;
+                tickStats.packets += n - erased;
+                tickStats.fragmentsLost += erased;
+
+                if (erased <= n - k) {
+                    tickStats.recovered += erasedPrimaries;
+                    previousLost = false;
+                    continue;
+                }
+
+                tickStats.lost += erasedPrimaries;
+                glitch |= erasedPrimaries > 0;
+                for (int i = 0; i < k; i++) {
+                    // The aggregator reports every gap in the output sequence once.
+                    if (primaryLost[i] && !previousLost) {
+                        tickStats.lossEvents++;
+                    }
+                    previousLost = primaryLost[i];
+                }
+            }
+
+            result.lost += tickStats.lost;
+            result.lossEvents += tickStats.lossEvents;
+            result.glitchTicks += glitch;
+
+            window.push_back(tickStats);
+            if (window.size() > TICKS_PER_SECOND) {
+                window.pop_front();
+            }
+
+            FecStats lastSecond;
+            for (const auto &stats : window) {
+                lastSecond.packets += stats.packets;
+                lastSecond.recovered += stats.recovered;
+                lastSecond.lost += stats.lost;
+                lastSecond.lossEvents += stats.lossEvents;
+                lastSecond.fragmentsLost += stats.fragmentsLost;
+                lastSecond.fragmentLossEvents += stats.fragmentLossEvents;
+            }
+
+            now += TICK;
+
+            // The drone applies the new level to the blocks of the next tick.
+            const int newLevel = controller.update(lastSecond, now);
+            result.levelChanges += newLevel != level;
+            level = newLevel;
+
+            result.levelSum += level;
+            result.ticks++;
+        }
+    }
+
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const std::string traceArg = argc > 1 ? argv[1] : DEFAULT_TRACE;
+    const uint32_t packetsPerSecond = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1000;
+    const uint32_t seed = argc > 3 ? strtoul(argv[3], nullptr, 10) : 1234;
+    const uint32_t runs = argc > 4 ? std::max(1ul, strtoul(argv[4], nullptr, 10)) : 20;
+
+    std::vector<Segment> trace;
+    const bool ok = traceArg.find('@') != std::string::npos ? parseSpec(traceArg, trace) : readWfbLog(traceArg, trace);
+    if (!ok) {
+        fprintf(stderr, "Invalid trace: %s\n", traceArg.c_str());
+        return 1;
+    }
+
+    int seconds = 0;
+    for (const auto &segment : trace) {
+        seconds += segment.seconds;
+    }
+
+    const FecLevels levels;
+    printf("%d s of channel in %zu segments, %u packets/s, %u runs, k %d, n",
+           seconds,
+           trace.size(),
+           packetsPerSecond,
+           runs,
+           levels.k);
+    for (int n : levels.n) {
+        printf(" %d", n);
+    }
+    printf("\n");
+
+    printf("%-12s %10s %10s %9s %9s %10s %9s\n",
+           "controller",
+           "overhead",
+           "residual",
+           "events",
+           "glitch s",
+           "avg level",
+           "changes");
+
+    // Each run starts with a fresh controller.
+    const std::vector<std::function<std::unique_ptr<FecController>()>> controllers = {
+        [] { return std::make_unique<FixedFecController>(0); },
+        [] { return std::make_unique<FixedFecController>(FecController::MAX_FEC_CHANGE); },
+        [] { return makeFecController("threshold"); },
+        [] { return makeFecController("model"); },
+    };
+
+    for (const auto &makeController : controllers) {
+        std::string name;
+        SimResult r;
+        for (uint32_t run = 0; run < runs; run++) {
+            auto controller = makeController();
+            name = controller->name();
+
+            const auto result = simulate(*controller, trace, packetsPerSecond, seed + run);
+            r.primaries += result.primaries;
+            r.parity += result.parity;
+            r.lost += result.lost;
+            r.lossEvents += result.lossEvents;
+            r.glitchTicks += result.glitchTicks;
+            r.levelChanges += result.levelChanges;
+            r.levelSum += result.levelSum;
+            r.ticks += result.ticks;
+        }
+
+        printf("%-12s %9.1f%% %9.4f%% %9.1f %9.1f %10.2f %9.1f\n",
+               name.c_str(),
+               100.0 * r.parity / r.primaries,
+               100.0 * r.lost / r.primaries,
+               double(r.lossEvents) / runs,
+               double(r.glitchTicks) / TICKS_PER_SECOND / runs,
+               double(r.levelSum) / r.ticks,
+               double(r.levelChanges) / runs);
+    }
+
+    return 0;
+}
@@ -0,0 +1,509 @@
+// Loopback benchmark of the wfb-ng stack: Transmitter (FEC + encryption) -> channel model -> Aggregator.
+// Everything runs in memory on one thread, so the numbers are the CPU cost of the stack plus the time
+// a packet waits in the aggregator for the rest of its FEC block.
+//
+// Usage: loopback_bench [packets] [loss model] [reorder] [duplicate]
+//   loss model: "none", "iid:<p>" or "ge:<p_gb>,<p_bg>,<loss_good>,<loss_bad>" (Gilbert-Elliott)
+//   reorder:    probability that a fragment is held back and sent after the next one
+//   duplicate:  probability that a fragment is sent twice
+// Without a loss model, every case runs with no loss, 5% i.i.d. loss and a bursty Gilbert-Elliott channel.
+//
+// Afterwards the USB read jitter is measured: a thread reads the fragments at a fixed pace, like the USB RX thread,
+// and either runs the aggregator itself (inline) or only queues them for a worker thread (worker), as WfbngLink does.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include "fec.h"
+}
+
+#include "loss_model.h"
+#include "rx.hpp"
+#include "spsc_packet_ring.h"
+#include "transmitter.h"
+
+namespace {
+
+struct FecCase {
+    int k;
+    int n;
+};
+
+constexpr FecCase FEC_CASES[] = {{1, 2}, {4, 8}, {8, 12}};
+
+constexpr size_t PAYLOAD_SIZES[] = {512, 1024, MAX_PAYLOAD_SIZE};
+
+/// Pace of the simulated USB reads, about 40k frames/s
+constexpr uint64_t USB_READ_INTERVAL_US = 25;
+
+// sha1 hash of link_domain="default", same as WfbngLink
+constexpr uint32_t LINK_ID = 7669206;
+constexpr uint32_t CHANNEL_ID = LINK_ID << 8;
+
+uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/// Queues the injected fragments in memory instead of sending them.
+class LoopbackTransmitter : public Transmitter {
+public:
+    LoopbackTransmitter(int k, int n, const std::string &keypair)
+        : Transmitter(k, n, keypair, 0, CHANNEL_ID) {}
+
+    void selectOutput(int idx) override {}
+
+    void dumpStats(FILE *fp,
+                   uint64_t ts,
+                   uint32_t &injectedPackets,
+                   uint32_t &droppedPackets,
+                   uint32_t &injectedBytes) override {}
+
+    std::deque<std::vector<uint8_t>> queue;
+
+private:
+    void injectPacket(const uint8_t *buf, size_t size) override {
+        queue.emplace_back(buf, buf + size);
+    }
+};
+
+/// Records the latency of every packet that comes out of the aggregator.
+class LoopbackAggregator : public Aggregator {
+public:
+    LoopbackAggregator(const std::string &keypair, const std::vector<uint64_t> &sendTimes)
+        : Aggregator(keypair, 0, CHANNEL_ID), sendTimes_(sendTimes) {}
+
+    std::vector<uint64_t> latenciesUs;
+    uint64_t outPackets = 0;
+
+protected:
+    void send_to_socket(const uint8_t *payload, uint16_t packet_size) override {
+        outPackets++;
+
+        uint64_t seq;
+        if (packet_size < sizeof(seq)) {
+            return;
+        }
+        memcpy(&seq, payload, sizeof(seq));
+        if (seq < sendTimes_.size()) {
+            latenciesUs.push_back(nowUs() - sendTimes_[seq]);
+        }
+    }
+
+private:
+    const std::vector<uint64_t> &sendTimes_;
+};
+
+/// The wfb-ng key files hold our secret key followed by the peer's public key.
+bool writeKeyPair(const std::string &txPath, const std::string &rxPath) {
+    uint8_t txPublic[crypto_box_PUBLICKEYBYTES], txSecret[crypto_box_SECRETKEYBYTES];
+    uint8_t rxPublic[crypto_box_PUBLICKEYBYTES], rxSecret[crypto_box_SECRETKEYBYTES];
+    crypto_box_keypair(txPublic, txSecret);
+    crypto_box_keypair(rxPublic, rxSecret);
+
+    auto write = [](const std::string &path, const uint8_t *secret, const uint8_t *peerPublic) {
+        FILE *fp = fopen(path.c_str(), "wb");
+        if (!fp) {
+            return false;
+        }
+        bool ok = fwrite(secret, crypto_box_SECRETKEYBYTES, 1, fp) == 1 &&
+                  fwrite(peerPublic, crypto_box_PUBLICKEYBYTES, 1, fp) == 1;
+        fclose(fp);
+        return ok;
+    };
+
+    return write(txPath, txSecret, rxPublic) && write(rxPath, rxSecret, txPublic);
+}
+
+struct ChannelOptions {
+    LossModel loss;
+    double reorder = 0;
+    double duplicate = 0;
+};
+
+struct RunResult {
+    double packetsPerSecond;
+    double mbPerSecond;
+    uint64_t sent;
+    uint64_t delivered;
+    uint32_t recovered;
+    uint32_t lost;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t max;
+};
+
+RunResult run(const FecCase &fecCase,
+              size_t payloadSize,
+              size_t packetCount,
+              ChannelOptions channel,
+              const std::string &txKey,
+              const std::string &rxKey) {
+    std::vector<uint64_t> sendTimes(packetCount);
+
+    LoopbackTransmitter transmitter(fecCase.k, fecCase.n, txKey);
+    LoopbackAggregator aggregator(rxKey, sendTimes);
+    aggregator.latenciesUs.reserve(packetCount);
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<double> dist(0, 1);
+
+    const uint8_t antenna[RX_ANT_MAX] = {0, 0xff, 0xff, 0xff};
+    const int8_t rssi[RX_ANT_MAX] = {-50};
+    const int8_t noise[RX_ANT_MAX] = {-90};
+
+    auto deliver = [&](const std::vector<uint8_t> &fragment) {
+        aggregator.process_packet(
+            fragment.data(), fragment.size(), 0, antenna, rssi, noise, 0, 0, 0, nullptr);
+    };
+
+    std::vector<uint8_t> heldBack;
+
+    // Push everything the transmitter has queued through the channel.
+    auto drain = [&] {
+        while (!transmitter.queue.empty()) {
+            auto fragment = std::move(transmitter.queue.front());
+            transmitter.queue.pop_front();
+
+            // Session keys always get through, wfb-ng repeats them anyway.
+            const bool isSessionKey = fragment[0] == WFB_PACKET_SESSION;
+
+            if (!isSessionKey && channel.loss.lost(rng)) {
+                continue;
+            }
+
+            if (!isSessionKey && heldBack.empty() && dist(rng) < channel.reorder) {
+                heldBack = std::move(fragment);
+                continue;
+            }
+
+            deliver(fragment);
+            if (!isSessionKey && dist(rng) < channel.duplicate) {
+                deliver(fragment);
+            }
+
+            if (!heldBack.empty()) {
+                deliver(heldBack);
+                heldBack.clear();
+            }
+        }
+    };
+
+    transmitter.sendSessionKey();
+    drain();
+
+    std::vector<uint8_t> payload(payloadSize);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (uint64_t seq = 0; seq < packetCount; seq++) {
+        memcpy(payload.data(), &seq, sizeof(seq));
+        sendTimes[seq] = nowUs();
+        transmitter.sendPacket(payload.data(), payload.size(), 0);
+        drain();
+    }
+
+    // Close the last block.
+    while (transmitter.sendPacket(payload.data(), 0, WFB_PACKET_FEC_ONLY)) {
+        drain();
+    }
+    drain();
+    if (!heldBack.empty()) {
+        deliver(heldBack);
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    auto &latencies = aggregator.latenciesUs;
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) -> uint64_t {
+        if (latencies.empty()) {
+            return 0;
+        }
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+    };
+
+    RunResult result{};
+    result.packetsPerSecond = packetCount / seconds;
+    result.mbPerSecond = packetCount * payloadSize / seconds / 1e6;
+    result.sent = packetCount;
+    result.delivered = latencies.size();
+    result.recovered = aggregator.count_p_fec_recovered;
+    result.lost = aggregator.count_p_lost;
+    result.p50 = percentile(0.5);
+    result.p90 = percentile(0.9);
+    result.p99 = percentile(0.99);
+    result.max = latencies.empty() ? 0 : latencies.back();
+    return result;
+}
+
+struct JitterResult {
+    /// Time between the starts of two consecutive reads
+    uint64_t gapP50;
+    uint64_t gapP99;
+    uint64_t gapMax;
+    /// How far the reads fell behind their schedule, i.e. what the adapter would have had to buffer
+    uint64_t maxLateUs;
+    uint64_t dropped;
+    uint64_t highWater;
+    uint64_t delivered;
+};
+
+/// Read `fragments` at USB_READ_INTERVAL_US, running the aggregator inline or on a worker thread.
+JitterResult runUsbJitter(const std::vector<std::vector<uint8_t>> &fragments, bool useWorker, const std::string &rxKey) {
+    const std::vector<uint64_t> noSendTimes;
+    LoopbackAggregator aggregator(rxKey, noSendTimes);
+
+    const uint8_t antenna[RX_ANT_MAX] = {0, 0xff, 0xff, 0xff};
+    const int8_t rssi[RX_ANT_MAX] = {-50};
+    const int8_t noise[RX_ANT_MAX] = {-90};
+
+    auto deliver = [&](const uint8_t *data, size_t size) {
+        aggregator.process_packet(data, size, 0, antenna, rssi, noise, 0, 0, 0, nullptr);
+    };
+
+    // Same ring geometry as WfbngLink::RxWorker.
+    SpscPacketRing ring(512, 4096);
+    std::atomic<bool> workerShouldStop = false;
+    std::thread worker;
+    if (useWorker) {
+        worker = std::thread([&] {
+            std::vector<uint8_t> buffer(ring.slotSize());
+            while (true) {
+                const size_t size = ring.popWait(buffer.data(), buffer.size(), std::chrono::milliseconds(100));
+                if (size == 0) {
+                    if (workerShouldStop) {
+                        break;
+                    }
+                    continue;
+                }
+                deliver(buffer.data(), size);
+            }
+        });
+    }
+
+    std::vector<uint64_t> gaps;
+    gaps.reserve(fragments.size());
+    uint64_t maxLate = 0;
+
+    const uint64_t start = nowUs();
+    uint64_t lastRead = 0;
+    for (size_t i = 0; i < fragments.size(); i++) {
+        const uint64_t scheduled = start + i * USB_READ_INTERVAL_US;
+        uint64_t now;
+        while ((now = nowUs()) < scheduled) {
+        }
+
+        maxLate = std::max(maxLate, now - scheduled);
+        if (i > 0) {
+            gaps.push_back(now - lastRead);
+        }
+        lastRead = now;
+
+        const auto &fragment = fragments[i];
+        if (useWorker) {
+            ring.push(fragment.data(), fragment.size());
+        } else {
+            deliver(fragment.data(), fragment.size());
+        }
+    }
+
+    if (useWorker) {
+        workerShouldStop = true;
+        worker.join();
+    }
+
+    std::sort(gaps.begin(), gaps.end());
+    auto percentile = [&](double p) -> uint64_t {
+        if (gaps.empty()) {
+            return 0;
+        }
+        return gaps[std::min(gaps.size() - 1, static_cast<size_t>(p * gaps.size()))];
+    };
+
+    JitterResult result{};
+    result.gapP50 = percentile(0.5);
+    result.gapP99 = percentile(0.99);
+    result.gapMax = gaps.empty() ? 0 : gaps.back();
+    result.maxLateUs = maxLate;
+    result.dropped = ring.droppedCount();
+    result.highWater = ring.highWaterMark();
+    result.delivered = aggregator.outPackets;
+    return result;
+}
+
+/// The fragments of `packetCount` packets after the loss model, as the adapter would receive them.
+std::vector<std::vector<uint8_t>> makeAirFragments(const FecCase &fecCase,
+                                                   size_t payloadSize,
+                                                   size_t packetCount,
+                                                   LossModel loss,
+                                                   const std::string &txKey) {
+    LoopbackTransmitter transmitter(fecCase.k, fecCase.n, txKey);
+    std::mt19937 rng(1234);
+
+    std::vector<std::vector<uint8_t>> fragments;
+    auto drain = [&] {
+        while (!transmitter.queue.empty()) {
+            auto fragment = std::move(transmitter.queue.front());
+            transmitter.queue.pop_front();
+            if (fragment[0] == WFB_PACKET_SESSION || !loss.lost(rng)) {
+                fragments.push_back(std::move(fragment));
+            }
+        }
+    };
+
+    transmitter.sendSessionKey();
+    drain();
+
+    std::vector<uint8_t> payload(payloadSize);
+    for (uint64_t seq = 0; seq < packetCount; seq++) {
+        memcpy(payload.data(), &seq, sizeof(seq));
+        transmitter.sendPacket(payload.data(), payload.size(), 0);
+        drain();
+    }
+    while (transmitter.sendPacket(payload.data(), 0, WFB_PACKET_FEC_ONLY)) {
+        drain();
+    }
+    drain();
+
+    return fragments;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (sodium_init() < 0) {
+        fprintf(stderr, "libsodium init failed\n");
+        return 1;
+    }
+
+    const size_t packetCount = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000;
+
+    std::vector<LossModel> lossModels;
+    if (argc > 2) {
+        LossModel model;
+        if (!LossModel::parse(argv[2], model)) {
+            fprintf(stderr, "Invalid loss model: %s\n", argv[2]);
+            return 1;
+        }
+        lossModels.push_back(model);
+    } else {
+        for (auto str : {"none", "iid:0.05", "ge:0.01,0.2,0.001,0.5"}) {
+            LossModel model;
+            LossModel::parse(str, model);
+            lossModels.push_back(model);
+        }
+    }
+
+    ChannelOptions channel;
+    channel.reorder = argc > 3 ? atof(argv[3]) : 0;
+    channel.duplicate = argc > 4 ? atof(argv[4]) : 0;
+
+    // A throwaway key pair, so the benchmark does not depend on the key files.
+    const std::string txKey = "/tmp/loopback_bench_tx.key";
+    const std::string rxKey = "/tmp/loopback_bench_rx.key";
+    if (!writeKeyPair(txKey, rxKey)) {
+        fprintf(stderr, "Unable to write key files\n");
+        return 1;
+    }
+
+    printf("%zu packets per run, reorder %.3f, duplicate %.3f, FEC: %s\n",
+           packetCount,
+           channel.reorder,
+           channel.duplicate,
+           fec_simd_name());
+    printf("%-24s %5s %6s %10s %8s %9s %8s %8s %7s %7s %7s %7s\n",
+           "loss",
+           "k/n",
+           "size",
+           "pkt/s",
+           "MB/s",
+           "delivered",
+           "recov",
+           "lost",
+           "p50 us",
+           "p90 us",
+           "p99 us",
+           "max us");
+
+    for (const auto &loss : lossModels) {
+        for (const auto &fecCase : FEC_CASES) {
+            for (auto size : PAYLOAD_SIZES) {
+                channel.loss = loss;
+                auto r = run(fecCase, size, packetCount, channel, txKey, rxKey);
+
+                char kn[16];
+                snprintf(kn, sizeof(kn), "%d/%d", fecCase.k, fecCase.n);
+                printf("%-24s %5s %6zu %10.0f %8.1f %8.2f%% %8u %8u %7llu %7llu %7llu %7llu\n",
+                       loss.name.c_str(),
+                       kn,
+                       size,
+                       r.packetsPerSecond,
+                       r.mbPerSecond,
+                       100.0 * r.delivered / r.sent,
+                       r.recovered,
+                       r.lost,
+                       (unsigned long long)r.p50,
+                       (unsigned long long)r.p90,
+                       (unsigned long long)r.p99,
+                       (unsigned long long)r.max);
+            }
+        }
+    }
+
+    {
+        const FecCase fecCase = {8, 12};
+        const size_t size = 1024;
+        LossModel loss;
+        LossModel::parse("iid:0.05", loss);
+
+        auto fragments = makeAirFragments(fecCase, size, std::min<size_t>(packetCount, 100000), loss, txKey);
+
+        printf("\nUSB read jitter, %zu fragments read every %llu us, k/n %d/%d, size %zu, loss %s\n",
+               fragments.size(),
+               (unsigned long long)USB_READ_INTERVAL_US,
+               fecCase.k,
+               fecCase.n,
+               size,
+               loss.name.c_str());
+        printf("%-8s %9s %9s %9s %12s %9s %10s %9s\n",
+               "mode",
+               "gap p50",
+               "gap p99",
+               "gap max",
+               "max late us",
+               "dropped",
+               "high water",
+               "delivered");
+
+        for (bool useWorker : {false, true}) {
+            auto r = runUsbJitter(fragments, useWorker, rxKey);
+            printf("%-8s %9llu %9llu %9llu %12llu %9llu %10llu %9llu\n",
+                   useWorker ? "worker" : "inline",
+                   (unsigned long long)r.gapP50,
+                   (unsigned long long)r.gapP99,
+                   (unsigned long long)r.gapMax,
+                   (unsigned long long)r.maxLateUs,
+                   (unsigned long long)r.dropped,
+                   (unsigned long long)r.highWater,
+                   (unsigned long long)r.delivered);
+        }
+    }
+
+    remove(txKey.c_str());
+    remove(rxKey.c_str());
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+// Channel loss models shared by the benchmarks and simulators.
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+/// Decides per fragment whether it gets lost on the air.
+struct LossModel {
+    enum class Type {
+        None,
+        Iid,
+        GilbertElliott,
+    };
+
+    Type type = Type::None;
+    /// I.i.d. loss probability
+    double p = 0;
+    /// Gilbert-Elliott: transition probabilities good->bad and bad->good, and loss probability in each state
+    double pGoodToBad = 0;
+    double pBadToGood = 0;
+    double lossGood = 0;
+    double lossBad = 0;
+
+    std::string name;
+
+    static bool parse(const std::string &str, LossModel &model) {
+        model = {};
+        model.name = str;
+        if (str == "none") {
+            return true;
+        }
+        if (str.rfind("iid:", 0) == 0) {
+            model.type = Type::Iid;
+            model.p = atof(str.c_str() + 4);
+            return true;
+        }
+        if (str.rfind("ge:", 0) == 0) {
+            model.type = Type::GilbertElliott;
+            return sscanf(str.c_str() + 3,
+                          "%lf,%lf,%lf,%lf",
+                          &model.pGoodToBad,
+                          &model.pBadToGood,
+                          &model.lossGood,
+                          &model.lossBad) == 4;
+        }
+        return false;
+    }
+
+    bool lost(std::mt19937 &rng) {
+        std::uniform_real_distribution<double> dist(0, 1);
+
+        switch (type) {
+            case Type::None:
+                return false;
+            case Type::Iid:
+                return dist(rng) < p;
+            case Type::GilbertElliott: {
+                if (bad_) {
+                    bad_ = dist(rng) >= pBadToGood;
+                } else {
+                    bad_ = dist(rng) < pGoodToBad;
+                }
+                return dist(rng) < (bad_ ? lossBad : lossGood);
+            }
+        }
+        return false;
+    }
+
+private:
+    bool bad_ = false;
+};
@@ -0,0 +1,134 @@
+// Replays a capture of raw 802.11 frames (see src/wifi/frame_capture.h) through the wfb-ng
+// aggregator, decryption and FEC, without an adapter, and reports the throughput.
+// Captures are recorded in the app with "Record 802.11 frames".
+//
+// Usage: replay_bench <capture.avfc> [gs.key] [speed]
+//   speed: 0 (default) replays as fast as possible, 1 with the original timing, N N times faster.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <string>
+
+#include "frame_capture.h"
+#include "rx.hpp"
+#include "rx_frame.h"
+
+namespace {
+
+// sha1 hash of link_domain="default", same as WfbngLink
+constexpr uint32_t LINK_ID = 7669206;
+constexpr uint8_t VIDEO_RADIO_PORT = 0;
+
+class CountingAggregator : public Aggregator {
+public:
+    CountingAggregator(const std::string &keypair, uint32_t channel_id) : Aggregator(keypair, 0, channel_id) {}
+
+    uint64_t outPackets = 0;
+    uint64_t outBytes = 0;
+
+protected:
+    void send_to_socket(const uint8_t *payload, uint16_t packet_size) override {
+        outPackets++;
+        outBytes += packet_size;
+    }
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <capture%s> [gs.key] [speed]\n", argv[0], FRAME_CAPTURE_EXTENSION);
+        return 1;
+    }
+
+    const std::string capturePath = argv[1];
+    const std::string keyPath = argc > 2 ? argv[2] : AVIATEUR_DEFAULT_GS_KEY;
+    const double speed = argc > 3 ? atof(argv[3]) : 0;
+
+    FrameCaptureReader reader;
+    if (!reader.open(capturePath)) {
+        fprintf(stderr, "Invalid capture file: %s\n", capturePath.c_str());
+        return 1;
+    }
+
+    const uint32_t videoChannelId = (LINK_ID << 8) + VIDEO_RADIO_PORT;
+
+    CountingAggregator aggregator(keyPath, videoChannelId);
+
+    uint64_t frames = 0;
+    uint64_t wfbFrames = 0;
+    uint64_t videoFrames = 0;
+    uint64_t inBytes = 0;
+    double aggregatorSeconds = 0;
+
+    std::atomic<bool> shouldStop = false;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    replayFrameCapture(
+        reader,
+        speed,
+        [&](const CapturedFrame &captured) {
+            frames++;
+
+            auto data = std::span(const_cast<uint8_t *>(captured.data.data()), captured.data.size());
+            RxFrame frame(data);
+            if (!frame.IsValidWfbFrame()) {
+                return;
+            }
+            wfbFrames++;
+
+            if (frame.GetChannelID() != videoChannelId || data.size() < sizeof(ieee80211_header) + 4) {
+                return;
+            }
+            videoFrames++;
+            inBytes += data.size();
+
+            const uint8_t antenna[RX_ANT_MAX] = {0, 1, 0xff, 0xff};
+            const int8_t rssi[RX_ANT_MAX] = {static_cast<int8_t>(captured.rssi[0]),
+                                             static_cast<int8_t>(captured.rssi[1])};
+            const int8_t noise[RX_ANT_MAX] = {static_cast<int8_t>(rssi[0] - captured.snr[0]),
+                                              static_cast<int8_t>(rssi[1] - captured.snr[1])};
+
+            const auto t0 = std::chrono::steady_clock::now();
+            aggregator.process_packet(data.data() + sizeof(ieee80211_header),
+                                      data.size() - sizeof(ieee80211_header) - 4,
+                                      captured.wlanIdx,
+                                      antenna,
+                                      rssi,
+                                      noise,
+                                      0,
+                                      0,
+                                      0,
+                                      nullptr);
+            aggregatorSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        },
+        shouldStop);
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("Capture: %s\n", capturePath.c_str());
+    printf("Frames: %llu, wfb-ng: %llu, video: %llu\n",
+           (unsigned long long)frames,
+           (unsigned long long)wfbFrames,
+           (unsigned long long)videoFrames);
+    printf("Output: %llu packets, %llu bytes\n",
+           (unsigned long long)aggregator.outPackets,
+           (unsigned long long)aggregator.outBytes);
+    printf("FEC recovered: %u, lost: %u, decrypt errors: %u\n",
+           aggregator.count_p_fec_recovered,
+           aggregator.count_p_lost,
+           aggregator.count_p_dec_err);
+    printf("Wall time: %.3f s (%.0f frames/s)\n", seconds, seconds > 0 ? frames / seconds : 0.0);
+    if (aggregatorSeconds > 0) {
+        printf("Aggregator: %.3f s, %.0f frames/s, %.1f MB/s in\n",
+               aggregatorSeconds,
+               videoFrames / aggregatorSeconds,
+               inBytes / aggregatorSeconds / 1e6);
+    }
+
+    return 0;
+}
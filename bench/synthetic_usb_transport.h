@@ -0,0 +1,147 @@
+#pragma once
+
+// A stand-in for the RTL8812AU bulk-in endpoint, so UsbBulkReceiver can be exercised without hardware.
+// Air data arrives at a fixed rate into a small adapter FIFO. Queued transfers drain the FIFO one after
+// another, whether or not the event thread is busy. While no transfer is queued, the FIFO fills up and
+// overflows, which is exactly the loss that keeping several transfers in flight avoids.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "usb_bulk_receiver.h"
+
+class SyntheticUsbTransport : public UsbTransport {
+public:
+    struct Config {
+        /// Rate at which data arrives at the adapter
+        double bytesPerSecond = 40e6;
+        /// Adapter RX FIFO, data arriving while it is full is lost
+        size_t fifoSize = 32 * 1024;
+        /// Min time from submission to completion, one USB 2.0 microframe by default
+        std::chrono::microseconds turnaround{125};
+    };
+
+    explicit SyntheticUsbTransport(const Config &config) : config_(config), last_(Clock::now()) {}
+
+    bool submit(UsbTransfer &transfer) override {
+        std::lock_guard lock(mutex_);
+        const auto now = Clock::now();
+        advance(now);
+
+        transfer.transport = this;
+        pending_.push_back({&transfer, now + config_.turnaround, false});
+        return true;
+    }
+
+    void cancel(UsbTransfer &transfer) override {
+        std::lock_guard lock(mutex_);
+        for (auto &item : pending_) {
+            if (item.transfer == &transfer) {
+                item.cancelled = true;
+            }
+        }
+    }
+
+    void handleEvents(std::chrono::milliseconds timeout) override {
+        const auto deadline = Clock::now() + timeout;
+
+        while (true) {
+            std::deque<UsbTransfer *> done;
+            {
+                std::lock_guard lock(mutex_);
+                advance(Clock::now());
+                done.swap(done_);
+            }
+
+            // Callbacks run unlocked, they resubmit.
+            for (auto *transfer : done) {
+                complete(*transfer);
+            }
+            if (!done.empty() || Clock::now() >= deadline) {
+                return;
+            }
+
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+    }
+
+    uint64_t arrivedBytes() const {
+        return static_cast<uint64_t>(arrivedBytes_);
+    }
+
+    uint64_t deliveredBytes() const {
+        return deliveredBytes_;
+    }
+
+    /// Lost to a full FIFO
+    uint64_t overflowBytes() const {
+        return static_cast<uint64_t>(overflowBytes_);
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Pending {
+        UsbTransfer *transfer;
+        Clock::time_point readyAt;
+        bool cancelled;
+    };
+
+    /// Let the data that arrived since the last call flow into the queued transfers, like the host
+    /// controller does on its own while the CPU is busy elsewhere.
+    void advance(Clock::time_point now) {
+        const double arrived = config_.bytesPerSecond * std::chrono::duration<double>(now - last_).count();
+        last_ = now;
+
+        arrivedBytes_ += arrived;
+        fifoBytes_ += arrived;
+
+        // Transfers complete in submission order, each one a turnaround after the previous one.
+        while (!pending_.empty()) {
+            auto &item = pending_.front();
+            UsbTransfer &transfer = *item.transfer;
+
+            if (item.cancelled) {
+                transfer.status = UsbTransferStatus::Cancelled;
+                transfer.actualLength = 0;
+            } else if (item.readyAt <= now && fifoBytes_ >= 1) {
+                const size_t size = std::min(static_cast<size_t>(fifoBytes_), transfer.capacity);
+                memset(transfer.buffer, static_cast<int>(deliveredBytes_ & 0xff), size);
+                fifoBytes_ -= size;
+                deliveredBytes_ += size;
+                transfer.status = UsbTransferStatus::Completed;
+                transfer.actualLength = size;
+
+                if (pending_.size() > 1) {
+                    pending_[1].readyAt = std::max(pending_[1].readyAt, item.readyAt + config_.turnaround);
+                }
+            } else {
+                break;
+            }
+
+            done_.push_back(&transfer);
+            pending_.pop_front();
+        }
+
+        if (fifoBytes_ > config_.fifoSize) {
+            overflowBytes_ += fifoBytes_ - config_.fifoSize;
+            fifoBytes_ = config_.fifoSize;
+        }
+    }
+
+    Config config_;
+    std::mutex mutex_;
+    std::deque<Pending> pending_;
+    /// Filled or cancelled, waiting for handleEvents() to report them
+    std::deque<UsbTransfer *> done_;
+    Clock::time_point last_;
+
+    double fifoBytes_ = 0;
+    double arrivedBytes_ = 0;
+    double overflowBytes_ = 0;
+    uint64_t deliveredBytes_ = 0;
+};
@@ -0,0 +1,129 @@
+// Runs UsbBulkReceiver against a synthetic bulk-in endpoint (see synthetic_usb_transport.h) and shows how
+// the number of transfers in flight affects throughput, adapter FIFO overflow and completion jitter.
+// One transfer in flight behaves like the synchronous read loop.
+//
+// Usage: usb_rx_bench [seconds per run] [MB/s arriving] [us of work per completion]
+//   The work stands in for splitting the transfer into frames and queueing them for the RX workers.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "synthetic_usb_transport.h"
+#include "usb_bulk_receiver.h"
+
+namespace {
+
+constexpr int TRANSFER_COUNTS[] = {1, 2, 4, 8, 16};
+
+constexpr size_t TRANSFER_SIZES[] = {16 * 1024, 64 * 1024};
+
+uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void busyWaitUs(uint64_t us) {
+    const uint64_t end = nowUs() + us;
+    while (nowUs() < end) {
+    }
+}
+
+struct RunResult {
+    double mbPerSecond;
+    double overflowPercent;
+    uint64_t completions;
+    uint64_t gapP50;
+    uint64_t gapP99;
+    uint64_t gapMax;
+};
+
+RunResult run(int transferCount, size_t transferSize, double seconds, double bytesPerSecond, uint64_t workUs) {
+    SyntheticUsbTransport::Config endpoint;
+    endpoint.bytesPerSecond = bytesPerSecond;
+    SyntheticUsbTransport transport(endpoint);
+
+    std::vector<uint64_t> gaps;
+    uint64_t lastCompletion = 0;
+
+    UsbBulkReceiver receiver(transport, {transferCount, transferSize}, [&](std::span<uint8_t> data) {
+        const uint64_t now = nowUs();
+        if (lastCompletion != 0) {
+            gaps.push_back(now - lastCompletion);
+        }
+        lastCompletion = now;
+
+        busyWaitUs(workUs);
+    });
+
+    UsbEventThread events([&](std::chrono::milliseconds timeout) { transport.handleEvents(timeout); });
+
+    const auto start = std::chrono::steady_clock::now();
+    receiver.start();
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    receiver.stop();
+    events.stop();
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::sort(gaps.begin(), gaps.end());
+    auto percentile = [&](double p) -> uint64_t {
+        if (gaps.empty()) {
+            return 0;
+        }
+        return gaps[std::min(gaps.size() - 1, static_cast<size_t>(p * gaps.size()))];
+    };
+
+    const auto stats = receiver.stats();
+
+    RunResult result{};
+    result.mbPerSecond = stats.bytes / elapsed / 1e6;
+    result.overflowPercent =
+        transport.arrivedBytes() == 0 ? 0 : 100.0 * transport.overflowBytes() / transport.arrivedBytes();
+    result.completions = stats.completed;
+    result.gapP50 = percentile(0.5);
+    result.gapP99 = percentile(0.99);
+    result.gapMax = gaps.empty() ? 0 : gaps.back();
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    const double seconds = argc > 1 ? atof(argv[1]) : 2;
+    const double mbPerSecond = argc > 2 ? atof(argv[2]) : 40;
+    const uint64_t workUs = argc > 3 ? strtoull(argv[3], nullptr, 10) : 300;
+
+    printf("%.1f s per run, %.1f MB/s arriving, %llu us of work per completion\n",
+           seconds,
+           mbPerSecond,
+           (unsigned long long)workUs);
+    printf("%9s %6s %8s %10s %12s %8s %8s %8s\n",
+           "transfers",
+           "size",
+           "MB/s",
+           "overflow",
+           "completions",
+           "p50 us",
+           "p99 us",
+           "max us");
+
+    for (auto size : TRANSFER_SIZES) {
+        for (auto count : TRANSFER_COUNTS) {
+            auto r = run(count, size, seconds, mbPerSecond * 1e6, workUs);
+            printf("%9d %5zuK %8.1f %9.2f%% %12llu %8llu %8llu %8llu\n",
+                   count,
+                   size / 1024,
+                   r.mbPerSecond,
+                   r.overflowPercent,
+                   (unsigned long long)r.completions,
+                   (unsigned long long)r.gapP50,
+                   (unsigned long long)r.gapP99,
+                   (unsigned long long)r.gapMax);
+        }
+    }
+
+    return 0;
+}
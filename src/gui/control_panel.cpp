@@ -4,6 +4,13 @@
 
 #include "settings_tab.h"
 
+namespace {
+
+/// Replay speed per menu item, 0 being as fast as possible. The first item turns replay off.
+constexpr double REPLAY_SPEEDS[] = {-1, 1, 2, 4, 0};
+
+} // namespace
+
 void ControlPanel::update_dongle_list() {
     auto menu = dongle_menu_button_->get_popup_menu().lock();
 
@@ -24,6 +31,32 @@ void ControlPanel::update_dongle_list() {
         dongle_name = "";
         selected_dongle = {};
     }
+
+    update_diversity_list();
+}
+
+void ControlPanel::update_diversity_list() {
+    if (!diversity_menu_button_) {
+        return;
+    }
+
+    auto menu = diversity_menu_button_->get_popup_menu().lock();
+
+    menu->clear_items();
+    menu->create_item(FTR("none"));
+
+    uint32_t selected = 0;
+    for (const auto &d : devices_) {
+        menu->create_item(d.display_name);
+        if (diversity_dongle_name == d.display_name) {
+            selected = menu->get_item_count() - 1;
+        }
+    }
+
+    if (selected == 0) {
+        diversity_dongle_name = "";
+    }
+    diversity_menu_button_->select_item(selected);
 }
 
 void ControlPanel::update_adapter_start_button_looking(bool start_status) const {
@@ -63,6 +96,7 @@ void ControlPanel::update_url_start_button_looking(bool start_status) const {
 void ControlPanel::custom_ready() {
     auto &ini = GuiInterface::Instance().ini_;
     dongle_name = ini[CONFIG_WIFI][WIFI_DEVICE];
+    diversity_dongle_name = ini[CONFIG_WIFI][WIFI_DIVERSITY_DEVICE];
     channel = std::stoi(ini[CONFIG_WIFI][WIFI_CHANNEL]);
     channelWidthMode = std::stoi(ini[CONFIG_WIFI][WIFI_CHANNEL_WIDTH_MODE]);
     keyPath = ini[CONFIG_WIFI][WIFI_GS_KEY];
@@ -139,6 +173,35 @@ void ControlPanel::custom_ready() {
             refresh_dongle_button_->connect_signal("pressed", callback2);
         }
 
+        // An extra adapter on the same channel, its packets are merged before FEC.
+        {
+            auto hbox_container = std::make_shared<revector::HBoxContainer>();
+            hbox_container->set_separation(8);
+            vbox_blockable->add_child(hbox_container);
+
+            auto label = std::make_shared<revector::Label>();
+            label->set_text(FTR("diversity device"));
+            hbox_container->add_child(label);
+
+            diversity_menu_button_ = std::make_shared<revector::MenuButton>();
+            diversity_menu_button_->set_custom_minimum_size({0, 32});
+            diversity_menu_button_->container_sizing.expand_h = true;
+            diversity_menu_button_->container_sizing.flag_h = revector::ContainerSizingFlag::Fill;
+            hbox_container->add_child(diversity_menu_button_);
+
+            update_diversity_list();
+
+            auto callback = [this](uint32_t) {
+                auto selected = diversity_menu_button_->get_selected_item_index();
+                if (selected.has_value() && selected.value() > 0) {
+                    diversity_dongle_name = diversity_menu_button_->get_selected_item_text();
+                } else {
+                    diversity_dongle_name = "";
+                }
+            };
+            diversity_menu_button_->connect_signal("item_selected", callback);
+        }
+
         {
             auto hbox_container = std::make_shared<revector::HBoxContainer>();
             vbox_blockable->add_child(hbox_container);
@@ -250,6 +313,69 @@ void ControlPanel::custom_ready() {
             hbox_container->add_child(select_button);
         }
 
+        // Replay a recorded capture through the whole receive pipeline, without an adapter.
+        {
+            auto hbox_container = std::make_shared<revector::HBoxContainer>();
+            vbox_blockable->add_child(hbox_container);
+
+            auto label = std::make_shared<revector::Label>();
+            label->set_text(FTR("replay"));
+            hbox_container->add_child(label);
+
+            auto speed_button = std::make_shared<revector::MenuButton>();
+            hbox_container->add_child(speed_button);
+
+            auto speed_menu = speed_button->get_popup_menu().lock();
+            speed_menu->create_item(FTR("off"));
+            speed_menu->create_item("1x");
+            speed_menu->create_item("2x");
+            speed_menu->create_item("4x");
+            speed_menu->create_item(FTR("max speed"));
+            speed_button->select_item(0);
+
+            auto text_edit = std::make_shared<revector::TextEdit>();
+            text_edit->set_editable(false);
+            text_edit->set_text(FTR("none"));
+            text_edit->container_sizing.expand_h = true;
+            text_edit->container_sizing.flag_h = revector::ContainerSizingFlag::Fill;
+            hbox_container->add_child(text_edit);
+
+            auto file_dialog = std::make_shared<revector::FileDialog>();
+            file_dialog->set_default_path(GuiInterface::GetCaptureDir());
+            add_child(file_dialog);
+
+            auto select_button = std::make_shared<revector::Button>();
+            select_button->set_text(FTR("open"));
+            hbox_container->add_child(select_button);
+
+            std::weak_ptr speed_button_weak = speed_button;
+            auto speed_callback = [this, speed_button_weak](uint32_t) {
+                auto selected = speed_button_weak.lock()->get_selected_item_index();
+                if (selected.has_value()) {
+                    replay_speed_index = selected.value();
+                }
+            };
+            speed_button->connect_signal("item_selected", speed_callback);
+
+            std::weak_ptr file_dialog_weak = file_dialog;
+            std::weak_ptr text_edit_weak = text_edit;
+            auto callback = [this, file_dialog_weak, text_edit_weak, speed_button_weak] {
+                auto path = file_dialog_weak.lock()->show();
+                if (path.has_value()) {
+                    std::filesystem::path p(path.value());
+                    text_edit_weak.lock()->set_text(p.filename().string());
+                    replay_path = path.value();
+
+                    // Picking a file means the user wants to replay it.
+                    if (replay_speed_index == 0) {
+                        replay_speed_index = 1;
+                        speed_button_weak.lock()->select_item(1);
+                    }
+                }
+            };
+            select_button->connect_signal("pressed", callback);
+        }
+
 #ifdef __linux__
         {
             auto alink_con = std::make_shared<revector::CollapseContainer>(revector::CollapseButtonType::Check);
@@ -311,6 +437,14 @@ void ControlPanel::custom_ready() {
         }
 #endif
 
+        {
+            auto capture_btn = std::make_shared<revector::CheckButton>();
+            capture_btn->set_text(FTR("record 802.11 frames"));
+            vbox_unblockable->add_child(capture_btn);
+            auto callback = [](bool toggled) { GuiInterface::EnableFrameCapture(toggled); };
+            capture_btn->connect_signal("toggled", callback);
+        }
+
         {
             play_button_ = std::make_shared<revector::Button>();
             play_button_->set_custom_minimum_size({0, 48});
@@ -321,16 +455,28 @@ void ControlPanel::custom_ready() {
             auto callback1 = [this] {
                 bool start = play_button_->get_text() == FTR("start") + " (F5)";
 
-                if (start) {
+                if (start && replay_speed_index > 0 && !replay_path.empty()) {
+                    bool res = GuiInterface::StartReplay(replay_path, keyPath, REPLAY_SPEEDS[replay_speed_index]);
+                    if (!res) {
+                        start = false;
+                    }
+                } else if (start) {
                     std::optional<DeviceId> target_device_id;
+                    std::vector<DeviceId> diversity_device_ids;
                     for (auto &d : devices_) {
                         if (dongle_name == d.display_name) {
                             target_device_id = d;
+                        } else if (diversity_dongle_name == d.display_name) {
+                            diversity_device_ids.push_back(d);
                         }
                     }
 
                     if (target_device_id.has_value()) {
-                        bool res = GuiInterface::Start(target_device_id.value(), channel, channelWidthMode, keyPath);
+                        bool res = GuiInterface::Start(target_device_id.value(),
+                                                       channel,
+                                                       channelWidthMode,
+                                                       keyPath,
+                                                       diversity_device_ids);
                         if (!res) {
                             start = false;
                         }
@@ -6,6 +6,7 @@
 class ControlPanel : public revector::Container {
 public:
     std::shared_ptr<revector::MenuButton> dongle_menu_button_;
+    std::shared_ptr<revector::MenuButton> diversity_menu_button_;
     std::shared_ptr<revector::MenuButton> channel_button_;
     std::shared_ptr<revector::MenuButton> channel_width_button_;
     std::shared_ptr<revector::Button> refresh_dongle_button_;
@@ -17,9 +18,15 @@ public:
 
     std::string dongle_name;
     std::optional<DeviceId> selected_dongle;
+    /// Extra adapter for diversity receive, empty if none.
+    std::string diversity_dongle_name;
     uint32_t channel = 0;
     uint32_t channelWidthMode = 0;
     std::string keyPath;
+    /// Replay a capture file instead of receiving from the adapter.
+    std::string replay_path;
+    /// Index into REPLAY_SPEEDS, 0 being off.
+    uint32_t replay_speed_index = 0;
 
     std::shared_ptr<revector::Button> play_button_;
 
@@ -33,6 +40,8 @@ public:
 
     void update_dongle_list();
 
+    void update_diversity_list();
+
     void update_adapter_start_button_looking(bool start_status) const;
 
     void update_url_start_button_looking(bool start_status) const;
@@ -144,16 +144,40 @@ void PlayerRect::custom_ready() {
         display_fps_label_ = std::make_shared<revector::Label>();
         hud_container_->add_child(display_fps_label_);
         display_fps_label_->set_text(FTR("display fps") + ":");
+
+        present_label_ = std::make_shared<revector::Label>();
+        hud_container_->add_child(present_label_);
     }
 
     hw_status_label_ = std::make_shared<revector::Label>();
     hud_container_->add_child(hw_status_label_);
 
+    {
+        link_stats_label_ = std::make_shared<revector::Label>();
+        hud_container_->add_child(link_stats_label_);
+
+        auto onStatsUpdated = [this](LinkStats stats) {
+            std::string text = std::format("802.11: {} WFB: {} RTP: {}",
+                                           stats.wifiFrameCount,
+                                           stats.wfbFrameCount,
+                                           stats.rtpPktCount);
+            // Age of the last uplink message when it reached the radio
+            if (stats.uplink.sent > 0) {
+                text += std::format(" UL: {} us", stats.uplink.ageLastUs);
+            }
+            link_stats_label_->set_text(text);
+        };
+        GuiInterface::Instance().statsUpdatedCallbacks.emplace_back(onStatsUpdated);
+    }
+
 #ifdef __linux__
     pl_label_ = std::make_shared<revector::Label>();
     hud_container_->add_child(pl_label_);
     fec_label_ = std::make_shared<revector::Label>();
     hud_container_->add_child(fec_label_);
+    rx_adapters_label_ = std::make_shared<revector::Label>();
+    hud_container_->add_child(rx_adapters_label_);
+    rx_adapters_label_->set_visibility(false);
 #endif
 
     rx_status_update_timer = std::make_shared<revector::Timer>();
@@ -165,6 +189,30 @@ void PlayerRect::custom_ready() {
 #ifdef __linux__
         pl_label_->set_text("PL: " + std::format("{:.1f}", GuiInterface::Instance().packet_loss_) + "%");
         fec_label_->set_text("FEC: " + std::to_string(GuiInterface::Instance().drone_fec_level_));
+
+        // Which adapter delivered the packets during the last second.
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_rx_adapter_stats_time_ >= std::chrono::seconds(1)) {
+            auto stats = WfbngLink::Instance().get_rx_adapter_stats();
+
+            if (stats.size() > 1 && stats.size() == last_rx_adapter_stats_.size()) {
+                uint64_t total = 0;
+                for (size_t i = 0; i < stats.size(); i++) {
+                    total += stats[i].unique_packets - last_rx_adapter_stats_[i].unique_packets;
+                }
+
+                std::string text = "RX";
+                for (size_t i = 0; i < stats.size(); i++) {
+                    uint64_t unique = stats[i].unique_packets - last_rx_adapter_stats_[i].unique_packets;
+                    text += std::format(" {}: {}%", i + 1, total == 0 ? 0 : unique * 100 / total);
+                }
+                rx_adapters_label_->set_text(text);
+            }
+            rx_adapters_label_->set_visibility(stats.size() > 1);
+
+            last_rx_adapter_stats_ = std::move(stats);
+            last_rx_adapter_stats_time_ = now;
+        }
 #endif
 
         rx_status_update_timer->start_timer(0.1);
@@ -298,6 +346,23 @@ void PlayerRect::custom_update(double dt) {
     display_fps_label_->set_text(FTR("display fps") + ": " +
                                  std::to_string(revector::Engine::get_singleton()->get_fps_int()));
 
+    // Video frames over the last second.
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_present_stats_time_ >= std::chrono::seconds(1)) {
+        auto stats = player_->presentStats();
+
+        uint64_t presented = stats.presented - last_present_stats_.presented;
+        uint64_t skipped = stats.skipped - last_present_stats_.skipped;
+        uint64_t age_sum_us = stats.ageSumUs - last_present_stats_.ageSumUs;
+        present_label_->set_text(std::format("Frames: {} Skip: {} Age: {:.1f} ms",
+                                             presented,
+                                             skipped,
+                                             presented == 0 ? 0.0 : age_sum_us / 1000.0 / presented));
+
+        last_present_stats_ = stats;
+        last_present_stats_time_ = now;
+    }
+
     if (is_recording) {
         std::chrono::duration<double, std::chrono::seconds::period> duration =
             std::chrono::steady_clock::now() - record_start_time;
@@ -348,6 +413,7 @@ void PlayerRect::start_playing(const std::string &url) {
     } else
 #endif
     {
+        player_->setLowLatencyDisplay(GuiInterface::Instance().low_latency_display_);
         player_->play(url, force_software_decoding);
         texture = render_image_;
         collapse_panel_->set_visibility(true);
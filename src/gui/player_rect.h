@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../gui_interface.h"
 #include "../player/real_time_player.h"
 #include "app.h"
 #include "tip_label.h"
@@ -43,12 +44,25 @@ public:
 
     std::shared_ptr<revector::Label> fec_label_;
 
+    /// Share of unique video packets per adapter, only shown with diversity receive.
+    std::shared_ptr<revector::Label> rx_adapters_label_;
+    std::vector<RxAdapterStats> last_rx_adapter_stats_;
+    std::chrono::time_point<std::chrono::steady_clock> last_rx_adapter_stats_time_;
+
     std::shared_ptr<SignalBar> lq_bar_;
 
     std::shared_ptr<revector::Label> video_info_label_;
 
     std::shared_ptr<revector::Label> display_fps_label_;
 
+    /// Received 802.11 frames, wfb-ng frames and RTP packets
+    std::shared_ptr<revector::Label> link_stats_label_;
+
+    /// Frames shown and skipped per second, and their age from decoding to display.
+    std::shared_ptr<revector::Label> present_label_;
+    RealTimePlayer::PresentStats last_present_stats_;
+    std::chrono::time_point<std::chrono::steady_clock> last_present_stats_time_;
+
     std::shared_ptr<revector::Button> video_stabilization_button_;
     std::shared_ptr<revector::Button> low_light_enhancement_button_;
 
@@ -74,6 +74,24 @@ void SettingsContainer::custom_ready() {
 
 #endif
 
+    {
+        auto in_process_rtp_btn = std::make_shared<revector::CheckButton>();
+        in_process_rtp_btn->set_text(FTR("in-process rtp"));
+        vbox_container->add_child(in_process_rtp_btn);
+        in_process_rtp_btn->set_pressed_no_signal(GuiInterface::Instance().in_process_rtp_);
+        auto callback = [this](bool toggled) { GuiInterface::Instance().in_process_rtp_ = toggled; };
+        in_process_rtp_btn->connect_signal("toggled", callback);
+    }
+
+    {
+        auto low_latency_display_btn = std::make_shared<revector::CheckButton>();
+        low_latency_display_btn->set_text(FTR("low latency display"));
+        vbox_container->add_child(low_latency_display_btn);
+        low_latency_display_btn->set_pressed_no_signal(GuiInterface::Instance().low_latency_display_);
+        auto callback = [this](bool toggled) { GuiInterface::Instance().low_latency_display_ = toggled; };
+        low_latency_display_btn->connect_signal("toggled", callback);
+    }
+
     {
         auto dark_mode_btn = std::make_shared<revector::CheckButton>();
         dark_mode_btn->set_text(FTR("dark mode"));
@@ -7,6 +7,7 @@
 #include <filesystem>
 #include <fstream>
 #include <future>
+#include <mutex>
 #include <nlohmann/json.hpp>
 
 #ifdef __linux__
@@ -15,6 +16,7 @@
 #endif
 
 #include "app.h"
+#include "wifi/stat_counter.h"
 #include "wifi/wfbng_link.h"
 
 #define CONFIG_FILE "config.ini"
@@ -24,11 +26,15 @@
 
 #define CONFIG_WIFI "wifi"
 #define WIFI_DEVICE "pid_vid"
+#define WIFI_DIVERSITY_DEVICE "diversity_pid_vid"
 #define WIFI_CHANNEL "channel"
 #define WIFI_CHANNEL_WIDTH_MODE "channel_width_mode"
 #define WIFI_GS_KEY "key"
 #define WIFI_ALINK_ENABLED "alink_enabled"
 #define WIFI_ALINK_TX_POWER "alink_tx_power"
+#define WIFI_FEC_CONTROLLER "fec_controller"
+#define WIFI_USB_TRANSFERS "usb_transfers"
+#define WIFI_USB_TRANSFER_SIZE "usb_transfer_size"
 
 #define CONFIG_LOCALHOST "localhost"
 #define CONFIG_LOCALHOST_PORT "port"
@@ -38,11 +44,16 @@
 #define CONFIG_SETTINGS_LANG "language"
 #define CONFIG_SETTINGS_DARK_MODE "dark_mode"
 #define CONFIG_SETTINGS_MEDIA_BACKEND "media_backend"
+#define CONFIG_SETTINGS_INPROCESS_RTP "inprocess_rtp"
+#define CONFIG_SETTINGS_LOW_LATENCY_DISPLAY "low_latency_display"
 
 #define DEFAULT_PORT 52356
 
 constexpr auto LOGGER_MODULE = "Aviateur";
 
+/// URL scheme of the RTP stream handed over in-process by WfbngLink, followed by the codec name.
+constexpr auto INPROC_RTP_URL_PREFIX = "inproc://";
+
 /// Bump this if the config structure changes.
 constexpr auto CONFIG_VERSION_NUM = 5;
 
@@ -92,6 +103,36 @@ inline std::string IniToString(const mINI::INIStructure &ini) {
     return oss.str();
 }
 
+/// How often the link counters are pushed to the GUI.
+constexpr int STATS_PUBLISH_HZ = 10;
+
+/// Messages the link queued to its TX thread in-process (adaptive link, keyframe requests), since the link started.
+/// Stays empty without a TX thread, e.g. on replay.
+struct UplinkStats {
+    long long sent = 0;
+    long long dropped = 0;
+    /// Time from queueing a message until it was handed to the radio
+    long long ageLastUs = 0;
+    long long ageAvgUs = 0;
+    long long ageMaxUs = 0;
+
+    bool operator==(const UplinkStats &) const = default;
+};
+
+/// Snapshot of the link counters, published by GuiInterface::PublishStats().
+struct LinkStats {
+    /// Number of received 802.11 frames
+    long long wifiFrameCount = 0;
+    /// Number of received wfb-ng frames
+    long long wfbFrameCount = 0;
+    /// Number of received RTP packets
+    long long rtpPktCount = 0;
+
+    UplinkStats uplink;
+
+    bool operator==(const LinkStats &) const = default;
+};
+
 /// Acts as an interface between GUI and core.
 class GuiInterface {
 public:
@@ -148,6 +189,8 @@ public:
             use_gstreamer_ = ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_MEDIA_BACKEND] != "ffmpeg";
             rtp_codec_ = ini_[CONFIG_LOCALHOST][CONFIG_LOCALHOST_CODEC];
             dark_mode_ = ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_DARK_MODE] == "true";
+            in_process_rtp_ = ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_INPROCESS_RTP] != "false";
+            low_latency_display_ = ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_LOW_LATENCY_DISPLAY] != "false";
         }
     }
 
@@ -202,11 +245,15 @@ public:
             ini[CONFIG_CONFIG][CONFIG_VERSION] = std::to_string(CONFIG_VERSION_NUM);
 
             ini[CONFIG_WIFI][WIFI_DEVICE] = "";
+            ini[CONFIG_WIFI][WIFI_DIVERSITY_DEVICE] = "";
             ini[CONFIG_WIFI][WIFI_CHANNEL] = "161";
             ini[CONFIG_WIFI][WIFI_CHANNEL_WIDTH_MODE] = "0";
             ini[CONFIG_WIFI][WIFI_GS_KEY] = "";
             ini[CONFIG_WIFI][WIFI_ALINK_ENABLED] = "true";
             ini[CONFIG_WIFI][WIFI_ALINK_TX_POWER] = "20";
+            ini[CONFIG_WIFI][WIFI_FEC_CONTROLLER] = "threshold";
+            ini[CONFIG_WIFI][WIFI_USB_TRANSFERS] = "0";
+            ini[CONFIG_WIFI][WIFI_USB_TRANSFER_SIZE] = "65536";
 
             ini[CONFIG_LOCALHOST][CONFIG_LOCALHOST_PORT] = "5600";
             ini[CONFIG_LOCALHOST][CONFIG_LOCALHOST_CODEC] = "H264";
@@ -214,6 +261,8 @@ public:
             ini[CONFIG_SETTINGS][CONFIG_SETTINGS_LANG] = "en";
             ini[CONFIG_SETTINGS][CONFIG_SETTINGS_MEDIA_BACKEND] = "ffmpeg";
             ini[CONFIG_SETTINGS][CONFIG_SETTINGS_DARK_MODE] = "true";
+            ini[CONFIG_SETTINGS][CONFIG_SETTINGS_INPROCESS_RTP] = "true";
+            ini[CONFIG_SETTINGS][CONFIG_SETTINGS_LOW_LATENCY_DISPLAY] = "true";
         }
 
         if (read_success) {
@@ -234,6 +283,9 @@ public:
         Instance().ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_MEDIA_BACKEND] =
             Instance().use_gstreamer_ ? "gstreamer" : "ffmpeg";
         Instance().ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_DARK_MODE] = Instance().dark_mode_ ? "true" : "false";
+        Instance().ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_INPROCESS_RTP] = Instance().in_process_rtp_ ? "true" : "false";
+        Instance().ini_[CONFIG_SETTINGS][CONFIG_SETTINGS_LOW_LATENCY_DISPLAY] =
+            Instance().low_latency_display_ ? "true" : "false";
 
         Instance().ini_[CONFIG_LOCALHOST][CONFIG_LOCALHOST_CODEC] = Instance().rtp_codec_;
 
@@ -257,12 +309,38 @@ public:
         return write_success;
     }
 
-    static bool Start(const DeviceId &deviceId, int channel, int channelWidthMode, std::string gsKeyPath) {
+    static bool Start(const DeviceId &deviceId,
+                      int channel,
+                      int channelWidthMode,
+                      std::string gsKeyPath,
+                      const std::vector<DeviceId> &diversityDeviceIds = {}) {
         Instance().ini_[CONFIG_WIFI][WIFI_DEVICE] = deviceId.display_name;
+        Instance().ini_[CONFIG_WIFI][WIFI_DIVERSITY_DEVICE] =
+            diversityDeviceIds.empty() ? "" : diversityDeviceIds.front().display_name;
         Instance().ini_[CONFIG_WIFI][WIFI_CHANNEL] = std::to_string(channel);
         Instance().ini_[CONFIG_WIFI][WIFI_CHANNEL_WIDTH_MODE] = std::to_string(channelWidthMode);
         Instance().ini_[CONFIG_WIFI][WIFI_GS_KEY] = gsKeyPath;
 
+        // Async USB receive is opt-in, set usb_transfers to e.g. 8 in the config file.
+        UsbRxConfig usb_rx_config;
+        try {
+            if (Instance().ini_[CONFIG_WIFI].has(WIFI_USB_TRANSFERS)) {
+                usb_rx_config.transfer_count = std::stoi(Instance().ini_[CONFIG_WIFI][WIFI_USB_TRANSFERS]);
+            }
+            if (Instance().ini_[CONFIG_WIFI].has(WIFI_USB_TRANSFER_SIZE)) {
+                usb_rx_config.transfer_size = std::stoul(Instance().ini_[CONFIG_WIFI][WIFI_USB_TRANSFER_SIZE]);
+            }
+        } catch (const std::exception &) {
+            Instance().PutLog(LogLevel::Warn, "Invalid USB transfer config, using synchronous reads");
+            usb_rx_config = {};
+        }
+        WfbngLink::Instance().set_usb_rx_config(usb_rx_config);
+
+        // "threshold" or "model", see fec_controller.h.
+        if (Instance().ini_[CONFIG_WIFI].has(WIFI_FEC_CONTROLLER)) {
+            WfbngLink::Instance().set_fec_controller(Instance().ini_[CONFIG_WIFI][WIFI_FEC_CONTROLLER]);
+        }
+
         // Set port.
         Instance().playerPort = GetFreePort(DEFAULT_PORT);
         Instance().PutLog(LogLevel::Info, "Using port: {}", Instance().playerPort);
@@ -272,7 +350,18 @@ public:
             gsKeyPath = revector::get_asset_dir("gs.key");
             Instance().PutLog(LogLevel::Info, "Using GS key: {}", gsKeyPath);
         }
-        return WfbngLink::Instance().start(deviceId, channel, channelWidthMode, gsKeyPath);
+        return WfbngLink::Instance().start(deviceId, channel, channelWidthMode, gsKeyPath, diversityDeviceIds);
+    }
+
+    static bool StartReplay(const std::string &capturePath, std::string gsKeyPath, double speed) {
+        Instance().playerPort = GetFreePort(DEFAULT_PORT);
+        Instance().PutLog(LogLevel::Info, "Using port: {}", Instance().playerPort);
+
+        if (gsKeyPath.empty()) {
+            gsKeyPath = revector::get_asset_dir("gs.key");
+            Instance().PutLog(LogLevel::Info, "Using GS key: {}", gsKeyPath);
+        }
+        return WfbngLink::Instance().start_replay(capturePath, gsKeyPath, speed);
     }
 
     static bool Stop() {
@@ -280,6 +369,33 @@ public:
         return true;
     }
 
+    /// Record the raw 802.11 frames of the link, for replaying them later.
+    static bool EnableFrameCapture(bool enable) {
+        if (!enable) {
+            WfbngLink::Instance().stop_capture();
+            return true;
+        }
+
+        auto dir = GetCaptureDir();
+
+        try {
+            if (!std::filesystem::exists(dir)) {
+                std::filesystem::create_directories(dir);
+            }
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+        }
+
+        std::stringstream filePath;
+        filePath << dir;
+        filePath << std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::system_clock::now().time_since_epoch())
+                        .count()
+                 << FRAME_CAPTURE_EXTENSION;
+
+        return WfbngLink::Instance().start_capture(filePath.str());
+    }
+
     static void EnableAlink(bool enable) {
         Instance().PutLog(LogLevel::Info, "Enable alink: {}", enable);
         WfbngLink::Instance().enable_alink(enable);
@@ -331,20 +447,46 @@ public:
         EmitRtpStream(sdpFile);
     }
 
-    void UpdateCount() {
-        EmitWifiFrameCountUpdated(wifiFrameCount_);
-        EmitWfbFrameCountUpdated(wfbFrameCount_);
-        EmitRtpPktCountUpdated(rtpPktCount_);
+    /// Play the RTP packets WfbngLink puts into its ring, without going through a UDP socket.
+    void NotifyInProcessRtpStream(const std::string &codec) {
+        EmitRtpStream(INPROC_RTP_URL_PREFIX + codec);
+    }
+
+    /// GStreamer reads from the UDP port, so only the FFmpeg backend can take the in-process path.
+    bool UseInProcessRtp() const {
+        return in_process_rtp_ && !use_gstreamer_;
+    }
+
+    /// Snapshot the counters and notify the listeners once, if anything changed.
+    /// The RX path only bumps the counters, the link calls this at STATS_PUBLISH_HZ.
+    /// Safe to call from any thread, e.g. a link being started while the previous run publishes its final counts.
+    void PublishStats(const UplinkStats &uplink = {}) {
+        std::lock_guard lock(statsPublishMutex_);
+
+        LinkStats stats{wifiFrameCount_.load(), wfbFrameCount_.load(), rtpPktCount_.load(), uplink};
+        if (stats == lastPublishedStats_) {
+            return;
+        }
+        lastPublishedStats_ = stats;
+
+        EmitStatsUpdated(stats);
+    }
+
+    void ResetCount() {
+        wifiFrameCount_.reset();
+        wfbFrameCount_.reset();
+        rtpPktCount_.reset();
+        PublishStats();
     }
 
     long long GetWfbFrameCount() const {
-        return wfbFrameCount_;
+        return wfbFrameCount_.load();
     }
     long long GetRtpPktCount() const {
-        return rtpPktCount_;
+        return rtpPktCount_.load();
     }
     long long GetWifiFrameCount() const {
-        return wifiFrameCount_;
+        return wifiFrameCount_.load();
     }
 
     int GetPlayerPort() const {
@@ -419,11 +561,15 @@ public:
     std::string locale_ = "en";
 
     /// Number of received 802.11 frames
-    long long wifiFrameCount_ = 0;
+    StatCounter wifiFrameCount_;
     /// Number of received wfb-ng frames
-    long long wfbFrameCount_ = 0;
+    StatCounter wfbFrameCount_;
     /// Number of received RTP packets
-    long long rtpPktCount_ = 0;
+    StatCounter rtpPktCount_;
+
+    /// Serializes PublishStats(), listeners see the snapshots in order
+    std::mutex statsPublishMutex_;
+    LinkStats lastPublishedStats_{};
 
     int playerPort = 0;
     std::string playerCodec;
@@ -442,13 +588,17 @@ public:
     // Use gstreamer for decoding instead of ffmpeg
     bool use_gstreamer_ = false;
 
+    // Hand RTP packets to the decoder directly instead of via the UDP loopback
+    bool in_process_rtp_ = true;
+
+    // Show the newest decoded frame only, instead of every frame in order
+    bool low_latency_display_ = true;
+
     // Signals.
     std::vector<revector::AnyCallable<void>> logCallbacks;
     std::vector<revector::AnyCallable<void>> tipCallbacks;
     std::vector<revector::AnyCallable<void>> wifiStopCallbacks;
-    std::vector<revector::AnyCallable<void>> wifiFrameCountCallbacks;
-    std::vector<revector::AnyCallable<void>> wfbFrameCountCallbacks;
-    std::vector<revector::AnyCallable<void>> rtpPktCountCallbacks;
+    std::vector<revector::AnyCallable<void>> statsUpdatedCallbacks;
     std::vector<revector::AnyCallable<void>> rtpStreamCallbacks;
     std::vector<revector::AnyCallable<void>> bitrateUpdateCallbacks;
     std::vector<revector::AnyCallable<void>> decoderReadyCallbacks;
@@ -483,30 +633,10 @@ public:
         }
     }
 
-    void EmitWifiFrameCountUpdated(long long count) {
-        for (auto &callback : wifiFrameCountCallbacks) {
-            try {
-                callback.operator()<long long>(std::move(count));
-            } catch (std::bad_any_cast &) {
-                Instance().PutLog(LogLevel::Error, "Mismatched signal argument types!");
-            }
-        }
-    }
-
-    void EmitWfbFrameCountUpdated(long long count) {
-        for (auto &callback : wfbFrameCountCallbacks) {
-            try {
-                callback.operator()<long long>(std::move(count));
-            } catch (std::bad_any_cast &) {
-                Instance().PutLog(LogLevel::Error, "Mismatched signal argument types!");
-            }
-        }
-    }
-
-    void EmitRtpPktCountUpdated(long long count) {
-        for (auto &callback : rtpPktCountCallbacks) {
+    void EmitStatsUpdated(LinkStats stats) {
+        for (auto &callback : statsUpdatedCallbacks) {
             try {
-                callback.operator()<long long>(std::move(count));
+                callback.operator()<LinkStats>(std::move(stats));
             } catch (std::bad_any_cast &) {
                 Instance().PutLog(LogLevel::Error, "Mismatched signal argument types!");
             }
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "ffmpeg_include.h"
+
+template <class T>
+struct AvPoolTraits;
+
+template <>
+struct AvPoolTraits<AVFrame> {
+    static AVFrame *alloc() {
+        return av_frame_alloc();
+    }
+    static void unref(AVFrame *frame) {
+        av_frame_unref(frame);
+    }
+    static void free(AVFrame *frame) {
+        av_frame_free(&frame);
+    }
+};
+
+template <>
+struct AvPoolTraits<AVPacket> {
+    static AVPacket *alloc() {
+        return av_packet_alloc();
+    }
+    static void unref(AVPacket *packet) {
+        av_packet_unref(packet);
+    }
+    static void free(AVPacket *packet) {
+        av_packet_free(&packet);
+    }
+};
+
+/// Bounded pool of AVFrames or AVPackets handed out as shared pointers.
+/// Once the last reference is dropped, wherever that happens, the object is unreferenced and goes back to the pool
+/// instead of being freed. The shared_ptr control blocks are recycled too, so a steady stream of acquire() and release
+/// doesn't allocate once the pool has warmed up.
+/// The pool may be destroyed while objects are still out, they are then freed on release.
+template <class T>
+class AvPool {
+public:
+    struct Stats {
+        /// Objects handed out
+        uint64_t acquired = 0;
+        /// Objects allocated because none were idle
+        uint64_t allocated = 0;
+        /// Objects freed on release because the pool was full
+        uint64_t freed = 0;
+        /// Control blocks allocated because none were idle
+        uint64_t blocksAllocated = 0;
+        /// Objects waiting in the pool
+        size_t idle = 0;
+    };
+
+    /// @param capacity Max idle objects kept, more may be out at once.
+    explicit AvPool(size_t capacity) : state_(std::make_shared<State>(capacity)) {}
+
+    AvPool(const AvPool &) = delete;
+    AvPool &operator=(const AvPool &) = delete;
+
+    /// A blank object, null if allocation failed.
+    std::shared_ptr<T> acquire() {
+        T *object = nullptr;
+        {
+            std::lock_guard lock(state_->mutex);
+            state_->acquired++;
+            if (!state_->idle.empty()) {
+                object = state_->idle.back();
+                state_->idle.pop_back();
+            } else {
+                state_->allocated++;
+            }
+        }
+
+        if (!object) {
+            object = AvPoolTraits<T>::alloc();
+            if (!object) {
+                return nullptr;
+            }
+        }
+
+        return std::shared_ptr<T>(object, Recycler{state_.get()}, BlockAllocator<T>(state_));
+    }
+
+    Stats stats() const {
+        std::lock_guard lock(state_->mutex);
+
+        Stats stats;
+        stats.acquired = state_->acquired;
+        stats.allocated = state_->allocated;
+        stats.freed = state_->freed;
+        stats.blocksAllocated = state_->blocksAllocated;
+        stats.idle = state_->idle.size();
+        return stats;
+    }
+
+private:
+    struct State {
+        explicit State(size_t capacity) : capacity(capacity) {
+            idle.reserve(capacity);
+            blocks.reserve(capacity);
+        }
+
+        ~State() {
+            for (T *object : idle) {
+                AvPoolTraits<T>::free(object);
+            }
+            for (void *block : blocks) {
+                ::operator delete(block);
+            }
+        }
+
+        std::mutex mutex;
+        size_t capacity;
+        std::vector<T *> idle;
+
+        /// Idle control blocks, all of blockSize bytes
+        std::vector<void *> blocks;
+        size_t blockSize = 0;
+
+        uint64_t acquired = 0;
+        uint64_t allocated = 0;
+        uint64_t freed = 0;
+        uint64_t blocksAllocated = 0;
+    };
+
+    /// Deleter of the handed out pointers. The allocator of the same control block keeps the state alive.
+    struct Recycler {
+        State *state;
+
+        void operator()(T *object) const {
+            AvPoolTraits<T>::unref(object);
+
+            std::unique_lock lock(state->mutex);
+            if (state->idle.size() < state->capacity) {
+                state->idle.push_back(object);
+                return;
+            }
+            state->freed++;
+            lock.unlock();
+
+            AvPoolTraits<T>::free(object);
+        }
+    };
+
+    /// Allocates the shared_ptr control blocks from the pool.
+    template <class U>
+    struct BlockAllocator {
+        using value_type = U;
+
+        explicit BlockAllocator(std::shared_ptr<State> state) : state(std::move(state)) {}
+
+        template <class V>
+        BlockAllocator(const BlockAllocator<V> &other) : state(other.state) {}
+
+        U *allocate(size_t n) {
+            const size_t size = n * sizeof(U);
+            {
+                std::lock_guard lock(state->mutex);
+                if (state->blockSize == 0) {
+                    state->blockSize = size;
+                }
+                if (size == state->blockSize && !state->blocks.empty()) {
+                    void *block = state->blocks.back();
+                    state->blocks.pop_back();
+                    return static_cast<U *>(block);
+                }
+                state->blocksAllocated++;
+            }
+            return static_cast<U *>(::operator new(size));
+        }
+
+        void deallocate(U *block, size_t n) {
+            const size_t size = n * sizeof(U);
+            {
+                std::lock_guard lock(state->mutex);
+                if (size == state->blockSize && state->blocks.size() < state->capacity) {
+                    state->blocks.push_back(block);
+                    return;
+                }
+            }
+            ::operator delete(block);
+        }
+
+        template <class V>
+        bool operator==(const BlockAllocator<V> &other) const {
+            return state == other.state;
+        }
+
+        std::shared_ptr<State> state;
+    };
+
+    std::shared_ptr<State> state_;
+};
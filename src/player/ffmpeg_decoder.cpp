@@ -1,14 +1,30 @@
 ﻿#include "ffmpeg_decoder.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iostream>
 #include <vector>
 
 #include "src/gui_interface.h"
 
-constexpr size_t MAX_AUDIO_PACKET = 2 * 1024 * 1024;
+// RTP video clock
+constexpr int RTP_VIDEO_CLOCK_RATE = 90000;
 
-bool FfmpegDecoder::OpenInput(std::string &inputFile, bool forceSoftwareDecoding) {
+// Give up opening an input after this many seconds.
+constexpr int OPEN_TIMEOUT = 10;
+
+// Report the in-process RTP input as lost after this long without a frame.
+constexpr std::chrono::milliseconds RTP_STALL_TIMEOUT{1000};
+
+static int openTimeoutCallback(void *timestamp) {
+    const auto now = std::chrono::steady_clock::now();
+    const std::chrono::duration<double> duration =
+        now - *(std::chrono::time_point<std::chrono::steady_clock> *)timestamp;
+    return duration.count() > OPEN_TIMEOUT;
+}
+
+bool FfmpegDecoder::OpenInput(std::string &inputFile, bool forceSoftwareDecoding, const VideoStreamInfo *knownVideo) {
 #ifndef NDEBUG
     av_log_set_level(AV_LOG_ERROR);
 #endif
@@ -46,31 +62,40 @@ bool FfmpegDecoder::OpenInput(std::string &inputFile, bool forceSoftwareDecoding
     av_dict_set(&options, "fflags", "nobuffer", 0);
     av_dict_set(&options, "flags", "low_delay", 0);
 
-    if (avformat_open_input(&pFormatCtx, inputFile.c_str(), nullptr, &options) != 0) {
+    startTime = std::chrono::steady_clock::now();
+
+    bool opened;
+    if (inputFile.starts_with(INPROC_RTP_URL_PREFIX)) {
+        opened = OpenRtpInput(inputFile.substr(std::string(INPROC_RTP_URL_PREFIX).size()));
+    } else {
+        opened = avformat_open_input(&pFormatCtx, inputFile.c_str(), nullptr, &options) == 0;
+    }
+    av_dict_free(&options);
+
+    if (!opened) {
         CloseInput();
         return false;
     }
 
     // Timeout
-    static constexpr int timeout = 10;
-    startTime = std::chrono::steady_clock::now();
-
-    pFormatCtx->interrupt_callback.callback = [](void *timestamp) -> int {
-        const auto now = std::chrono::steady_clock::now();
-        const std::chrono::duration<double> duration =
-            now - *(std::chrono::time_point<std::chrono::steady_clock> *)timestamp;
-        return duration.count() > timeout;
-    };
+    pFormatCtx->interrupt_callback.callback = openTimeoutCallback;
     pFormatCtx->interrupt_callback.opaque = &startTime;
 
-    if (avformat_find_stream_info(pFormatCtx, nullptr) < 0) {
+    // The RTP input knows its only stream already, probing would just hold back the first frames.
+    // Other inputs are always probed, as that is the only way to learn about their other streams, e.g. audio.
+    if (rtpInput) {
+        if (knownVideo && knownVideo->params && ApplyVideoStreamInfo(*knownVideo)) {
+            GuiInterface::Instance().PutLog(LogLevel::Info, "Reusing known video parameters");
+        }
+        streamInfoFromDecoder = true;
+    } else if (avformat_find_stream_info(pFormatCtx, nullptr) < 0) {
         CloseInput();
         return false;
     }
 
     // Timeout
     if (const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - startTime;
-        duration.count() > timeout) {
+        duration.count() > OPEN_TIMEOUT) {
         CloseInput();
         return false;
     }
@@ -84,7 +109,10 @@ bool FfmpegDecoder::OpenInput(std::string &inputFile, bool forceSoftwareDecoding
 
     // Convert time base
     if (videoStreamIndex != -1) {
-        videoFps = static_cast<float>(av_q2d(pFormatCtx->streams[videoStreamIndex]->r_frame_rate));
+        // Unknown for the RTP input until a few frames have arrived.
+        if (const AVRational frameRate = pFormatCtx->streams[videoStreamIndex]->r_frame_rate; frameRate.den > 0) {
+            videoFps = static_cast<float>(av_q2d(frameRate));
+        }
         videoBaseTime = av_q2d(pFormatCtx->streams[videoStreamIndex]->time_base);
 
         GuiInterface::Instance().PutLog(LogLevel::Info, "Video FPS: {}", videoFps);
@@ -97,7 +125,7 @@ bool FfmpegDecoder::OpenInput(std::string &inputFile, bool forceSoftwareDecoding
     // Create audio buffer
     if (hasAudioStream) {
         size_t count = GetAudioFrameSamples() * GetAudioChannelCount() * 10;
-        audioFifoBuffer = av_fifo_alloc2(count, sizeof(uint8_t), AV_FIFO_FLAG_AUTO_GROW);
+        audioRing = std::make_unique<PcmRing>(count);
     }
 
     return true;
@@ -108,25 +136,234 @@ bool FfmpegDecoder::CloseInput() {
 
     GuiInterface::Instance().PutLog(LogLevel::Info, "{}", __FUNCTION__);
 
+    if (sourceIsOpened) {
+        const auto frames = framePool.stats();
+        const auto packets = packetPool.stats();
+        GuiInterface::Instance().PutLog(LogLevel::Info,
+                                        "Frame pool: {} frames, {} allocated. Packet pool: {} packets, {} allocated",
+                                        frames.acquired,
+                                        frames.allocated,
+                                        packets.acquired,
+                                        packets.allocated);
+
+        if (audioRing) {
+            GuiInterface::Instance().PutLog(LogLevel::Info,
+                                            "Audio ring: {} underruns, {} overruns",
+                                            audioRing->underrunCount(),
+                                            audioRing->overrunCount());
+        }
+
+        if (rtpDepacketizer) {
+            const auto &rtp = rtpDepacketizer->stats();
+            GuiInterface::Instance().PutLog(LogLevel::Info,
+                                            "RTP: {} packets, {} lost. {} frames, {} dropped. {} resyncs",
+                                            rtp.packets,
+                                            rtp.lostPackets,
+                                            rtp.frames,
+                                            rtp.droppedFrames,
+                                            rtp.resyncs);
+        }
+    }
+
     sourceIsOpened = false;
 
     CloseVideo();
     CloseAudio();
 
     if (pFormatCtx) {
-        avformat_close_input(&pFormatCtx);
+        // The RTP input context was never opened, only allocated.
+        if (rtpInput) {
+            avformat_free_context(pFormatCtx);
+        } else {
+            avformat_close_input(&pFormatCtx);
+        }
         pFormatCtx = nullptr;
     }
 
+    streamInfoFromDecoder = false;
+    rtpInput = false;
+    rtpDepacketizer.reset();
+    av_buffer_pool_uninit(&rtpBufferPool);
+    rtpBufferSize = 0;
+    rtpPts = AV_NOPTS_VALUE;
+    rtpFrameDuration = 0;
+    rtpStalled = false;
+
     return true;
 }
 
-void freeFrame(AVFrame *f) {
-    av_frame_free(&f);
+bool FfmpegDecoder::OpenRtpInput(const std::string &codec) {
+    GuiInterface::Instance().PutLog(LogLevel::Info, "Opening in-process RTP stream, codec: {}", codec);
+
+    const bool isH265 = codec == "H265";
+
+    rtpDepacketizer = std::make_unique<RtpDepacketizer>(isH265);
+    rtpPacket.resize(WfbngLink::Instance().rtp_ring().slotSize());
+
+    // A format context with a single stream and no demuxer behind it. It is still what stop() interrupts and what
+    // recording takes the stream parameters from.
+    pFormatCtx = avformat_alloc_context();
+    if (!pFormatCtx) {
+        return false;
+    }
+    rtpInput = true;
+
+    AVStream *stream = avformat_new_stream(pFormatCtx, nullptr);
+    if (!stream) {
+        return false;
+    }
+    stream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+    stream->codecpar->codec_id = isH265 ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264;
+    stream->time_base = {1, RTP_VIDEO_CLOCK_RATE};
+
+    // Whatever queued up before the decoder was ready is stale by now.
+    WfbngLink::Instance().rtp_ring().discard();
+    rtpLastFrameTime = std::chrono::steady_clock::now();
+
+    return true;
+}
+
+int FfmpegDecoder::ReadRtpAccessUnit(AVPacket *packet) {
+    auto &ring = WfbngLink::Instance().rtp_ring();
+
+    while (true) {
+        // Checked on every iteration, so stop() is honored while the link is silent.
+        if (pFormatCtx->interrupt_callback.callback &&
+            pFormatCtx->interrupt_callback.callback(pFormatCtx->interrupt_callback.opaque)) {
+            return AVERROR_EXIT;
+        }
+
+        const size_t size = ring.popWait(rtpPacket.data(), rtpPacket.size(), std::chrono::milliseconds(100));
+        if (size > 0 && rtpDepacketizer->push(rtpPacket.data(), size)) {
+            break;
+        }
+
+        // Report a silent link once, like a read error of a URL input, then keep waiting for it to come back.
+        if (!rtpStalled && std::chrono::steady_clock::now() - rtpLastFrameTime > RTP_STALL_TIMEOUT) {
+            rtpStalled = true;
+            // Whatever comes next may be a restarted sender, don't hold it against the old sequence numbers.
+            rtpDepacketizer->reset();
+            return AVERROR(ETIMEDOUT);
+        }
+    }
+
+    rtpStalled = false;
+    rtpLastFrameTime = std::chrono::steady_clock::now();
+
+    const std::vector<uint8_t> &frame = rtpDepacketizer->frame();
+
+    // Reuse packet buffers instead of allocating one per frame, the pool only grows when a frame doesn't fit.
+    if (frame.size() + AV_INPUT_BUFFER_PADDING_SIZE > rtpBufferSize) {
+        av_buffer_pool_uninit(&rtpBufferPool);
+        rtpBufferSize = (frame.size() + AV_INPUT_BUFFER_PADDING_SIZE) * 2;
+        rtpBufferPool = av_buffer_pool_init(rtpBufferSize, nullptr);
+        if (!rtpBufferPool) {
+            rtpBufferSize = 0;
+            return AVERROR(ENOMEM);
+        }
+    }
+
+    packet->buf = av_buffer_pool_get(rtpBufferPool);
+    if (!packet->buf) {
+        return AVERROR(ENOMEM);
+    }
+    packet->data = packet->buf->data;
+    packet->size = static_cast<int>(frame.size());
+    memcpy(packet->data, frame.data(), frame.size());
+    memset(packet->data + frame.size(), 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    const uint32_t timestamp = rtpDepacketizer->frameTimestamp();
+    if (rtpPts == AV_NOPTS_VALUE) {
+        rtpPts = timestamp;
+    } else {
+        const int64_t step = static_cast<int32_t>(timestamp - rtpLastTimestamp);
+        rtpPts += step;
+        if (step > 0 && (rtpFrameDuration == 0 || step < rtpFrameDuration)) {
+            rtpFrameDuration = step;
+        }
+    }
+    rtpLastTimestamp = timestamp;
+
+    packet->pts = rtpPts;
+    packet->dts = rtpPts;
+    packet->stream_index = videoStreamIndex;
+    if (rtpDepacketizer->frameIsKeyframe()) {
+        packet->flags |= AV_PKT_FLAG_KEY;
+    }
+
+    return 0;
+}
+
+bool FfmpegDecoder::ApplyVideoStreamInfo(const VideoStreamInfo &info) {
+    for (uint32_t i = 0; i < pFormatCtx->nb_streams; i++) {
+        AVStream *stream = pFormatCtx->streams[i];
+        if (stream->codecpar->codec_type != AVMEDIA_TYPE_VIDEO) {
+            continue;
+        }
+
+        if (stream->codecpar->codec_id != info.params->codec_id ||
+            avcodec_parameters_copy(stream->codecpar, info.params.get()) < 0) {
+            return false;
+        }
+
+        if (info.fps > 0) {
+            stream->avg_frame_rate = av_d2q(info.fps, 100000);
+            stream->r_frame_rate = stream->avg_frame_rate;
+        }
+        return true;
+    }
+    return false;
+}
+
+void FfmpegDecoder::UpdateStreamInfo() {
+    AVStream *stream = pFormatCtx->streams[videoStreamIndex];
+    bool changed = false;
+
+    if (pVideoCodecCtx->width != width || pVideoCodecCtx->height != height) {
+        width = pVideoCodecCtx->width;
+        height = pVideoCodecCtx->height;
+
+        avcodec_parameters_from_context(stream->codecpar, pVideoCodecCtx);
+
+        // Muxers want the parameter sets out of band, e.g. for the avcC/hvcC box of MP4 recordings.
+        const std::vector<uint8_t> parameterSets =
+            rtpDepacketizer ? rtpDepacketizer->parameterSets() : std::vector<uint8_t>();
+        if (!parameterSets.empty()) {
+            av_freep(&stream->codecpar->extradata);
+            stream->codecpar->extradata =
+                static_cast<uint8_t *>(av_mallocz(parameterSets.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+            if (stream->codecpar->extradata) {
+                memcpy(stream->codecpar->extradata, parameterSets.data(), parameterSets.size());
+                stream->codecpar->extradata_size = static_cast<int>(parameterSets.size());
+            } else {
+                stream->codecpar->extradata_size = 0;
+            }
+        }
+
+        changed = true;
+    }
+
+    if (rtpFrameDuration > 0) {
+        const float fps = std::round(100.0f * RTP_VIDEO_CLOCK_RATE / rtpFrameDuration) / 100.0f;
+        if (fps != videoFps) {
+            videoFps = fps;
+            stream->avg_frame_rate = av_d2q(fps, 100000);
+            stream->r_frame_rate = stream->avg_frame_rate;
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        GuiInterface::Instance().PutLog(LogLevel::Info, "Video: {}x{}, {} FPS", width, height, videoFps);
+
+        if (videoInfoCallback) {
+            videoInfoCallback(width, height, videoFps);
+        }
+    }
 }
 
-void freePkt(AVPacket *f) {
-    av_packet_free(&f);
+void freeFrame(AVFrame *f) {
+    av_frame_free(&f);
 }
 
 void freeSwrCtx(SwrContext *s) {
@@ -151,12 +388,12 @@ std::shared_ptr<AVFrame> FfmpegDecoder::GetNextFrame() {
             throw std::runtime_error("AVFormatContext is null");
         }
 
-        auto timestamp = std::make_shared<revector::Timestamp>("Aviateur");
-        timestamp->set_enabled(false);
-
-        std::shared_ptr<AVPacket> packet = std::shared_ptr<AVPacket>(av_packet_alloc(), &freePkt);
+        std::shared_ptr<AVPacket> packet = packetPool.acquire();
+        if (!packet) {
+            throw std::runtime_error("Failed to allocate packet");
+        }
 
-        int ret = av_read_frame(pFormatCtx, packet.get());
+        int ret = rtpInput ? ReadRtpAccessUnit(packet.get()) : av_read_frame(pFormatCtx, packet.get());
         if (ret < 0) {
             char errStr[AV_ERROR_MAX_STRING_SIZE];
             av_strerror(ret, errStr, AV_ERROR_MAX_STRING_SIZE);
@@ -164,8 +401,6 @@ std::shared_ptr<AVFrame> FfmpegDecoder::GetNextFrame() {
             throw ReadFrameException("av_read_frame failed: " + std::string(errStr));
         }
 
-        timestamp->record("av_read_frame");
-
         // Calculate bitrate
         {
             bytesSecond += packet->size;
@@ -190,24 +425,21 @@ std::shared_ptr<AVFrame> FfmpegDecoder::GetNextFrame() {
                 gotPktCallback(packet);
             }
 
-            timestamp->record("gotPktCallback");
-
-            std::shared_ptr<AVFrame> pFrameVideo = std::shared_ptr<AVFrame>(av_frame_alloc(), &freeFrame);
+            std::shared_ptr<AVFrame> pFrameVideo = framePool.acquire();
 
             if (bool successful = DecodeVideo(packet.get(), pFrameVideo)) {
                 res = pFrameVideo;
-            }
 
-            timestamp->record("DecodeVideo");
+                if (streamInfoFromDecoder) {
+                    UpdateStreamInfo();
+                }
+            }
 
             // Trigger callback
             if (gotVideoFrameCallback) {
                 gotVideoFrameCallback(pFrameVideo);
             }
 
-            timestamp->record("gotVideoFrameCallback");
-            timestamp->print();
-
             break;
         }
 
@@ -218,13 +450,7 @@ std::shared_ptr<AVFrame> FfmpegDecoder::GetNextFrame() {
             }
 
             if (packet->dts != AV_NOPTS_VALUE) {
-                constexpr int audioFrameSize = MAX_AUDIO_PACKET;
-                auto pFrameAudio = std::shared_ptr<uint8_t>(new uint8_t[audioFrameSize]);
-
-                if (const size_t nDecodedSize = DecodeAudio(packet.get(), pFrameAudio.get(), audioFrameSize);
-                    nDecodedSize > 0) {
-                    writeAudioBuff(pFrameAudio.get(), nDecodedSize);
-                }
+                DecodeAudio(packet.get());
             }
 
             if (!HasVideo()) {
@@ -235,6 +461,43 @@ std::shared_ptr<AVFrame> FfmpegDecoder::GetNextFrame() {
     return res;
 }
 
+void FfmpegDecoder::Flush() {
+    std::lock_guard lck(_releaseLock);
+
+    if (pVideoCodecCtx) {
+        avcodec_flush_buffers(pVideoCodecCtx);
+    }
+    if (pAudioCodecCtx) {
+        avcodec_flush_buffers(pAudioCodecCtx);
+    }
+}
+
+VideoStreamInfo FfmpegDecoder::GetVideoStreamInfo() const {
+    // The decode thread may be replacing the extradata in UpdateStreamInfo().
+    std::lock_guard lck(_releaseLock);
+
+    VideoStreamInfo info;
+
+    // Without the size and the parameter sets, the decoder would have to wait for them in band anyway.
+    if (!pFormatCtx || videoStreamIndex == -1 || width <= 0 || height <= 0) {
+        return info;
+    }
+    const AVCodecParameters *params = pFormatCtx->streams[videoStreamIndex]->codecpar;
+    if (params->extradata_size <= 0) {
+        return info;
+    }
+
+    info.params = std::shared_ptr<AVCodecParameters>(avcodec_parameters_alloc(),
+                                                     [](AVCodecParameters *p) { avcodec_parameters_free(&p); });
+    if (!info.params || avcodec_parameters_copy(info.params.get(), params) < 0) {
+        info.params.reset();
+        return info;
+    }
+    info.fps = videoFps;
+
+    return info;
+}
+
 bool FfmpegDecoder::createHwCtx(AVCodecContext *ctx, const AVHWDeviceType type) {
     if (av_hwdevice_ctx_create(&hwDeviceCtx, type, nullptr, nullptr, 0) < 0) {
         return false;
@@ -431,9 +694,7 @@ void FfmpegDecoder::CloseAudio() {
     }
 }
 
-size_t FfmpegDecoder::DecodeAudio(const AVPacket *av_pkt, uint8_t *pOutBuffer, size_t nOutBufferSize) {
-    size_t decodedSize = 0;
-
+void FfmpegDecoder::DecodeAudio(const AVPacket *av_pkt) {
     int ret = avcodec_send_packet(pAudioCodecCtx, av_pkt);
     if (ret < 0) {
         char errStr[AV_ERROR_MAX_STRING_SIZE];
@@ -441,123 +702,79 @@ size_t FfmpegDecoder::DecodeAudio(const AVPacket *av_pkt, uint8_t *pOutBuffer, s
         throw SendPacketException("avcodec_send_packet failed: " + std::string(errStr));
     }
 
-    while (true) {
-        uint8_t *pDest = pOutBuffer + decodedSize;
-        if (nOutBufferSize - decodedSize < 0) {
-            break;
-        }
-
-        AVFrame *audioFrame = av_frame_alloc();
+    if (!audioFrame) {
+        audioFrame = std::shared_ptr<AVFrame>(av_frame_alloc(), &freeFrame);
         if (!audioFrame) {
             throw std::runtime_error("Failed to allocate audio frame");
         }
-
-        bool shouldBreakLoop = false;
-
-        ret = avcodec_receive_frame(pAudioCodecCtx, audioFrame);
-
-        switch (ret) {
-            case 0: {
-                if (audioFrame->format != AV_SAMPLE_FMT_S16) {
-                    // Convert frame to AV_SAMPLE_FMT_S16 if needed
-                    if (!swrCtx) {
-                        SwrContext *ptr = nullptr;
-                        swr_alloc_set_opts2(&ptr,
-                                            &pAudioCodecCtx->ch_layout,
-                                            AV_SAMPLE_FMT_S16,
-                                            pAudioCodecCtx->sample_rate,
-                                            &pAudioCodecCtx->ch_layout,
-                                            static_cast<AVSampleFormat>(audioFrame->format),
-                                            pAudioCodecCtx->sample_rate,
-                                            0,
-                                            nullptr);
-
-                        if (const int ret2 = swr_init(ptr); ret2 < 0) {
-                            char errStr[AV_ERROR_MAX_STRING_SIZE];
-                            av_strerror(ret2, errStr, AV_ERROR_MAX_STRING_SIZE);
-                            throw std::runtime_error("Decoding audio failed: " + std::string(errStr));
-                        }
-                        swrCtx = std::shared_ptr<SwrContext>(ptr, &freeSwrCtx);
-                    }
-
-                    // Convert audio frame to S16 format
-                    const int samples = swr_convert(swrCtx.get(),
-                                                    &pDest,
-                                                    audioFrame->nb_samples,
-                                                    (const uint8_t **)audioFrame->data,
-                                                    audioFrame->nb_samples);
-                    const size_t sizeToDecode =
-                        samples * pAudioCodecCtx->ch_layout.nb_channels * av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
-
-                    decodedSize += sizeToDecode;
-                } else {
-                    // Copy S16 audio data directly
-                    const size_t sizeToDecode = av_samples_get_buffer_size(nullptr,
-                                                                           pAudioCodecCtx->ch_layout.nb_channels,
-                                                                           audioFrame->nb_samples,
-                                                                           AV_SAMPLE_FMT_S16,
-                                                                           1);
-                    memcpy(pDest, audioFrame->data[0], sizeToDecode);
-
-                    decodedSize += sizeToDecode;
-                }
-            } break;
-            case AVERROR(EAGAIN): {
-                shouldBreakLoop = true;
-            } break;
-            case AVERROR_EOF: {
-                shouldBreakLoop = true;
-            } break;
-            case AVERROR_INVALIDDATA: {
-                shouldBreakLoop = true;
-            } break;
-            default: {
-                shouldBreakLoop = true;
-            } break;
-        }
-
-        av_frame_free(&audioFrame);
-
-        if (shouldBreakLoop) {
-            break;
-        }
     }
 
-    return decodedSize;
-}
+    const int channels = pAudioCodecCtx->ch_layout.nb_channels;
+    const int bytesPerSample = av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
+
+    // Stop at EAGAIN, EOF or any decoding error.
+    while (avcodec_receive_frame(pAudioCodecCtx, audioFrame.get()) == 0) {
+        if (audioFrame->format != AV_SAMPLE_FMT_S16) {
+            // Convert frame to AV_SAMPLE_FMT_S16 if needed
+            if (!swrCtx) {
+                SwrContext *ptr = nullptr;
+                swr_alloc_set_opts2(&ptr,
+                                    &pAudioCodecCtx->ch_layout,
+                                    AV_SAMPLE_FMT_S16,
+                                    pAudioCodecCtx->sample_rate,
+                                    &pAudioCodecCtx->ch_layout,
+                                    static_cast<AVSampleFormat>(audioFrame->format),
+                                    pAudioCodecCtx->sample_rate,
+                                    0,
+                                    nullptr);
+
+                if (const int ret2 = swr_init(ptr); ret2 < 0) {
+                    char errStr[AV_ERROR_MAX_STRING_SIZE];
+                    av_strerror(ret2, errStr, AV_ERROR_MAX_STRING_SIZE);
+                    throw std::runtime_error("Decoding audio failed: " + std::string(errStr));
+                }
+                swrCtx = std::shared_ptr<SwrContext>(ptr, &freeSwrCtx);
+            }
 
-void FfmpegDecoder::writeAudioBuff(const uint8_t *aSample, const size_t aSize) {
-    std::lock_guard lck(abBuffMtx);
+            // The resampler may have samples buffered from the last frame, so ask it for the real output size.
+            const int maxSamples = swr_get_out_samples(swrCtx.get(), audioFrame->nb_samples);
+            if (maxSamples > 0) {
+                const size_t maxSize = static_cast<size_t>(maxSamples) * channels * bytesPerSample;
+                if (audioBuffer.size() < maxSize) {
+                    audioBuffer.resize(maxSize);
+                }
 
-    if (const size_t free_space = av_fifo_can_write(audioFifoBuffer); free_space < aSize) {
-        // Drop old data.
-        std::vector<uint8_t> tmp;
-        tmp.resize(aSize);
-        av_fifo_read(audioFifoBuffer, tmp.data(), aSize);
-    }
+                // Convert audio frame to S16 format
+                uint8_t *pDest = audioBuffer.data();
+                const int samples = swr_convert(swrCtx.get(),
+                                                &pDest,
+                                                maxSamples,
+                                                (const uint8_t **)audioFrame->data,
+                                                audioFrame->nb_samples);
+                if (samples > 0) {
+                    audioRing->write(audioBuffer.data(), static_cast<size_t>(samples) * channels * bytesPerSample);
+                }
+            }
+        } else {
+            // Queue S16 audio data directly
+            const int size =
+                av_samples_get_buffer_size(nullptr, channels, audioFrame->nb_samples, AV_SAMPLE_FMT_S16, 1);
+            if (size > 0) {
+                audioRing->write(audioFrame->data[0], size);
+            }
+        }
 
-    if (const int ret = av_fifo_write(audioFifoBuffer, aSample, aSize); ret < 0) {
-        GuiInterface::Instance().PutLog(LogLevel::Warn, "av_fifo_write failed!");
+        av_frame_unref(audioFrame.get());
     }
 }
 
 int FfmpegDecoder::ReadAudioBuff(uint8_t *aSample, const size_t aSize) {
-    std::lock_guard lck(abBuffMtx);
-
-    if (const size_t available_size = av_fifo_can_read(audioFifoBuffer); available_size < aSize) {
-        // Not enough to read.
-        return false;
-    }
-    const int ret = av_fifo_read(audioFifoBuffer, aSample, aSize);
-
-    return ret >= 0;
+    // Not enough to read counts as an underrun.
+    return audioRing && audioRing->read(aSample, aSize);
 }
 
 void FfmpegDecoder::ClearAudioBuff() {
-    std::lock_guard lck(abBuffMtx);
-
-    if (audioFifoBuffer) {
-        av_fifo_reset2(audioFifoBuffer);
-        audioFifoBuffer = nullptr;
+    if (audioRing) {
+        audioRing->discard();
     }
 }
@@ -4,8 +4,12 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
+#include "av_pool.h"
 #include "ffmpeg_include.h"
+#include "pcm_ring.h"
+#include "rtp_depacketizer.h"
 
 class ReadFrameException : public std::runtime_error {
 public:
@@ -17,6 +21,13 @@ public:
     SendPacketException(const std::string &msg) : runtime_error(msg.c_str()) {}
 };
 
+/// What an earlier session learned about a video stream, so that reopening it can start with its parameters.
+struct VideoStreamInfo {
+    /// Codec parameters including the extradata (SPS/PPS/VPS)
+    std::shared_ptr<AVCodecParameters> params;
+    float fps = 0;
+};
+
 class FfmpegDecoder {
     friend class RealTimePlayer;
 
@@ -30,12 +41,20 @@ public:
         hwFrame.reset();
     }
 
-    bool OpenInput(std::string &inputFile, bool forceSoftwareDecoding);
+    /// @param knownVideo The video stream of this input as found by an earlier session. If it still matches,
+    /// the in-process RTP input starts with its parameters. Other inputs are probed regardless.
+    bool OpenInput(std::string &inputFile, bool forceSoftwareDecoding, const VideoStreamInfo *knownVideo = nullptr);
 
     bool CloseInput();
 
     std::shared_ptr<AVFrame> GetNextFrame();
 
+    /// Drop the codec state after the input stalled, so decoding resumes cleanly instead of from broken references.
+    void Flush();
+
+    /// The video stream to pass to the next OpenInput() of the same input. Without params until they are complete.
+    VideoStreamInfo GetVideoStreamInfo() const;
+
     int GetWidth() const {
         return width;
     }
@@ -56,6 +75,7 @@ public:
         return hasVideoStream;
     }
 
+    /// Called from the audio callback. Reads exactly `aSize` bytes of S16 PCM, or nothing if fewer are queued.
     int ReadAudioBuff(uint8_t *aSample, size_t aSize);
 
     void ClearAudioBuff();
@@ -88,21 +108,37 @@ private:
 
     bool OpenAudio();
 
+    /// Open the RTP packets handed over in-process by the wfb-ng link instead of a URL.
+    /// Access units go from the depacketizer straight to the decoder, there is no demuxer to buffer or probe.
+    bool OpenRtpInput(const std::string &codec);
+
+    /// Wait for the next complete access unit from the link and wrap it in `packet`.
+    int ReadRtpAccessUnit(AVPacket *packet);
+
+    /// Use the parameters of a known video stream before the stream has shown any.
+    /// Returns false if the stream changed codec.
+    bool ApplyVideoStreamInfo(const VideoStreamInfo &info);
+
+    /// Fill in the video size, frame rate and parameter sets when they weren't probed, from the decoded stream.
+    void UpdateStreamInfo();
+
     void CloseVideo();
 
     void CloseAudio();
 
-    size_t DecodeAudio(const AVPacket *av_pkt, uint8_t *pOutBuffer, size_t nOutBufferSize);
+    /// Decode an audio packet and queue its samples as S16 PCM for the audio callback.
+    void DecodeAudio(const AVPacket *av_pkt);
 
     bool DecodeVideo(const AVPacket *av_pkt, std::shared_ptr<AVFrame> &pOutFrame);
 
-    void writeAudioBuff(const uint8_t *aSample, size_t aSize);
-
     /// NALU callback (video/audio)
     std::function<void(const std::shared_ptr<AVPacket> &packet)> gotPktCallback;
 
     std::function<void(const std::shared_ptr<AVFrame> &frame)> gotVideoFrameCallback;
 
+    /// Video size or frame rate became known or changed after opening
+    std::function<void(int width, int height, float fps)> videoInfoCallback;
+
     bool createHwCtx(AVCodecContext *ctx, enum AVHWDeviceType type);
 
     void emitBitrateUpdate(uint64_t pBitrate) {
@@ -113,6 +149,25 @@ private:
 
     AVFormatContext *pFormatCtx = nullptr;
 
+    /// The stream info wasn't probed, it comes from the decoded stream
+    bool streamInfoFromDecoder = false;
+
+    // In-process RTP input
+    bool rtpInput = false;
+    std::unique_ptr<RtpDepacketizer> rtpDepacketizer;
+    std::vector<uint8_t> rtpPacket;
+    /// Packet buffers of the largest access unit seen so far
+    AVBufferPool *rtpBufferPool = nullptr;
+    size_t rtpBufferSize = 0;
+    /// RTP timestamps unwrapped to 64 bits
+    int64_t rtpPts = AV_NOPTS_VALUE;
+    uint32_t rtpLastTimestamp = 0;
+    /// Shortest timestamp step between two access units, i.e. one frame when none was dropped in between
+    int64_t rtpFrameDuration = 0;
+    std::chrono::steady_clock::time_point rtpLastFrameTime;
+    /// The link has been silent for RTP_STALL_TIMEOUT, reported once until it comes back
+    bool rtpStalled = false;
+
     AVCodecContext *pVideoCodecCtx = nullptr;
 
     AVCodecContext *pAudioCodecCtx = nullptr;
@@ -132,7 +187,7 @@ private:
 
     double audioBaseTime = 0;
 
-    std::mutex _releaseLock;
+    mutable std::mutex _releaseLock;
 
     bool hasVideoStream{};
 
@@ -148,8 +203,10 @@ private:
     std::function<void(uint64_t bitrate)> bitrateUpdateCallback;
 
     // Audio buffer
-    std::mutex abBuffMtx;
-    AVFifo *audioFifoBuffer{};
+    std::unique_ptr<PcmRing> audioRing;
+    std::shared_ptr<AVFrame> audioFrame;
+    /// Resampler output, grown to the largest frame seen
+    std::vector<uint8_t> audioBuffer;
 
     // Hardware decoding
     AVHWDeviceType hwDecoderType = AV_HWDEVICE_TYPE_NONE;
@@ -159,4 +216,9 @@ private:
     AVBufferRef *hwDeviceCtx = nullptr;
     volatile bool dropCurrentVideoFrame = false;
     std::shared_ptr<AVFrame> hwFrame;
+
+    // Recycled per packet and per frame. Decoded frames wait in the player queue and the renderer,
+    // so the frame pool is deeper than the player queue.
+    AvPool<AVPacket> packetPool{8};
+    AvPool<AVFrame> framePool{16};
 };
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include "ffmpeg_include.h"
+
+/// A decoded video frame and when it left the decoder.
+struct DecodedFrame {
+    std::shared_ptr<AVFrame> frame;
+    std::chrono::steady_clock::time_point decodedAt;
+};
+
+/// Lock-free triple buffer holding only the newest decoded frame.
+/// The decode thread publishes into its back slot and swaps it with the middle one, the render thread swaps the
+/// middle slot with its front slot whenever it holds a frame it hasn't taken yet. Neither side ever waits, and a
+/// frame the renderer didn't get to in time is replaced rather than queued behind.
+class FrameMailbox {
+public:
+    FrameMailbox() = default;
+
+    FrameMailbox(const FrameMailbox &) = delete;
+    FrameMailbox &operator=(const FrameMailbox &) = delete;
+
+    /// Producer side. Returns false if this replaced a frame the consumer never took.
+    bool publish(DecodedFrame frame) {
+        slots_[back_] = std::move(frame);
+
+        const uint8_t previous = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel);
+        back_ = previous & INDEX_MASK;
+
+        // Hand the skipped frame back to its pool now rather than on the next publish.
+        slots_[back_].frame.reset();
+
+        return !(previous & FRESH);
+    }
+
+    /// Consumer side. The newest frame published since the last call, or one with a null frame if there is none.
+    DecodedFrame take() {
+        if (!(middle_.load(std::memory_order_acquire) & FRESH)) {
+            return {};
+        }
+
+        const uint8_t previous = middle_.exchange(front_, std::memory_order_acq_rel);
+        front_ = previous & INDEX_MASK;
+        return std::move(slots_[front_]);
+    }
+
+    /// Drop all frames. Only call while neither side runs.
+    void clear() {
+        for (auto &slot : slots_) {
+            slot = {};
+        }
+        back_ = 0;
+        middle_.store(1, std::memory_order_relaxed);
+        front_ = 2;
+    }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    /// Set on the middle index while it holds a frame the consumer hasn't taken
+    static constexpr uint8_t FRESH = 0x4;
+
+    std::array<DecodedFrame, 3> slots_;
+
+    /// Owned by the producer
+    uint8_t back_ = 0;
+    std::atomic<uint8_t> middle_{1};
+    /// Owned by the consumer
+    uint8_t front_ = 2;
+};
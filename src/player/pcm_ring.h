@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+/// Lock-free single-producer/single-consumer byte ring carrying PCM from the decode thread to the audio callback.
+/// Neither side locks or allocates, so the audio thread never waits for the decoder.
+class PcmRing {
+public:
+    /// @param capacity Size in bytes, rounded up to a power of two.
+    explicit PcmRing(size_t capacity) {
+        size_t count = 1;
+        while (count < capacity) {
+            count <<= 1;
+        }
+        mask_ = count - 1;
+        storage_ = std::make_unique<uint8_t[]>(count);
+    }
+
+    PcmRing(const PcmRing &) = delete;
+    PcmRing &operator=(const PcmRing &) = delete;
+
+    /// Producer side. Queues all of `data` or, if it doesn't fit, drops it and counts an overrun.
+    bool write(const uint8_t *data, size_t size) {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        const uint64_t used = head - tail_.load(std::memory_order_acquire);
+        if (size > capacity() - used) {
+            overruns_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        const size_t offset = head & mask_;
+        const size_t first = std::min(size, capacity() - offset);
+        std::memcpy(storage_.get() + offset, data, first);
+        std::memcpy(storage_.get(), data + first, size - first);
+        head_.store(head + size, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer side. Reads exactly `size` bytes or, if fewer are queued, nothing and counts an underrun.
+    bool read(uint8_t *out, size_t size) {
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (head_.load(std::memory_order_acquire) - tail < size) {
+            underruns_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        const size_t offset = tail & mask_;
+        const size_t first = std::min(size, capacity() - offset);
+        std::memcpy(out, storage_.get() + offset, first);
+        std::memcpy(out + first, storage_.get(), size - first);
+        tail_.store(tail + size, std::memory_order_release);
+        return true;
+    }
+
+    /// Consumer side. Drops everything currently queued, e.g. stale audio from while playback was muted.
+    void discard() {
+        tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    /// Bytes queued
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+    /// Reads that found too little audio queued
+    uint64_t underrunCount() const {
+        return underruns_.load(std::memory_order_relaxed);
+    }
+
+    /// Writes dropped because the ring was full
+    uint64_t overrunCount() const {
+        return overruns_.load(std::memory_order_relaxed);
+    }
+
+private:
+    size_t mask_;
+    std::unique_ptr<uint8_t[]> storage_;
+
+    // Keep the producer and consumer indices on separate cache lines.
+    alignas(64) std::atomic<uint64_t> head_{0};
+    alignas(64) std::atomic<uint64_t> tail_{0};
+
+    alignas(64) std::atomic<uint64_t> underruns_{0};
+    std::atomic<uint64_t> overruns_{0};
+};
@@ -44,22 +44,36 @@ void RealTimePlayer::update(float dt) {
 }
 
 std::shared_ptr<AVFrame> RealTimePlayer::getFrame() {
-    std::lock_guard lck(mtx);
+    DecodedFrame decoded;
 
-    // No frame in the queue
-    if (videoFrameQueue.empty()) {
-        return nullptr;
-    }
+    if (useMailbox_) {
+        decoded = frameMailbox.take();
+        if (!decoded.frame) {
+            return nullptr;
+        }
+    } else {
+        std::lock_guard lck(mtx);
 
-    // Get a frame from the queue
-    std::shared_ptr<AVFrame> frame = videoFrameQueue.front();
+        // No frame in the queue
+        if (videoFrameQueue.empty()) {
+            return nullptr;
+        }
+
+        // Get a frame from the queue and remove it.
+        decoded = std::move(videoFrameQueue.front());
+        videoFrameQueue.pop();
+    }
 
-    // Remove the frame from the queue.
-    videoFrameQueue.pop();
+    const auto age = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+                                                                           decoded.decodedAt)
+                         .count();
+    framesPresented_.fetch_add(1, std::memory_order_relaxed);
+    presentAgeSumUs_.fetch_add(age, std::memory_order_relaxed);
+    presentAgeLastUs_.store(age, std::memory_order_relaxed);
 
-    lastFrame_ = frame;
+    lastFrame_ = decoded.frame;
 
-    return frame;
+    return decoded.frame;
 }
 
 void RealTimePlayer::onVideoInfoReady(int width, int height, int format) {
@@ -88,11 +102,18 @@ void RealTimePlayer::play(const std::string &playUrl, bool forceSoftwareDecoding
 
     decoder = std::make_shared<FfmpegDecoder>();
 
+    // Only switched while no decode thread runs.
+    useMailbox_ = lowLatencyDisplay_;
+
+    playStartTime_ = std::chrono::steady_clock::now();
+
     analysisThread = std::thread([this, forceSoftwareDecoding] {
         // Indicate we are using ffmpeg resources in a detached thread.
         analysisResMtx.lock();
 
-        bool ok = decoder->OpenInput(url, forceSoftwareDecoding);
+        const VideoStreamInfo *knownVideo = knownVideoUrl_ == url ? &knownVideo_ : nullptr;
+
+        bool ok = decoder->OpenInput(url, forceSoftwareDecoding, knownVideo);
         if (!ok) {
             GuiInterface::Instance().PutLog(LogLevel::Error, "Loading URL failed");
             analysisResMtx.unlock();
@@ -112,11 +133,21 @@ void RealTimePlayer::play(const std::string &playUrl, bool forceSoftwareDecoding
         // Bitrate callback.
         decoder->bitrateUpdateCallback = [](uint64_t bitrate) { GuiInterface::Instance().EmitBitrateUpdate(bitrate); };
 
+        // Without probing, the RTP input learns the video size and frame rate only from the first frames.
+        decoder->videoInfoCallback = [this](int width, int height, float fps) {
+            GuiInterface::Instance().EmitDecoderReady(width, height, fps);
+            onVideoInfoReady(width, height, decoder->GetVideoFrameFormat());
+        };
+
         hwEnabled = decoder->hwDecoderEnabled;
 
         decodeThread = std::thread([this] {
             decodeResMtx.lock();
 
+            // Waiting for the first frame since play() or since the signal was lost
+            bool waitingForFrame = true;
+            auto waitStartTime = playStartTime_;
+
             while (!playStop) {
                 try {
                     // Getting frame.
@@ -125,12 +156,32 @@ void RealTimePlayer::play(const std::string &playUrl, bool forceSoftwareDecoding
                         continue;
                     }
 
+                    if (waitingForFrame) {
+                        waitingForFrame = false;
+
+                        const auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+                                                std::chrono::steady_clock::now() - waitStartTime)
+                                                .count();
+                        timeToFirstFrameUs_.store(waited, std::memory_order_relaxed);
+                        GuiInterface::Instance().PutLog(LogLevel::Info, "First frame after {} ms", waited / 1000);
+                    }
+
+                    DecodedFrame decoded{std::move(frame), std::chrono::steady_clock::now()};
+
+                    if (useMailbox_) {
+                        if (!frameMailbox.publish(std::move(decoded))) {
+                            framesSkipped_.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        continue;
+                    }
+
                     // Push frame to the buffer queue.
                     std::lock_guard lck(mtx);
                     if (videoFrameQueue.size() > 10) {
                         videoFrameQueue.pop();
+                        framesSkipped_.fetch_add(1, std::memory_order_relaxed);
                     }
-                    videoFrameQueue.push(frame);
+                    videoFrameQueue.push(std::move(decoded));
                 }
                 // Decoder error. But continue.
                 catch (const SendPacketException &e) {
@@ -141,6 +192,15 @@ void RealTimePlayer::play(const std::string &playUrl, bool forceSoftwareDecoding
                 catch (const ReadFrameException &e) {
                     GuiInterface::Instance().PutLog(LogLevel::Error, e.what());
                     GuiInterface::Instance().ShowTip(FTR("signal lost"));
+
+                    // Keep the input open and only drop the decoder state, the stream resumes at its next keyframe
+                    // without reopening or probing anything.
+                    decoder->Flush();
+
+                    if (!waitingForFrame) {
+                        waitingForFrame = true;
+                        waitStartTime = std::chrono::steady_clock::now();
+                    }
                 }
                 // Break on other unknown errors.
                 catch (const std::exception &e) {
@@ -186,13 +246,20 @@ void RealTimePlayer::stop() {
 
     {
         std::lock_guard lck(mtx);
-        videoFrameQueue = std::queue<std::shared_ptr<AVFrame>>();
+        videoFrameQueue = std::queue<DecodedFrame>();
     }
+    frameMailbox.clear();
 
     // Do this before closing input.
     disableAudio();
 
     if (decoder) {
+        // Remembered for the restart after a lost connection, which reopens the same URL.
+        if (VideoStreamInfo info = decoder->GetVideoStreamInfo(); info.params) {
+            knownVideo_ = std::move(info);
+            knownVideoUrl_ = url;
+        }
+
         decoder->CloseInput();
         decoder.reset();
     }
@@ -331,6 +398,20 @@ void RealTimePlayer::forceSoftwareDecoding(bool force) {
     forceSoftwareDecoding_ = force;
 }
 
+void RealTimePlayer::setLowLatencyDisplay(bool enabled) {
+    lowLatencyDisplay_ = enabled;
+}
+
+RealTimePlayer::PresentStats RealTimePlayer::presentStats() const {
+    PresentStats stats;
+    stats.presented = framesPresented_.load(std::memory_order_relaxed);
+    stats.skipped = framesSkipped_.load(std::memory_order_relaxed);
+    stats.ageSumUs = presentAgeSumUs_.load(std::memory_order_relaxed);
+    stats.ageLastUs = presentAgeLastUs_.load(std::memory_order_relaxed);
+    stats.timeToFirstFrameUs = timeToFirstFrameUs_.load(std::memory_order_relaxed);
+    return stats;
+}
+
 bool RealTimePlayer::isHardwareAccelerated() const {
     return hwEnabled;
 }
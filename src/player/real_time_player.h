@@ -7,6 +7,7 @@
 #include <thread>
 
 #include "ffmpeg_decoder.h"
+#include "frame_mailbox.h"
 #include "gif_encoder.h"
 #include "mp4_encoder.h"
 #include "yuv_renderer.h"
@@ -15,6 +16,18 @@ struct SDL_AudioStream;
 
 class RealTimePlayer {
 public:
+    /// Frames handed to the renderer and the ones it never got to see.
+    struct PresentStats {
+        uint64_t presented = 0;
+        /// Replaced by a newer frame in low-latency mode, dropped from a full queue otherwise
+        uint64_t skipped = 0;
+        /// Sum of the times from decoding to presentation, so deltas give the average age over any interval
+        uint64_t ageSumUs = 0;
+        uint64_t ageLastUs = 0;
+        /// From play() or the last signal loss to the next decoded frame, i.e. how long the picture was stale
+        uint64_t timeToFirstFrameUs = 0;
+    };
+
     RealTimePlayer(std::shared_ptr<Pathfinder::Device> device, std::shared_ptr<Pathfinder::Queue> queue);
     ~RealTimePlayer();
     void update(float dt);
@@ -62,6 +75,11 @@ public:
 
     void forceSoftwareDecoding(bool force);
 
+    /// Show only the newest decoded frame instead of queueing every frame. Takes effect on the next play().
+    void setLowLatencyDisplay(bool enabled);
+
+    PresentStats presentStats() const;
+
     bool isHardwareAccelerated() const;
 
     std::shared_ptr<FfmpegDecoder> getDecoder() const;
@@ -89,13 +107,31 @@ protected:
     // Play file URL
     std::string url;
 
+    // The video stream of the last session, so that restarting the same URL starts with its parameters
+    VideoStreamInfo knownVideo_;
+    std::string knownVideoUrl_;
+
+    std::chrono::steady_clock::time_point playStartTime_;
+
     volatile bool playStop = true;
 
     volatile bool isMuted = false;
 
     SDL_AudioStream *stream{};
 
-    std::queue<std::shared_ptr<AVFrame>> videoFrameQueue;
+    // Queue mode, every frame is shown in order
+    std::queue<DecodedFrame> videoFrameQueue;
+
+    // Low-latency mode, the renderer always takes the newest frame
+    FrameMailbox frameMailbox;
+    bool lowLatencyDisplay_ = true;
+    bool useMailbox_ = true;
+
+    std::atomic<uint64_t> framesPresented_{0};
+    std::atomic<uint64_t> framesSkipped_{0};
+    std::atomic<uint64_t> presentAgeSumUs_{0};
+    std::atomic<uint64_t> presentAgeLastUs_{0};
+    std::atomic<uint64_t> timeToFirstFrameUs_{0};
 
     std::mutex mtx;
 
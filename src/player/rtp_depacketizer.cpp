@@ -0,0 +1,335 @@
+#include "rtp_depacketizer.h"
+
+#include <iterator>
+
+namespace {
+
+constexpr uint8_t START_CODE[] = {0x00, 0x00, 0x00, 0x01};
+
+constexpr size_t RTP_HEADER_SIZE = 12;
+
+// A sequence number further off than this, either way, can't be loss or reordering and means the sender restarted.
+constexpr uint16_t MAX_SEQUENCE_JUMP = 1000;
+
+// This many packets in a row from behind the expected sequence number also mean the sender restarted.
+constexpr int MAX_LATE_PACKETS = 8;
+
+constexpr uint8_t H264_NAL_IDR = 5;
+constexpr uint8_t H264_NAL_SPS = 7;
+constexpr uint8_t H264_NAL_PPS = 8;
+constexpr uint8_t H264_NAL_STAP_A = 24;
+constexpr uint8_t H264_NAL_FU_A = 28;
+
+constexpr uint8_t H265_NAL_BLA_W_LP = 16;
+constexpr uint8_t H265_NAL_RSV_IRAP_23 = 23;
+constexpr uint8_t H265_NAL_VPS = 32;
+constexpr uint8_t H265_NAL_SPS = 33;
+constexpr uint8_t H265_NAL_PPS = 34;
+constexpr uint8_t H265_NAL_AP = 48;
+constexpr uint8_t H265_NAL_FU = 49;
+
+} // namespace
+
+bool RtpDepacketizer::push(const uint8_t *packet, size_t size) {
+    if (size < RTP_HEADER_SIZE || (packet[0] >> 6) != 2) {
+        return false;
+    }
+
+    size_t offset = RTP_HEADER_SIZE + (packet[0] & 0x0F) * 4;
+
+    // Header extension
+    if (packet[0] & 0x10) {
+        if (offset + 4 > size) {
+            return false;
+        }
+        offset += 4 + ((packet[offset + 2] << 8) | packet[offset + 3]) * 4;
+    }
+
+    size_t end = size;
+
+    // Padding
+    if (packet[0] & 0x20) {
+        const uint8_t padding = packet[size - 1];
+        if (padding > end) {
+            return false;
+        }
+        end -= padding;
+    }
+
+    if (offset >= end) {
+        return false;
+    }
+
+    const bool marker = packet[1] & 0x80;
+    const uint16_t sequence = (packet[2] << 8) | packet[3];
+    const uint32_t timestamp = (uint32_t(packet[4]) << 24) | (packet[5] << 16) | (packet[6] << 8) | packet[7];
+    const uint32_t ssrc = (uint32_t(packet[8]) << 24) | (packet[9] << 16) | (packet[10] << 8) | packet[11];
+
+    // A restarted encoder picks a new SSRC and a new random sequence number.
+    bool restarted = haveSsrc_ && ssrc != ssrc_;
+    haveSsrc_ = true;
+    ssrc_ = ssrc;
+
+    bool gap = false;
+    if (haveSequence_ && !restarted) {
+        const uint16_t missing = sequence - nextSequence_;
+        if (missing >= 0x8000) {
+            const uint16_t behind = nextSequence_ - sequence;
+            if (behind <= MAX_SEQUENCE_JUMP && ++latePackets_ < MAX_LATE_PACKETS) {
+                // Duplicate or late, whatever it belonged to has been dealt with already.
+                return false;
+            }
+            restarted = true;
+        } else if (missing > MAX_SEQUENCE_JUMP) {
+            restarted = true;
+        } else if (missing > 0) {
+            stats_.lostPackets += missing;
+            gap = true;
+        }
+    }
+
+    if (restarted) {
+        stats_.resyncs++;
+        resync();
+    }
+    latePackets_ = 0;
+    haveSequence_ = true;
+    nextSequence_ = sequence + 1;
+    stats_.packets++;
+
+    // The missing packets may have been the end of the open access unit or the start of the next one.
+    if (gap) {
+        currentBroken_ = true;
+        inFragment_ = false;
+    }
+
+    bool completed = false;
+
+    // A new timestamp while an access unit is open means its marker packet got lost.
+    if (currentOpen_ && timestamp != currentTimestamp_) {
+        completed = finishFrame();
+        currentBroken_ = gap;
+    }
+
+    currentOpen_ = true;
+    currentTimestamp_ = timestamp;
+
+    if (!currentBroken_) {
+        if (isH265_) {
+            pushH265(packet + offset, end - offset);
+        } else {
+            pushH264(packet + offset, end - offset);
+        }
+    }
+
+    // Should this packet have completed another access unit as well, that one is finished by the next packet, as
+    // frame() can only hold one.
+    if (marker && !completed) {
+        completed = finishFrame();
+    }
+
+    return completed;
+}
+
+std::vector<uint8_t> RtpDepacketizer::parameterSets() const {
+    std::vector<uint8_t> out;
+    if ((isH265_ && vps_.empty()) || sps_.empty() || pps_.empty()) {
+        return out;
+    }
+
+    for (const auto *nal : {&vps_, &sps_, &pps_}) {
+        if (!nal->empty()) {
+            out.insert(out.end(), std::begin(START_CODE), std::end(START_CODE));
+            out.insert(out.end(), nal->begin(), nal->end());
+        }
+    }
+    return out;
+}
+
+void RtpDepacketizer::reset() {
+    resync();
+
+    haveSsrc_ = false;
+    frame_.clear();
+    frameIsKeyframe_ = false;
+    vps_.clear();
+    sps_.clear();
+    pps_.clear();
+}
+
+void RtpDepacketizer::resync() {
+    if (currentOpen_ && !current_.empty()) {
+        stats_.droppedFrames++;
+    }
+
+    haveSequence_ = false;
+    latePackets_ = 0;
+    current_.clear();
+    currentOpen_ = false;
+    currentBroken_ = false;
+    currentIsKeyframe_ = false;
+    inFragment_ = false;
+}
+
+bool RtpDepacketizer::finishFrame() {
+    const bool complete = !currentBroken_ && !inFragment_ && !current_.empty();
+
+    if (complete) {
+        // Swap rather than copy, the old frame's buffer is reused for the next access unit.
+        frame_.swap(current_);
+        frameTimestamp_ = currentTimestamp_;
+        frameIsKeyframe_ = currentIsKeyframe_;
+        stats_.frames++;
+    } else if (currentBroken_ || inFragment_) {
+        stats_.droppedFrames++;
+    }
+
+    current_.clear();
+    currentOpen_ = false;
+    currentBroken_ = false;
+    currentIsKeyframe_ = false;
+    inFragment_ = false;
+
+    return complete;
+}
+
+void RtpDepacketizer::pushH264(const uint8_t *payload, size_t size) {
+    const uint8_t nalType = payload[0] & 0x1F;
+
+    switch (nalType) {
+        case H264_NAL_STAP_A: {
+            size_t pos = 1;
+            while (pos + 2 <= size) {
+                const size_t nalSize = (payload[pos] << 8) | payload[pos + 1];
+                pos += 2;
+                if (nalSize == 0 || pos + nalSize > size) {
+                    break;
+                }
+                appendNal(payload + pos, nalSize);
+                pos += nalSize;
+            }
+            inFragment_ = false;
+        } break;
+        case H264_NAL_FU_A: {
+            if (size < 3) {
+                return;
+            }
+            const uint8_t fuHeader = payload[1];
+            const bool start = fuHeader & 0x80;
+            const bool end = fuHeader & 0x40;
+
+            if (start) {
+                const uint8_t nalHeader = (payload[0] & 0xE0) | (fuHeader & 0x1F);
+                inspectNal(&nalHeader, 1);
+                current_.insert(current_.end(), std::begin(START_CODE), std::end(START_CODE));
+                current_.push_back(nalHeader);
+                inFragment_ = true;
+            } else if (!inFragment_) {
+                // The start of this NAL unit was lost, skip the rest of it.
+                return;
+            }
+
+            current_.insert(current_.end(), payload + 2, payload + size);
+
+            if (end) {
+                inFragment_ = false;
+            }
+        } break;
+        default: {
+            // Single NAL unit packet
+            appendNal(payload, size);
+            inFragment_ = false;
+        } break;
+    }
+}
+
+void RtpDepacketizer::pushH265(const uint8_t *payload, size_t size) {
+    if (size < 2) {
+        return;
+    }
+
+    const uint8_t nalType = (payload[0] >> 1) & 0x3F;
+
+    switch (nalType) {
+        case H265_NAL_AP: {
+            size_t pos = 2;
+            while (pos + 2 <= size) {
+                const size_t nalSize = (payload[pos] << 8) | payload[pos + 1];
+                pos += 2;
+                if (nalSize < 2 || pos + nalSize > size) {
+                    break;
+                }
+                appendNal(payload + pos, nalSize);
+                pos += nalSize;
+            }
+            inFragment_ = false;
+        } break;
+        case H265_NAL_FU: {
+            if (size < 4) {
+                return;
+            }
+            const uint8_t fuHeader = payload[2];
+            const bool start = fuHeader & 0x80;
+            const bool end = fuHeader & 0x40;
+
+            if (start) {
+                const uint8_t nalHeader[] = {uint8_t((payload[0] & 0x81) | ((fuHeader & 0x3F) << 1)), payload[1]};
+                inspectNal(nalHeader, sizeof(nalHeader));
+                current_.insert(current_.end(), std::begin(START_CODE), std::end(START_CODE));
+                current_.insert(current_.end(), std::begin(nalHeader), std::end(nalHeader));
+                inFragment_ = true;
+            } else if (!inFragment_) {
+                // The start of this NAL unit was lost, skip the rest of it.
+                return;
+            }
+
+            current_.insert(current_.end(), payload + 3, payload + size);
+
+            if (end) {
+                inFragment_ = false;
+            }
+        } break;
+        default: {
+            // Single NAL unit packet
+            appendNal(payload, size);
+            inFragment_ = false;
+        } break;
+    }
+}
+
+void RtpDepacketizer::appendNal(const uint8_t *nal, size_t size) {
+    inspectNal(nal, size);
+    current_.insert(current_.end(), std::begin(START_CODE), std::end(START_CODE));
+    current_.insert(current_.end(), nal, nal + size);
+}
+
+void RtpDepacketizer::inspectNal(const uint8_t *nal, size_t size) {
+    // Parameter sets are small enough never to be fragmented, a lone FU header doesn't count.
+    std::vector<uint8_t> *parameterSet = nullptr;
+
+    if (isH265_) {
+        const uint8_t nalType = (nal[0] >> 1) & 0x3F;
+        if (nalType >= H265_NAL_BLA_W_LP && nalType <= H265_NAL_RSV_IRAP_23) {
+            currentIsKeyframe_ = true;
+        } else if (nalType == H265_NAL_VPS) {
+            parameterSet = &vps_;
+        } else if (nalType == H265_NAL_SPS) {
+            parameterSet = &sps_;
+        } else if (nalType == H265_NAL_PPS) {
+            parameterSet = &pps_;
+        }
+    } else {
+        const uint8_t nalType = nal[0] & 0x1F;
+        if (nalType == H264_NAL_IDR) {
+            currentIsKeyframe_ = true;
+        } else if (nalType == H264_NAL_SPS) {
+            parameterSet = &sps_;
+        } else if (nalType == H264_NAL_PPS) {
+            parameterSet = &pps_;
+        }
+    }
+
+    if (parameterSet && size > (isH265_ ? 2u : 1u)) {
+        parameterSet->assign(nal, nal + size);
+    }
+}
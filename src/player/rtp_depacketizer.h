@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// Reassembles RTP packets carrying H.264 (RFC 6184) or H.265 (RFC 7798) into access units, one video frame each,
+/// as Annex-B byte streams ready for the decoder.
+/// An access unit ends with the marker bit, or with the first packet of a newer timestamp if the marker was lost.
+/// A gap in the sequence numbers spoils the access unit it falls into, which is then dropped as a whole
+/// instead of being handed to the decoder half complete.
+/// A new SSRC, a large jump in the sequence numbers or a run of packets from behind the expected one mean the sender
+/// restarted, and the depacketizer starts over from the packet at hand.
+class RtpDepacketizer {
+public:
+    struct Stats {
+        uint64_t packets = 0;
+        /// Packets missing from the sequence
+        uint64_t lostPackets = 0;
+        /// Access units completed
+        uint64_t frames = 0;
+        /// Access units dropped because some of their packets were lost
+        uint64_t droppedFrames = 0;
+        /// Times the depacketizer started over because the sender restarted
+        uint64_t resyncs = 0;
+    };
+
+    explicit RtpDepacketizer(bool isH265) : isH265_(isH265) {}
+
+    /// Feed one RTP packet. Returns true if it completed an access unit, which is then available from frame()
+    /// until the next call. Invalid, duplicate and late packets are ignored.
+    bool push(const uint8_t *packet, size_t size);
+
+    /// The last completed access unit
+    const std::vector<uint8_t> &frame() const {
+        return frame_;
+    }
+
+    /// RTP timestamp of the last completed access unit, 90 kHz
+    uint32_t frameTimestamp() const {
+        return frameTimestamp_;
+    }
+
+    /// Whether the last completed access unit holds an IDR/IRAP picture
+    bool frameIsKeyframe() const {
+        return frameIsKeyframe_;
+    }
+
+    /// The latest VPS (H.265), SPS and PPS in Annex-B, in that order. Empty until all of them have been seen.
+    std::vector<uint8_t> parameterSets() const;
+
+    const Stats &stats() const {
+        return stats_;
+    }
+
+    /// Forget the stream, e.g. after the link was silent for a while. The stats are kept.
+    void reset();
+
+private:
+    /// Start over from the next packet, dropping the access unit being assembled.
+    void resync();
+
+    void pushH264(const uint8_t *payload, size_t size);
+
+    void pushH265(const uint8_t *payload, size_t size);
+
+    /// Append a complete NAL unit to the current access unit.
+    void appendNal(const uint8_t *nal, size_t size);
+
+    /// Note keyframes and parameter sets, `nal` being at least the NAL unit header.
+    void inspectNal(const uint8_t *nal, size_t size);
+
+    /// Close the current access unit. Returns true if it is complete and moved to frame_.
+    bool finishFrame();
+
+    bool isH265_;
+
+    Stats stats_;
+
+    bool haveSsrc_ = false;
+    uint32_t ssrc_ = 0;
+
+    bool haveSequence_ = false;
+    uint16_t nextSequence_ = 0;
+    /// Consecutive packets from behind the expected sequence number
+    int latePackets_ = 0;
+
+    /// The access unit being assembled
+    std::vector<uint8_t> current_;
+    bool currentOpen_ = false;
+    bool currentBroken_ = false;
+    bool currentIsKeyframe_ = false;
+    uint32_t currentTimestamp_ = 0;
+
+    /// A FU-A/FU start has been seen and the rest of that NAL unit is expected.
+    bool inFragment_ = false;
+
+    std::vector<uint8_t> frame_;
+    uint32_t frameTimestamp_ = 0;
+    bool frameIsKeyframe_ = false;
+
+    std::vector<uint8_t> vps_;
+    std::vector<uint8_t> sps_;
+    std::vector<uint8_t> pps_;
+};
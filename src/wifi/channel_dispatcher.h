@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "FrameParser.h"
+#include "stat_counter.h"
+
+/// wfb-ng channel ID of a radio port: the 24-bit link ID followed by the port.
+constexpr uint32_t makeWfbChannelId(uint32_t linkId, uint8_t radioPort) {
+    return (linkId << 8) | radioPort;
+}
+
+/// Routes wfb-ng frames to a handler by channel ID, (link_id << 8) | radio_port.
+/// Every channel has its own lock, so e.g. telemetry never waits for a video FEC block to be recovered.
+class ChannelDispatcher {
+public:
+    /// Runs with the channel lock held, so the handler may keep unsynchronized state such as its aggregator.
+    using Handler = std::function<void(const Packet &packet, uint8_t wlanIdx)>;
+
+    struct Channel {
+        uint32_t id = 0;
+        std::string name;
+        Handler handler;
+        std::mutex mutex;
+        /// Frames routed to this channel
+        StatCounter frames;
+    };
+
+    ChannelDispatcher() = default;
+
+    ChannelDispatcher(const ChannelDispatcher &) = delete;
+    ChannelDispatcher &operator=(const ChannelDispatcher &) = delete;
+
+    /// Not synchronized with dispatch(), register channels before the RX threads start.
+    /// Returns false if another channel already uses the radio port.
+    bool add(uint32_t channelId, std::string name, Handler handler) {
+        auto &slot = channels_[channelId & 0xff];
+        if (slot) {
+            return false;
+        }
+
+        slot = std::make_unique<Channel>();
+        slot->id = channelId;
+        slot->name = std::move(name);
+        slot->handler = std::move(handler);
+        return true;
+    }
+
+    /// Drop all channels and their handlers. Only call once the RX threads have stopped.
+    void clear() {
+        for (auto &slot : channels_) {
+            slot.reset();
+        }
+        unmatched_.reset();
+    }
+
+    /// Hand a frame to the channel registered for `channelId`.
+    /// Returns false if there is none, the frame is then only counted.
+    bool dispatch(uint32_t channelId, const Packet &packet, uint8_t wlanIdx) {
+        Channel *channel = channels_[channelId & 0xff].get();
+        if (!channel || channel->id != channelId) {
+            unmatched_.add();
+            return false;
+        }
+
+        channel->frames.add();
+
+        std::lock_guard lock(channel->mutex);
+        channel->handler(packet, wlanIdx);
+        return true;
+    }
+
+    /// Frames of a link ID or radio port nobody registered.
+    int64_t unmatchedCount() const {
+        return unmatched_.load();
+    }
+
+private:
+    /// Indexed by radio port, the lowest byte of the channel ID. A lookup is one load and one compare.
+    std::array<std::unique_ptr<Channel>, 256> channels_;
+
+    StatCounter unmatched_;
+};
@@ -13,6 +13,24 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #define FEC_SIMD_X86
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#elif defined(__aarch64__) || defined(_M_ARM64) || (defined(__ARM_NEON) && defined(__arm__))
+    #define FEC_SIMD_NEON
+    #include <arm_neon.h>
+#endif
+
+/* Lets a single function use an instruction set the rest of the file is not compiled for. */
+#if defined(FEC_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+    #define FEC_TARGET(isa) __attribute__((target(isa)))
+#else
+    #define FEC_TARGET(isa)
+#endif
+
 /*
  * Primitive polynomials - see Lin & Costello, Appendix A,
  * and  Lee & Messerschmitt, p. 453.
@@ -90,6 +108,23 @@ static void _init_mul_table(void) {
     for (j = 0; j < 256; j++) gf_mul_table[0][j] = gf_mul_table[j][0] = 0;
 }
 
+/*
+ * Split-nibble tables for the SIMD kernels. Multiplication by c is linear
+ * over GF(2), so c * x = c * (x & 0x0f) ^ c * (x & 0xf0). gf_nibble_table[c]
+ * holds the 16 products of the low nibble followed by the 16 products of the
+ * high nibble, each half being a pshufb/tbl lookup table.
+ */
+static gf gf_nibble_table[256][32];
+
+static void _init_nibble_table(void) {
+    int c, i;
+    for (c = 0; c < 256; c++)
+        for (i = 0; i < 16; i++) {
+            gf_nibble_table[c][i] = gf_mul_table[c][i];
+            gf_nibble_table[c][16 + i] = gf_mul_table[c][i << 4];
+        }
+}
+
 #define NEW_GF_MATRIX(rows, cols) (gf *)malloc(rows *cols)
 
 /*
@@ -164,7 +199,7 @@ static void generate_gf(void) {
  * calls are unfrequent in my typical apps so I did not bother.
  */
 #define addmul(dst, src, c, sz) \
-    if (c != 0) _addmul1(dst, src, c, sz)
+    if (c != 0) addmul_impl(dst, src, c, sz)
 
 #define UNROLL 16 /* 1, 4, 8, 16 */
 static void _addmul1(register gf *restrict dst, const register gf *restrict src, gf c, size_t sz) {
@@ -202,6 +237,127 @@ static void _addmul1(register gf *restrict dst, const register gf *restrict src,
         GF_ADDMULC(*dst, *src);
 }
 
+/*
+ * SIMD versions of _addmul1(). Each one handles the bulk of the buffer with
+ * pshufb/tbl lookups into gf_nibble_table[c] and leaves the tail to
+ * _addmul1(), so the output is bit-identical to the scalar code.
+ */
+#ifdef FEC_SIMD_X86
+FEC_TARGET("ssse3")
+static void _addmul1_ssse3(gf *restrict dst, const gf *restrict src, gf c, size_t sz) {
+    const __m128i lo_table = _mm_loadu_si128((const __m128i *)gf_nibble_table[c]);
+    const __m128i hi_table = _mm_loadu_si128((const __m128i *)(gf_nibble_table[c] + 16));
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= sz; i += 16) {
+        const __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        const __m128i lo = _mm_shuffle_epi8(lo_table, _mm_and_si128(x, mask));
+        const __m128i hi = _mm_shuffle_epi8(hi_table, _mm_and_si128(_mm_srli_epi64(x, 4), mask));
+        const __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, _mm_xor_si128(lo, hi)));
+    }
+
+    if (i < sz) _addmul1(dst + i, src + i, c, sz - i);
+}
+
+FEC_TARGET("avx2")
+static void _addmul1_avx2(gf *restrict dst, const gf *restrict src, gf c, size_t sz) {
+    const __m256i lo_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)gf_nibble_table[c]));
+    const __m256i hi_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(gf_nibble_table[c] + 16)));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 32 <= sz; i += 32) {
+        const __m256i x = _mm256_loadu_si256((const __m256i *)(src + i));
+        const __m256i lo = _mm256_shuffle_epi8(lo_table, _mm256_and_si256(x, mask));
+        const __m256i hi = _mm256_shuffle_epi8(hi_table, _mm256_and_si256(_mm256_srli_epi64(x, 4), mask));
+        const __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d, _mm256_xor_si256(lo, hi)));
+    }
+
+    if (i < sz) _addmul1_ssse3(dst + i, src + i, c, sz - i);
+}
+
+static int _cpu_has_ssse3(void) {
+    #ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 9)) != 0;
+    #else
+    return __builtin_cpu_supports("ssse3");
+    #endif
+}
+
+static int _cpu_has_avx2(void) {
+    #ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return 0;
+    __cpuid(info, 1);
+    /* The OS must save the YMM registers (OSXSAVE + XCR0 bits 1 and 2). */
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6) return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+    #else
+    return __builtin_cpu_supports("avx2");
+    #endif
+}
+#endif
+
+#ifdef FEC_SIMD_NEON
+static void _addmul1_neon(gf *restrict dst, const gf *restrict src, gf c, size_t sz) {
+    const uint8x16_t lo_table = vld1q_u8(gf_nibble_table[c]);
+    const uint8x16_t hi_table = vld1q_u8(gf_nibble_table[c] + 16);
+    const uint8x16_t mask = vdupq_n_u8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= sz; i += 16) {
+        const uint8x16_t x = vld1q_u8(src + i);
+    #if defined(__aarch64__) || defined(_M_ARM64)
+        const uint8x16_t lo = vqtbl1q_u8(lo_table, vandq_u8(x, mask));
+        const uint8x16_t hi = vqtbl1q_u8(hi_table, vshrq_n_u8(x, 4));
+    #else
+        const uint8x8x2_t lo_t = {{vget_low_u8(lo_table), vget_high_u8(lo_table)}};
+        const uint8x8x2_t hi_t = {{vget_low_u8(hi_table), vget_high_u8(hi_table)}};
+        const uint8x16_t xl = vandq_u8(x, mask);
+        const uint8x16_t xh = vshrq_n_u8(x, 4);
+        const uint8x16_t lo = vcombine_u8(vtbl2_u8(lo_t, vget_low_u8(xl)), vtbl2_u8(lo_t, vget_high_u8(xl)));
+        const uint8x16_t hi = vcombine_u8(vtbl2_u8(hi_t, vget_low_u8(xh)), vtbl2_u8(hi_t, vget_high_u8(xh)));
+    #endif
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), veorq_u8(lo, hi)));
+    }
+
+    if (i < sz) _addmul1(dst + i, src + i, c, sz - i);
+}
+#endif
+
+typedef void (*addmul_fn)(gf *restrict dst, const gf *restrict src, gf c, size_t sz);
+
+/* Picked once by _init_addmul() according to the running CPU. */
+static addmul_fn addmul_impl = _addmul1;
+static const char *addmul_impl_name = "scalar";
+
+static void _init_addmul(int allow_simd) {
+    addmul_impl = _addmul1;
+    addmul_impl_name = "scalar";
+
+    if (!allow_simd) return;
+
+#if defined(FEC_SIMD_X86)
+    if (_cpu_has_avx2()) {
+        addmul_impl = _addmul1_avx2;
+        addmul_impl_name = "avx2";
+    } else if (_cpu_has_ssse3()) {
+        addmul_impl = _addmul1_ssse3;
+        addmul_impl_name = "ssse3";
+    }
+#elif defined(FEC_SIMD_NEON)
+    addmul_impl = _addmul1_neon;
+    addmul_impl_name = "neon";
+#endif
+}
+
 /*
  * computes C = AB where A is n*k, B is k*m, C is n*m
  */
@@ -385,9 +541,21 @@ static int fec_initialized = 0;
 static void init_fec(void) {
     generate_gf();
     _init_mul_table();
+    _init_nibble_table();
+    _init_addmul(1);
     fec_initialized = 1;
 }
 
+const char *fec_simd_name(void) {
+    if (fec_initialized == 0) init_fec();
+    return addmul_impl_name;
+}
+
+void fec_set_simd_enabled(int enabled) {
+    if (fec_initialized == 0) init_fec();
+    _init_addmul(enabled);
+}
+
 /*
  * This section contains the proper FEC encoding/decoding routines.
  * The encoding matrix is computed starting with a Vandermonde matrix,
@@ -396,8 +564,49 @@ static void init_fec(void) {
 
 #define FEC_MAGIC 0xFECC0DEC
 
+/*
+ * A lossy link keeps hitting the same few erasure patterns, e.g. the same
+ * fragment of every block lost to a periodic interferer. Caching the inverted
+ * decode matrix per pattern turns a repeated recovery into pure addmul work
+ * instead of a k^3 matrix inversion. Entries are evicted least recently used.
+ */
+#define FEC_DECODE_CACHE_SIZE 8
+
+struct fec_decode_cache_entry {
+    unsigned long last_used; /* 0 if the entry is empty */
+    gf *key;                 /* index[] pattern, k entries (block numbers are < n <= 256) */
+    gf *matrix;              /* k*k inverted decode matrix */
+};
+
+struct fec_decode_cache {
+    unsigned long clock;
+    unsigned long hits;
+    unsigned long misses;
+    gf *space;
+    struct fec_decode_cache_entry entries[FEC_DECODE_CACHE_SIZE];
+};
+
+static struct fec_decode_cache *_decode_cache_new(unsigned k) {
+    struct fec_decode_cache *cache = (struct fec_decode_cache *)calloc(1, sizeof(struct fec_decode_cache));
+    size_t entry_size = k + k * k;
+    unsigned i;
+
+    cache->space = (gf *)malloc(FEC_DECODE_CACHE_SIZE * entry_size);
+    for (i = 0; i < FEC_DECODE_CACHE_SIZE; i++) {
+        cache->entries[i].key = cache->space + i * entry_size;
+        cache->entries[i].matrix = cache->entries[i].key + k;
+    }
+    return cache;
+}
+
+static void _decode_cache_free(struct fec_decode_cache *cache) {
+    free(cache->space);
+    free(cache);
+}
+
 void fec_free(fec_t *p) {
     assert(p != NULL && p->magic == (((FEC_MAGIC ^ p->k) ^ p->n) ^ (unsigned long)(p->enc_matrix)));
+    _decode_cache_free(p->decode_cache);
     free(p->enc_matrix);
     free(p);
 }
@@ -420,6 +629,7 @@ fec_t *fec_new(unsigned short k, unsigned short n) {
     retval->n = n;
     retval->enc_matrix = NEW_GF_MATRIX(n, k);
     retval->magic = ((FEC_MAGIC ^ k) ^ n) ^ (unsigned long)(retval->enc_matrix);
+    retval->decode_cache = _decode_cache_new(k);
     tmp_m = NEW_GF_MATRIX(n, k);
     /*
      * fill the matrix with powers of field elements, starting from 0.
@@ -470,6 +680,16 @@ void fec_encode(const fec_t *code, const gf **src, gf **fecs, size_t sz) {
     }
 }
 
+void fec_encode_add(const fec_t *code, const gf *src, unsigned src_index, gf **fecs, size_t sz) {
+    unsigned i;
+    const gf *p = &(code->enc_matrix[code->k * code->k + src_index]);
+
+    /* Column src_index of the parity rows, one row every k bytes */
+    for (i = 0; i < (unsigned)(code->n - code->k); i++, p += code->k) {
+        addmul(fecs[i], src, *p, sz);
+    }
+}
+
 /**
  * Build decode matrix into some memory space.
  *
@@ -492,12 +712,47 @@ void build_decode_matrix_into_space(const fec_t *restrict const code,
     _invert_mat(matrix, k);
 }
 
+/*
+ * Returns the inverted decode matrix for the erasure pattern index[], from the
+ * cache if possible, otherwise built into the least recently used entry.
+ */
+static const gf *_get_decode_matrix(const fec_t *code, const unsigned *index) {
+    struct fec_decode_cache *cache = code->decode_cache;
+    struct fec_decode_cache_entry *entry, *victim = &cache->entries[0];
+    gf *key = (gf *)alloca(code->k);
+    unsigned i;
+
+    for (i = 0; i < code->k; i++) key[i] = (gf)index[i];
+
+    cache->clock++;
+
+    for (i = 0; i < FEC_DECODE_CACHE_SIZE; i++) {
+        entry = &cache->entries[i];
+        if (entry->last_used != 0 && memcmp(entry->key, key, code->k) == 0) {
+            entry->last_used = cache->clock;
+            cache->hits++;
+            return entry->matrix;
+        }
+        if (entry->last_used < victim->last_used) victim = entry;
+    }
+
+    cache->misses++;
+    build_decode_matrix_into_space(code, index, code->k, victim->matrix);
+    memcpy(victim->key, key, code->k);
+    victim->last_used = cache->clock;
+    return victim->matrix;
+}
+
+void fec_decode_cache_stats(const fec_t *code, unsigned long *hits, unsigned long *misses) {
+    *hits = code->decode_cache->hits;
+    *misses = code->decode_cache->misses;
+}
+
 void fec_decode(const fec_t *code, const gf **inpkts, gf **outpkts, const unsigned *index, size_t sz) {
-    gf *m_dec = (gf *)alloca(code->k * code->k);
+    const gf *m_dec = _get_decode_matrix(code, index);
     unsigned char outix = 0;
     unsigned char row = 0;
     unsigned char col = 0;
-    build_decode_matrix_into_space(code, index, code->k, m_dec);
 
     for (row = 0; row < code->k; row++) {
         assert((index[row] >= code->k) || (index[row] == row)); /* If the block whose number is i is present, then it is
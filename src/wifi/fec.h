@@ -12,10 +12,13 @@
 
 typedef unsigned char gf;
 
+struct fec_decode_cache;
+
 typedef struct {
     unsigned long magic;
     unsigned short k, n; /* parameters of the code */
     gf *enc_matrix;
+    struct fec_decode_cache *decode_cache; /* inverted decode matrices of recent erasure patterns */
 } fec_t;
 
 #if defined(__clang__)
@@ -43,6 +46,18 @@ void fec_free(fec_t *p);
  */
 void fec_encode(const fec_t *code, const gf **src, gf **fecs, size_t sz);
 
+/**
+ * Streaming counterpart of fec_encode(): adds the contribution of one primary block to the secondary blocks, so they
+ * can be built up while the primary blocks arrive. Once every primary block has been added, fecs holds exactly what
+ * fec_encode() would have written. The caller zeroes fecs before adding the first primary block of a group.
+ *
+ * @param src the primary block, bytes past sz are treated as zero
+ * @param src_index number of the primary block, < k
+ * @param fecs the n - k secondary blocks, at least sz bytes each
+ * @param sz size of the primary block in bytes
+ */
+void fec_encode_add(const fec_t *code, const gf *src, unsigned src_index, gf **fecs, size_t sz);
+
 /**
  * @param inpkts an array of packets (size k); If a primary block, i, is present then it must be at index i. Secondary
  * blocks can appear anywhere.
@@ -53,6 +68,27 @@ void fec_encode(const fec_t *code, const gf **src, gf **fecs, size_t sz);
  */
 void fec_decode(const fec_t *code, const gf **inpkts, gf **outpkts, const unsigned *index, size_t sz);
 
+/**
+ * fec_decode() keeps the inverted decode matrices of the last few erasure patterns (the index[] argument), so a
+ * pattern seen before skips the matrix inversion. As a consequence, fec_decode() must not be called concurrently on
+ * the same fec_t.
+ *
+ * @param hits number of fec_decode() calls that found their decode matrix in the cache
+ * @param misses number of fec_decode() calls that had to build and invert it
+ */
+void fec_decode_cache_stats(const fec_t *code, unsigned long *hits, unsigned long *misses);
+
+/**
+ * Name of the multiply-accumulate kernel picked for this CPU ("avx2", "ssse3", "neon" or "scalar").
+ */
+const char *fec_simd_name(void);
+
+/**
+ * Switch between the SIMD kernels and the scalar reference code. SIMD is enabled by default.
+ * Both produce identical output, this is meant for benchmarking.
+ */
+void fec_set_simd_enabled(int enabled);
+
 #if defined(_MSC_VER)
     #define alloca _alloca
 #else
@@ -0,0 +1,111 @@
+#include "fec_controller.h"
+
+#include <algorithm>
+#include <vector>
+
+std::unique_ptr<FecController> makeFecController(const std::string &name) {
+    if (name == "threshold") {
+        return std::make_unique<ThresholdFecController>();
+    }
+    if (name == "model") {
+        return std::make_unique<ModelFecController>();
+    }
+    return nullptr;
+}
+
+double ModelFecController::residualLoss(int k, int n, double lossRate, double burstLength) {
+    if (lossRate <= 0 || n <= 0 || k <= 0) {
+        return 0;
+    }
+    const double p = std::min(lossRate, 0.999);
+
+    // A Gilbert channel can't be lossier than its bursts allow, lengthen them to match the rate.
+    const double b = std::max({1.0, burstLength, p / (1 - p)});
+
+    // Leave the bad (erasing) state with 1/b, enter it at the rate that gives a stationary erasure rate of p.
+    const double toGood = 1 / b;
+    const double toBad = std::min(1.0, p * toGood / (1 - p));
+
+    // Probability of e erasures so far, ending in the good or the bad state
+    std::vector<double> good(n + 1, 0), bad(n + 1, 0);
+    good[0] = 1 - p;
+    bad[1] = p;
+
+    for (int i = 1; i < n; i++) {
+        std::vector<double> nextGood(n + 1, 0), nextBad(n + 1, 0);
+        for (int e = 0; e <= i; e++) {
+            nextGood[e] += good[e] * (1 - toBad) + bad[e] * toGood;
+            nextBad[e + 1] += good[e] * toBad + bad[e] * (1 - toGood);
+        }
+        good.swap(nextGood);
+        bad.swap(nextBad);
+    }
+
+    // A block with more erasures than parity loses its missing primaries, on average e * k / n of them.
+    double residual = 0;
+    for (int e = n - k + 1; e <= n; e++) {
+        residual += (good[e] + bad[e]) * e / n;
+    }
+    return residual;
+}
+
+int ModelFecController::levelFor(const FecStats &window) const {
+    const double sent = double(window.packets) + window.fragmentsLost;
+    if (sent < config_.minPackets) {
+        return -1;
+    }
+
+    // Counted in fragments as they went over the air, so the level they were sent with doesn't matter.
+    const double lossRate = window.fragmentsLost / sent;
+    const double burstLength =
+        window.fragmentLossEvents > 0 ? double(window.fragmentsLost) / window.fragmentLossEvents : 1;
+
+    for (int level = 0; level <= MAX_FEC_CHANGE; level++) {
+        if (residualLoss(config_.levels.k, config_.levels.n[level], lossRate, burstLength) <= config_.residualTarget) {
+            return level;
+        }
+    }
+    return MAX_FEC_CHANGE;
+}
+
+int ModelFecController::update(const FecStats &stats, Clock::time_point now) {
+    std::lock_guard lock(mutex_);
+
+    // The alink tick passes a sliding one-second window, keep one of them per second.
+    if (history_.empty() || now - lastSample_ >= std::chrono::seconds(1)) {
+        history_.push_back(stats);
+        lastSample_ = now;
+
+        const size_t longest = *std::max_element(config_.windowSeconds.begin(), config_.windowSeconds.end());
+        while (history_.size() > longest) {
+            history_.pop_front();
+        }
+    }
+
+    int level = levelFor(stats);
+
+    for (const size_t seconds : config_.windowSeconds) {
+        FecStats window;
+        const size_t count = std::min(seconds, history_.size());
+        for (auto it = history_.end() - count; it != history_.end(); ++it) {
+            window.packets += it->packets;
+            window.recovered += it->recovered;
+            window.lost += it->lost;
+            window.lossEvents += it->lossEvents;
+            window.fragmentsLost += it->fragmentsLost;
+            window.fragmentLossEvents += it->fragmentLossEvents;
+        }
+        level = std::max(level, levelFor(window));
+    }
+
+    // No window saw enough traffic, e.g. the video stopped. Keep what we had.
+    if (level >= 0) {
+        level_ = level;
+    }
+    return level_;
+}
+
+int ModelFecController::value(Clock::time_point) {
+    std::lock_guard lock(mutex_);
+    return level_;
+}
@@ -1,49 +1,118 @@
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <mutex>
+#include <string>
 
+/// FEC stats of the video link over one second.
+struct FecStats {
+    /// Unique fragments received, primary and parity
+    uint32_t packets = 0;
+    /// Primary packets restored by FEC
+    uint32_t recovered = 0;
+    /// Primary packets FEC couldn't restore
+    uint32_t lost = 0;
+    /// Runs of consecutive lost packets in the output, so lost / lossEvents is the mean residual burst length
+    uint32_t lossEvents = 0;
+    /// Fragments that never arrived, before FEC. Unlike the counts above, these don't depend on the block size.
+    uint32_t fragmentsLost = 0;
+    /// Runs of consecutive fragments that never arrived, so fragmentsLost / fragmentLossEvents is the mean burst
+    /// length of the channel itself
+    uint32_t fragmentLossEvents = 0;
+};
+
+/// FEC block sizes the drone uses for each fec_change. The drone decides these, so this is an assumption the
+/// model-based controller and the simulator share.
+struct FecLevels {
+    int k = 8;
+    std::array<int, 6> n = {12, 13, 14, 16, 18, 20};
+};
+
+/// Decides the fec_change sent to the drone with every alink message, 0 for the least redundancy.
 class FecController {
 public:
-    /// Query the current (possibly decayed) fec_change value.
-    /// Call this as often as you like; the class handles its own timing.
-    int value() {
-        if (!mEnabled) {
-            return 0;
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int MAX_FEC_CHANGE = 5;
+
+    virtual ~FecController() = default;
+
+    /// Feed the stats of the last second and return the fec_change to ask for. Called on every alink tick,
+    /// so consecutive windows overlap.
+    virtual int update(const FecStats &stats, Clock::time_point now) = 0;
+
+    /// The fec_change as of `now`, without new stats.
+    virtual int value(Clock::time_point now) = 0;
+
+    virtual const char *name() const = 0;
+};
+
+/// "threshold" or "model", null for anything else.
+std::unique_ptr<FecController> makeFecController(const std::string &name);
+
+/// Raises fec_change by fixed recovered/lost thresholds and lowers it by one per second after that.
+class ThresholdFecController : public FecController {
+public:
+    int update(const FecStats &stats, Clock::time_point now) override {
+        if (stats.lost > 2) {
+            bump(5, now);
+        } else {
+            if (stats.recovered > 30) {
+                bump(5, now);
+            }
+            if (stats.recovered > 24) {
+                bump(3, now);
+            }
+            if (stats.recovered > 22) {
+                bump(2, now);
+            }
+            if (stats.recovered > 18) {
+                bump(1, now);
+            }
+            if (stats.recovered < 18) {
+                bump(0, now);
+            }
         }
+        return value(now);
+    }
 
+    /// Query the current (possibly decayed) fec_change value.
+    /// Call this as often as you like; the class handles its own timing.
+    int value(Clock::time_point now) override {
         std::lock_guard lock(mx_);
-        decayLocked_();
+        decayLocked_(now);
         return val_;
     }
 
+    const char *name() const override {
+        return "threshold";
+    }
+
     /// Raise fec_change. If newValue <= current, the call is ignored.
-    /// A successful bump resets the 5-second "hold" timer.
-    void bump(int newValue) {
+    /// A successful bump resets the 1-second "hold" timer.
+    void bump(int newValue, Clock::time_point now) {
         std::lock_guard lock(mx_);
         if (newValue > val_) {
             val_ = newValue;
-            lastChange_ = Clock::now();
+            lastChange_ = now;
         }
     }
 
-    void setEnabled(bool use) {
-        mEnabled = use;
-    }
-
 private:
-    using Clock = std::chrono::steady_clock;
     static constexpr std::chrono::seconds kTick{1}; // length of one hold/decay window
 
-    void decayLocked_() {
+    void decayLocked_(Clock::time_point now) {
         if (val_ == 0) {
             return;
         }
 
-        auto now = Clock::now();
         auto elapsed = now - lastChange_;
 
-        // Still inside the mandatory 5-second hold? Do nothing.
+        // Still inside the mandatory hold? Do nothing.
         if (elapsed < kTick) {
             return;
         }
@@ -67,7 +136,53 @@ private:
     }
 
     int val_{0};
-    Clock::time_point lastChange_{Clock::now()};
+    Clock::time_point lastChange_{};
     std::mutex mx_;
-    bool mEnabled = false;
+};
+
+/// Estimates the erasure rate and burst length of the channel from the fragments lost before FEC, over a short,
+/// a medium and a long window. Models it as a Gilbert channel and picks the smallest fec_change whose block size
+/// keeps the expected residual loss under the target in every window. The long windows make it slow to lower
+/// redundancy after a bad stretch.
+class ModelFecController : public FecController {
+public:
+    struct Config {
+        FecLevels levels;
+        /// Fraction of primary packets allowed to stay lost after FEC, according to the model. It underrates the
+        /// clustering of real losses, so this is set well below what is actually acceptable.
+        double residualTarget = 1e-5;
+        /// Medium and long window, in one-second samples. The short window is the last second.
+        std::array<size_t, 2> windowSeconds = {2, 10};
+        /// Windows with fewer fragments than this don't say enough about the channel and are skipped
+        uint32_t minPackets = 50;
+    };
+
+    ModelFecController() = default;
+
+    explicit ModelFecController(const Config &config) : config_(config) {}
+
+    int update(const FecStats &stats, Clock::time_point now) override;
+
+    /// The level picked by the last update(). It only changes with new stats.
+    int value(Clock::time_point) override;
+
+    const char *name() const override {
+        return "model";
+    }
+
+    /// Expected fraction of primary packets lost after FEC for blocks of k out of n fragments on a Gilbert channel
+    /// with erasure rate `lossRate` and mean burst length `burstLength`.
+    static double residualLoss(int k, int n, double lossRate, double burstLength);
+
+private:
+    /// Smallest fec_change that meets the target for the channel seen in `window`, or -1 if it says too little.
+    int levelFor(const FecStats &window) const;
+
+    Config config_;
+    std::mutex mutex_;
+
+    /// One sample per second, the newest last
+    std::deque<FecStats> history_;
+    Clock::time_point lastSample_{};
+    int level_ = 0;
 };
@@ -0,0 +1,171 @@
+#include "frame_capture.h"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+} // namespace
+
+FrameCaptureWriter::~FrameCaptureWriter() {
+    close();
+}
+
+bool FrameCaptureWriter::open(const std::string &path) {
+    std::lock_guard lock(mutex_);
+
+    if (file_) {
+        fclose(file_);
+    }
+
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) {
+        return false;
+    }
+
+    // Frames arrive on the USB threads, keep the disk writes large.
+    setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+
+    FrameCaptureFileHeader header{};
+    std::memcpy(header.magic, FRAME_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = FRAME_CAPTURE_VERSION;
+    fwrite(&header, sizeof(header), 1, file_);
+
+    startUs_ = nowUs();
+    frameCount_ = 0;
+    open_ = true;
+
+    return true;
+}
+
+void FrameCaptureWriter::close() {
+    std::lock_guard lock(mutex_);
+
+    open_ = false;
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+void FrameCaptureWriter::write(const uint8_t *data,
+                               size_t size,
+                               uint8_t wlanIdx,
+                               const uint8_t rssi[2],
+                               const int8_t snr[2]) {
+    if (size > UINT16_MAX) {
+        return;
+    }
+
+    std::lock_guard lock(mutex_);
+
+    if (!file_) {
+        return;
+    }
+
+    FrameRecordHeader record{};
+    record.timestampUs = nowUs() - startUs_;
+    record.length = size;
+    record.wlanIdx = wlanIdx;
+    record.rssi[0] = rssi[0];
+    record.rssi[1] = rssi[1];
+    record.snr[0] = snr[0];
+    record.snr[1] = snr[1];
+
+    fwrite(&record, sizeof(record), 1, file_);
+    fwrite(data, 1, size, file_);
+
+    frameCount_++;
+}
+
+FrameCaptureReader::~FrameCaptureReader() {
+    close();
+}
+
+bool FrameCaptureReader::open(const std::string &path) {
+    close();
+
+    file_ = fopen(path.c_str(), "rb");
+    if (!file_) {
+        return false;
+    }
+
+    FrameCaptureFileHeader header{};
+    if (fread(&header, sizeof(header), 1, file_) != 1 ||
+        std::memcmp(header.magic, FRAME_CAPTURE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != FRAME_CAPTURE_VERSION) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void FrameCaptureReader::close() {
+    if (file_) {
+        fclose(file_);
+        file_ = nullptr;
+    }
+}
+
+bool FrameCaptureReader::next(CapturedFrame &frame) {
+    if (!file_) {
+        return false;
+    }
+
+    FrameRecordHeader record{};
+    if (fread(&record, sizeof(record), 1, file_) != 1) {
+        return false;
+    }
+
+    frame.timestampUs = record.timestampUs;
+    frame.wlanIdx = record.wlanIdx;
+    frame.rssi[0] = record.rssi[0];
+    frame.rssi[1] = record.rssi[1];
+    frame.snr[0] = record.snr[0];
+    frame.snr[1] = record.snr[1];
+    frame.data.resize(record.length);
+
+    return fread(frame.data.data(), 1, record.length, file_) == record.length;
+}
+
+void FrameCaptureReader::rewind() {
+    if (file_) {
+        fseek(file_, sizeof(FrameCaptureFileHeader), SEEK_SET);
+    }
+}
+
+uint64_t replayFrameCapture(FrameCaptureReader &reader,
+                            double speed,
+                            const std::function<void(const CapturedFrame &)> &callback,
+                            const std::atomic<bool> &shouldStop) {
+    CapturedFrame frame;
+    uint64_t count = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t firstTimestampUs = 0;
+
+    while (!shouldStop && reader.next(frame)) {
+        if (count == 0) {
+            firstTimestampUs = frame.timestampUs;
+        }
+
+        if (speed > 0) {
+            const auto offset = std::chrono::microseconds(
+                static_cast<int64_t>(static_cast<double>(frame.timestampUs - firstTimestampUs) / speed));
+            std::this_thread::sleep_until(start + offset);
+        }
+
+        callback(frame);
+        count++;
+    }
+
+    return count;
+}
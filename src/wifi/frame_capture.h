@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/// One received 802.11 frame, as handed over by the Wi-Fi driver.
+struct CapturedFrame {
+    /// Microseconds since the capture started
+    uint64_t timestampUs = 0;
+    /// Index of the adapter the frame came from, 0 being the main adapter
+    uint8_t wlanIdx = 0;
+    uint8_t rssi[2] = {};
+    int8_t snr[2] = {};
+    std::vector<uint8_t> data;
+};
+
+/// Capture files are a small file header followed by records of `FrameRecordHeader` + frame data.
+/// The headers are written as they are in memory, so fields are in host byte order.
+struct FrameCaptureFileHeader {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+};
+
+struct FrameRecordHeader {
+    uint64_t timestampUs;
+    uint16_t length;
+    uint8_t wlanIdx;
+    uint8_t rssi[2];
+    int8_t snr[2];
+    uint8_t reserved;
+};
+static_assert(sizeof(FrameCaptureFileHeader) == 8);
+static_assert(sizeof(FrameRecordHeader) == 16);
+
+constexpr char FRAME_CAPTURE_MAGIC[4] = {'A', 'V', 'F', 'C'};
+constexpr uint16_t FRAME_CAPTURE_VERSION = 1;
+constexpr auto FRAME_CAPTURE_EXTENSION = ".avfc";
+
+/// Records received frames to a capture file. Safe to call from several RX threads.
+class FrameCaptureWriter {
+public:
+    FrameCaptureWriter() = default;
+
+    ~FrameCaptureWriter();
+
+    FrameCaptureWriter(const FrameCaptureWriter &) = delete;
+    FrameCaptureWriter &operator=(const FrameCaptureWriter &) = delete;
+
+    bool open(const std::string &path);
+
+    void close();
+
+    bool isOpen() const {
+        return open_.load(std::memory_order_relaxed);
+    }
+
+    void write(const uint8_t *data, size_t size, uint8_t wlanIdx, const uint8_t rssi[2], const int8_t snr[2]);
+
+    uint64_t frameCount() const {
+        return frameCount_;
+    }
+
+private:
+    std::mutex mutex_;
+    FILE *file_ = nullptr;
+    /// Lets the RX threads skip the lock when not capturing.
+    std::atomic<bool> open_ = false;
+    uint64_t startUs_ = 0;
+    uint64_t frameCount_ = 0;
+};
+
+/// Reads frames back from a capture file.
+class FrameCaptureReader {
+public:
+    FrameCaptureReader() = default;
+
+    ~FrameCaptureReader();
+
+    FrameCaptureReader(const FrameCaptureReader &) = delete;
+    FrameCaptureReader &operator=(const FrameCaptureReader &) = delete;
+
+    bool open(const std::string &path);
+
+    void close();
+
+    /// Returns false at the end of the file or on a truncated record.
+    bool next(CapturedFrame &frame);
+
+    /// Go back to the first frame.
+    void rewind();
+
+private:
+    FILE *file_ = nullptr;
+};
+
+/// Feeds the frames of a capture file to a callback.
+/// @param speed 1 replays with the original timing, N replays N times faster, 0 replays as fast as possible.
+/// @param shouldStop Checked between frames.
+/// @return Number of frames replayed.
+uint64_t replayFrameCapture(FrameCaptureReader &reader,
+                            double speed,
+                            const std::function<void(const CapturedFrame &)> &callback,
+                            const std::atomic<bool> &shouldStop);
@@ -0,0 +1,110 @@
+#include "keyframe_requester.h"
+
+#include <algorithm>
+#include <random>
+
+namespace {
+
+/// Four random lowercase letters, packed into an integer.
+uint32_t generate_random_code() {
+    thread_local std::mt19937 gen(std::random_device{}());
+    std::uniform_int_distribution<> distrib(0, 25);
+
+    uint32_t code = 0;
+    for (int i = 0; i < 4; ++i) {
+        code |= static_cast<uint32_t>('a' + distrib(gen)) << (i * 8);
+    }
+    return code;
+}
+
+std::string unpack_code(uint32_t code) {
+    std::string result(4, ' ');
+    for (int i = 0; i < 4; ++i) {
+        result[i] = static_cast<char>((code >> (i * 8)) & 0xff);
+    }
+    return result;
+}
+
+} // namespace
+
+KeyframeRequester::KeyframeRequester() : code_('a' | 'a' << 8 | 'a' << 16 | 'a' << 24) {}
+
+void KeyframeRequester::setSender(Sender sender) {
+    std::lock_guard lock(mutex_);
+    sender_ = std::move(sender);
+    pending_ = false;
+}
+
+void KeyframeRequester::onLoss(uint32_t lostPackets) {
+    if (lostPackets == 0) {
+        return;
+    }
+
+    const auto now = Clock::now();
+
+    std::lock_guard lock(mutex_);
+    ++losses_;
+
+    if (!sender_) {
+        return;
+    }
+
+    if (pending_) {
+        ++coalesced_;
+        return;
+    }
+
+    if (requests_ > 0 && now - lastRequest_ < MIN_REQUEST_INTERVAL) {
+        // Too soon after the last request, send one more once the interval is over.
+        ++coalesced_;
+        pending_ = true;
+        pendingSince_ = now;
+        return;
+    }
+
+    pendingSince_ = now;
+    sendLocked(now);
+}
+
+void KeyframeRequester::poll() {
+    const auto now = Clock::now();
+
+    std::lock_guard lock(mutex_);
+    if (pending_ && sender_ && now - lastRequest_ >= MIN_REQUEST_INTERVAL) {
+        sendLocked(now);
+    }
+}
+
+void KeyframeRequester::sendLocked(Clock::time_point now) {
+    code_ = generate_random_code();
+    pending_ = false;
+    lastRequest_ = now;
+
+    // The new code also goes out with the next regular alink message, so a dropped request is only late.
+    sender_(unpack_code(code_));
+
+    const auto latency = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - pendingSince_).count());
+    ++requests_;
+    latencyLastUs_ = latency;
+    latencySumUs_ += latency;
+    latencyMaxUs_ = std::max(latencyMaxUs_, latency);
+}
+
+std::string KeyframeRequester::code() const {
+    std::lock_guard lock(mutex_);
+    return unpack_code(code_);
+}
+
+KeyframeRequester::Stats KeyframeRequester::stats() const {
+    std::lock_guard lock(mutex_);
+
+    Stats stats;
+    stats.losses = losses_;
+    stats.requests = requests_;
+    stats.coalesced = coalesced_;
+    stats.latencyLastUs = latencyLastUs_;
+    stats.latencyAvgUs = requests_ == 0 ? 0 : latencySumUs_ / requests_;
+    stats.latencyMaxUs = latencyMaxUs_;
+    return stats;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+
+/// Asks the drone for a keyframe as soon as the video aggregator notices lost packets, instead of waiting for the
+/// next adaptive-link tick. A request is a new 4-letter IDR code in an alink message, the drone sends one keyframe
+/// per code it hasn't seen before.
+///
+/// Requests are rate limited: the first loss after a quiet period is requested right away, losses that follow
+/// within MIN_REQUEST_INTERVAL are folded into one more request once the interval is over.
+class KeyframeRequester {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /// A keyframe takes a few video frames to arrive, asking again sooner only costs bitrate.
+    static constexpr std::chrono::milliseconds MIN_REQUEST_INTERVAL{100};
+
+    /// Sends an alink message carrying `idrCode`. Returns false if it couldn't be queued.
+    using Sender = std::function<bool(const std::string &idrCode)>;
+
+    struct Stats {
+        /// Loss events reported by the aggregator
+        uint64_t losses = 0;
+        /// Requests sent
+        uint64_t requests = 0;
+        /// Loss events that didn't trigger a request of their own because of the rate limit
+        uint64_t coalesced = 0;
+        /// Time from the first loss a request covers until the request was queued on the uplink
+        uint64_t latencyLastUs = 0;
+        uint64_t latencyAvgUs = 0;
+        uint64_t latencyMaxUs = 0;
+    };
+
+    KeyframeRequester();
+
+    /// Requests are only sent while a sender is set, e.g. while adaptive link runs. Pass null to stop.
+    void setSender(Sender sender);
+
+    /// Called by the aggregator for every gap in the packet sequence. Runs on an RX thread.
+    void onLoss(uint32_t lostPackets);
+
+    /// Send a request held back by the rate limit once its interval is over. Call periodically.
+    void poll();
+
+    /// The IDR code to put in regular alink messages, it only changes with a request.
+    std::string code() const;
+
+    Stats stats() const;
+
+private:
+    /// Roll a new code and hand it to the sender. Expects mutex_ to be held.
+    void sendLocked(Clock::time_point now);
+
+    mutable std::mutex mutex_;
+    Sender sender_;
+
+    /// Four lowercase letters packed into an integer
+    uint32_t code_;
+
+    Clock::time_point lastRequest_{};
+    /// A loss waits for the rate limit, with the time of the first one it covers
+    bool pending_ = false;
+    Clock::time_point pendingSince_{};
+
+    uint64_t losses_ = 0;
+    uint64_t requests_ = 0;
+    uint64_t coalesced_ = 0;
+    uint64_t latencyLastUs_ = 0;
+    uint64_t latencySumUs_ = 0;
+    uint64_t latencyMaxUs_ = 0;
+};
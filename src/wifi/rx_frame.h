@@ -1,6 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cstdint>
+#include <optional>
 #include <span>
 #include <vector>
 
@@ -71,12 +74,15 @@ public:
         return _data[10];
     }
 
-    bool MatchesChannelID(const uint8_t *channel_id) const {
+    /// The channel ID, (link_id << 8) | radio_port, carried in both the transmitter and the destination address.
+    /// Empty if the addresses don't have the wfb-ng layout.
+    std::optional<uint32_t> GetChannelID() const {
         //        0x57, 0x42, 0xaa, 0xbb, 0xcc, 0xdd,   // last four bytes are replaced by channel_id (x2)
-        return _data[10] == 0x57 && _data[11] == 0x42 && _data[12] == channel_id[0] && _data[13] == channel_id[1] &&
-               _data[14] == channel_id[2] && _data[15] == channel_id[3] && _data[16] == 0x57 && _data[17] == 0x42 &&
-               _data[18] == channel_id[0] && _data[19] == channel_id[1] && _data[20] == channel_id[2] &&
-               _data[21] == channel_id[3];
+        if (_data.size() < 22 || _data[10] != 0x57 || _data[11] != 0x42 ||
+            !std::equal(_data.begin() + 10, _data.begin() + 16, _data.begin() + 16)) {
+            return std::nullopt;
+        }
+        return uint32_t(_data[12]) << 24 | uint32_t(_data[13]) << 16 | uint32_t(_data[14]) << 8 | uint32_t(_data[15]);
     }
 
 private:
@@ -1,89 +1,191 @@
 #include <chrono>
-#include <random>
+#include <limits>
 
 #include "signal_quality.h"
 
 namespace {
 
-std::string generate_random_string(size_t length) {
-    const std::string characters = "abcdefghijklmnopqrstuvwxyz";
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> distrib(0, characters.size() - 1);
+template <class T>
+void atomic_min(std::atomic<T> &target, T value) {
+    T current = target.load(std::memory_order_relaxed);
+    while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
 
-    std::string result;
-    result.reserve(length);
-    for (size_t i = 0; i < length; ++i) {
-        result += characters[distrib(gen)];
+template <class T>
+void atomic_max(std::atomic<T> &target, T value) {
+    T current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
     }
-    return result;
 }
 
 } // namespace
 
-// Remove RSSI samples older than 1 second
-void SignalQualityCalculator::cleanup_old_rssi_data() {
-    auto now = std::chrono::steady_clock::now();
-    auto cutoff = now - kAveragingWindow;
+SignalQualityCalculator::SignalQualityCalculator() {
+    for (auto &bucket : m_buckets) {
+        bucket.tick = kTickUnused;
+        bucket.rssi.reset();
+        bucket.snr.reset();
+        bucket.fec_all = 0;
+        bucket.fec_recovered = 0;
+        bucket.fec_lost = 0;
+        bucket.fec_loss_events = 0;
+        bucket.fragments = 0;
+        bucket.fragments_lost = 0;
+        bucket.fragment_loss_events = 0;
+    }
+}
 
-    // Erase-remove idiom for data older than cutoff
-    m_rssis.erase(std::remove_if(m_rssis.begin(),
-                                 m_rssis.end(),
-                                 [&](const RssiEntry &entry) { return entry.timestamp < cutoff; }),
-                  m_rssis.end());
+void SignalQualityCalculator::SampleAccumulator::reset() {
+    count.store(0, std::memory_order_relaxed);
+    for (int i = 0; i < 2; i++) {
+        sum[i].store(0, std::memory_order_relaxed);
+        min[i].store(std::numeric_limits<int32_t>::max(), std::memory_order_relaxed);
+        max[i].store(std::numeric_limits<int32_t>::min(), std::memory_order_relaxed);
+    }
 }
 
-void SignalQualityCalculator::cleanup_old_snr_data() {
-    auto now = std::chrono::steady_clock::now();
-    auto cutoff = now - kAveragingWindow;
+void SignalQualityCalculator::SampleAccumulator::add(int ant1, int ant2) {
+    const int values[2] = {ant1, ant2};
+    for (int i = 0; i < 2; i++) {
+        sum[i].fetch_add(values[i], std::memory_order_relaxed);
+        atomic_min(min[i], values[i]);
+        atomic_max(max[i], values[i]);
+    }
+    count.fetch_add(1, std::memory_order_relaxed);
+}
 
-    // Erase-remove idiom for data older than cutoff
-    m_snrs.erase(
-        std::remove_if(m_snrs.begin(), m_snrs.end(), [&](const SnrEntry &entry) { return entry.timestamp < cutoff; }),
-        m_snrs.end());
+int64_t SignalQualityCalculator::current_tick() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+               .count() /
+           kBucketDuration.count();
 }
 
-void SignalQualityCalculator::cleanup_old_fec_data() {
-    auto now = std::chrono::steady_clock::now();
-    auto cutoff = now - kAveragingWindow;
+SignalQualityCalculator::Bucket *SignalQualityCalculator::current_bucket() {
+    const int64_t tick = current_tick();
+    Bucket &bucket = m_buckets[tick % kBucketCount];
+
+    int64_t seen = bucket.tick.load(std::memory_order_acquire);
+    if (seen == tick) {
+        return &bucket;
+    }
+
+    // The bucket still holds a slice from a second ago, the first writer of the new slice clears it.
+    if (seen == kTickRecycling || seen > tick ||
+        !bucket.tick.compare_exchange_strong(seen, kTickRecycling, std::memory_order_acq_rel)) {
+        return nullptr;
+    }
 
-    m_fec_data.erase(std::remove_if(m_fec_data.begin(),
-                                    m_fec_data.end(),
-                                    [&](const FecEntry &entry) { return entry.timestamp < cutoff; }),
-                     m_fec_data.end());
+    bucket.rssi.reset();
+    bucket.snr.reset();
+    bucket.fec_all.store(0, std::memory_order_relaxed);
+    bucket.fec_recovered.store(0, std::memory_order_relaxed);
+    bucket.fec_lost.store(0, std::memory_order_relaxed);
+    bucket.fec_loss_events.store(0, std::memory_order_relaxed);
+    bucket.fragments.store(0, std::memory_order_relaxed);
+    bucket.fragments_lost.store(0, std::memory_order_relaxed);
+    bucket.fragment_loss_events.store(0, std::memory_order_relaxed);
+
+    bucket.tick.store(tick, std::memory_order_release);
+
+    return &bucket;
 }
 
-void SignalQualityCalculator::add_rssi(uint8_t ant1, uint8_t ant2) {
-    std::lock_guard lock(m_mutex);
+bool SignalQualityCalculator::in_window(const Bucket &bucket, int64_t now_tick) {
+    const int64_t tick = bucket.tick.load(std::memory_order_acquire);
+    return tick >= 0 && tick <= now_tick && now_tick - tick < static_cast<int64_t>(kBucketCount);
+}
 
-    RssiEntry entry;
-    entry.timestamp = std::chrono::steady_clock::now();
-    entry.ant1 = ant1;
-    entry.ant2 = ant2;
-    m_rssis.push_back(entry);
+void SignalQualityCalculator::add_rssi(uint8_t ant1, uint8_t ant2) {
+    if (auto bucket = current_bucket()) {
+        bucket->rssi.add(ant1, ant2);
+    }
 }
 
 void SignalQualityCalculator::add_snr(int8_t ant1, int8_t ant2) {
-    std::lock_guard lock(m_mutex);
+    if (auto bucket = current_bucket()) {
+        bucket->snr.add(ant1, ant2);
+    }
+}
 
-    SnrEntry entry;
-    entry.timestamp = std::chrono::steady_clock::now();
-    entry.ant1 = ant1;
-    entry.ant2 = ant2;
-    m_snrs.push_back(entry);
+void SignalQualityCalculator::add_fec_data(uint32_t p_all, uint32_t p_recovered, uint32_t p_lost) {
+    if (auto bucket = current_bucket()) {
+        bucket->fec_all.fetch_add(p_all, std::memory_order_relaxed);
+        bucket->fec_recovered.fetch_add(p_recovered, std::memory_order_relaxed);
+        bucket->fec_lost.fetch_add(p_lost, std::memory_order_relaxed);
+    }
+}
+
+void SignalQualityCalculator::add_loss_event() {
+    if (auto bucket = current_bucket()) {
+        bucket->fec_loss_events.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SignalQualityCalculator::add_fragment_data(uint32_t f_received, uint32_t f_lost, uint32_t f_loss_events) {
+    if (auto bucket = current_bucket()) {
+        bucket->fragments.fetch_add(f_received, std::memory_order_relaxed);
+        bucket->fragments_lost.fetch_add(f_lost, std::memory_order_relaxed);
+        bucket->fragment_loss_events.fetch_add(f_loss_events, std::memory_order_relaxed);
+    }
+}
+
+std::array<SignalQualityCalculator::AntennaStats, 2> SignalQualityCalculator::fold(
+    SampleAccumulator Bucket::*accumulator) const {
+    const int64_t now_tick = current_tick();
+
+    uint32_t count = 0;
+    int64_t sum[2] = {};
+    int32_t min[2] = {std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max()};
+    int32_t max[2] = {std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::min()};
+
+    for (const auto &bucket : m_buckets) {
+        if (!in_window(bucket, now_tick)) {
+            continue;
+        }
+
+        const SampleAccumulator &samples = bucket.*accumulator;
+        const uint32_t bucket_count = samples.count.load(std::memory_order_relaxed);
+        if (bucket_count == 0) {
+            continue;
+        }
+
+        count += bucket_count;
+        for (int i = 0; i < 2; i++) {
+            sum[i] += samples.sum[i].load(std::memory_order_relaxed);
+            min[i] = std::min(min[i], samples.min[i].load(std::memory_order_relaxed));
+            max[i] = std::max(max[i], samples.max[i].load(std::memory_order_relaxed));
+        }
+    }
+
+    std::array<AntennaStats, 2> stats{};
+    if (count > 0) {
+        for (int i = 0; i < 2; i++) {
+            stats[i].count = count;
+            stats[i].avg = static_cast<float>(sum[i]) / count;
+            stats[i].min = min[i];
+            stats[i].max = max[i];
+        }
+    }
+    return stats;
+}
+
+std::array<SignalQualityCalculator::AntennaStats, 2> SignalQualityCalculator::get_rssi_stats() const {
+    return fold(&Bucket::rssi);
+}
+
+std::array<SignalQualityCalculator::AntennaStats, 2> SignalQualityCalculator::get_snr_stats() const {
+    return fold(&Bucket::snr);
 }
 
 SignalQualityCalculator::SignalQuality SignalQualityCalculator::calculate_signal_quality() {
     SignalQuality ret;
-    std::lock_guard lock(m_mutex);
 
-    // Make sure we clean up old data first
-    cleanup_old_rssi_data();
-    cleanup_old_snr_data();
-    cleanup_old_fec_data();
-
-    float avg_rssi = get_avg(m_rssis);
-    float avg_snr = get_avg(m_snrs);
+    // We'll take the maximum of the two average values
+    auto rssi = get_rssi_stats();
+    auto snr = get_snr_stats();
+    float avg_rssi = std::max(rssi[0].avg, rssi[1].avg);
+    float avg_snr = std::max(snr[0].avg, snr[1].avg);
 
     // Map the RSSI from range 10..80 to -1024..1024
     avg_rssi = map_range(avg_rssi, 0.f, 80.f, -1024.f, 1024.f);
@@ -92,7 +194,7 @@ SignalQualityCalculator::SignalQuality SignalQualityCalculator::calculate_signal
     // Return final clamped quality
     // formula: quality = avg_rssi - p_recovered * 5 - p_lost * 100
     // clamp between -1024 and 1024
-    auto [p_recovered, p_lost, p_total] = get_accumulated_fec_data();
+    auto [p_recovered, p_lost, p_total, p_loss_events] = get_accumulated_fec_data();
 
     float quality = avg_rssi; // - static_cast<float>(p_recovered) * 12.f - static_cast<float>(p_lost) * 40.f;
     quality = std::max(-1024.f, std::min(1024.f, quality));
@@ -100,39 +202,53 @@ SignalQualityCalculator::SignalQuality SignalQualityCalculator::calculate_signal
     ret.lost_last_second = p_lost;
     ret.recovered_last_second = p_recovered;
     ret.total_last_second = p_total;
+    ret.loss_events_last_second = p_loss_events;
+
+    auto [f_received, f_lost, f_loss_events] = get_accumulated_fragment_data();
+    ret.fragments_last_second = f_received;
+    ret.fragments_lost_last_second = f_lost;
+    ret.fragment_loss_events_last_second = f_loss_events;
 
     ret.quality = quality;
     ret.snr = avg_snr;
-    ret.idr_code = m_idr_code;
 
     return ret;
 }
 
-std::tuple<uint32_t, uint32_t, uint32_t> SignalQualityCalculator::get_accumulated_fec_data() const {
-    uint32_t p_recovered = 0;
-    uint32_t p_all = 0;
-    uint32_t p_lost = 0;
-    for (const auto &data : m_fec_data) {
-        p_all += data.all;
-        p_recovered += data.recovered;
-        p_lost += data.lost;
+std::tuple<uint32_t, uint32_t, uint32_t, uint32_t> SignalQualityCalculator::get_accumulated_fec_data() const {
+    const int64_t now_tick = current_tick();
+
+    uint64_t p_recovered = 0;
+    uint64_t p_all = 0;
+    uint64_t p_lost = 0;
+    uint64_t p_loss_events = 0;
+    for (const auto &bucket : m_buckets) {
+        if (!in_window(bucket, now_tick)) {
+            continue;
+        }
+        p_all += bucket.fec_all.load(std::memory_order_relaxed);
+        p_recovered += bucket.fec_recovered.load(std::memory_order_relaxed);
+        p_lost += bucket.fec_lost.load(std::memory_order_relaxed);
+        p_loss_events += bucket.fec_loss_events.load(std::memory_order_relaxed);
     }
 
-    return {p_recovered, p_lost, p_all};
+    return {p_recovered, p_lost, p_all, p_loss_events};
 }
 
-void SignalQualityCalculator::add_fec_data(uint32_t p_all, uint32_t p_recovered, uint32_t p_lost) {
-    std::lock_guard lock(m_mutex);
-
-    FecEntry entry;
-    entry.timestamp = std::chrono::steady_clock::now();
-    entry.all = p_all;
-    entry.recovered = p_recovered;
-    entry.lost = p_lost;
-
-    if (p_lost > 0) {
-        m_idr_code = generate_random_string(4);
+std::tuple<uint32_t, uint32_t, uint32_t> SignalQualityCalculator::get_accumulated_fragment_data() const {
+    const int64_t now_tick = current_tick();
+
+    uint64_t f_received = 0;
+    uint64_t f_lost = 0;
+    uint64_t f_loss_events = 0;
+    for (const auto &bucket : m_buckets) {
+        if (!in_window(bucket, now_tick)) {
+            continue;
+        }
+        f_received += bucket.fragments.load(std::memory_order_relaxed);
+        f_lost += bucket.fragments_lost.load(std::memory_order_relaxed);
+        f_loss_events += bucket.fragment_loss_events.load(std::memory_order_relaxed);
     }
 
-    m_fec_data.push_back(entry);
+    return {f_received, f_lost, f_loss_events};
 }
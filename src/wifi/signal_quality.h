@@ -1,63 +1,68 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
-#include <mutex>
+#include <string>
+#include <tuple>
 #include <utility>
-#include <vector>
 
 inline double map_range(double value, double inputMin, double inputMax, double outputMin, double outputMax) {
     return outputMin + ((value - inputMin) * (outputMax - outputMin) / (inputMax - inputMin));
 }
 
+/// Link statistics over the last second.
+/// Writers (the RX threads) only touch relaxed atomics in fixed time buckets, so adding a sample
+/// never locks or allocates. Readers fold the buckets in O(bucket count).
 class SignalQualityCalculator {
 public:
     struct SignalQuality {
         int lost_last_second;
         int recovered_last_second;
         int total_last_second;
+        /// Runs of consecutive lost packets, so lost_last_second / loss_events_last_second is the mean burst length
+        int loss_events_last_second;
+        /// Unique fragments received, and the ones that never arrived, before FEC
+        int fragments_last_second;
+        int fragments_lost_last_second;
+        /// Runs of consecutive fragments that never arrived
+        int fragment_loss_events_last_second;
         int quality;
         float snr;
-        std::string idr_code;
     };
 
-    SignalQualityCalculator() = default;
+    /// Per-antenna summary of the samples in the window.
+    struct AntennaStats {
+        uint32_t count = 0;
+        float avg = 0;
+        int min = 0;
+        int max = 0;
+    };
+
+    SignalQualityCalculator();
     ~SignalQualityCalculator() = default;
 
-    /// Add a new RSSI entry with current timestamp
+    /// Add a new RSSI sample to the current bucket
     void add_rssi(uint8_t ant1, uint8_t ant2);
 
     void add_snr(int8_t ant1, int8_t ant2);
 
-    /// Add new FEC data entry with current timestamp
+    /// Add new FEC data to the current bucket
     void add_fec_data(uint32_t p_all, uint32_t p_recovered, uint32_t p_lost);
 
-    /// Get fresh averages over the last second
-    template <class T>
-    float get_avg(const T &array) {
-        std::lock_guard lock(m_mutex);
-
-        // Remove old entries
-        cleanup_old_rssi_data();
-
-        float sum1 = 0.f;
-        float sum2 = 0.f;
-        int count = static_cast<int>(array.size());
-
-        if (count > 0) {
-            for (auto &entry : array) {
-                sum1 += entry.ant1;
-                sum2 += entry.ant2;
-            }
-            sum1 /= count;
-            sum2 /= count;
-        }
-
-        // We'll take the maximum of the two average RSSI values
-        float avg = std::max(sum1, sum2);
-        return avg;
-    }
+    /// Count a gap in the video packet sequence in the current bucket
+    void add_loss_event();
+
+    /// Add fragments received and lost before FEC to the current bucket
+    void add_fragment_data(uint32_t f_received, uint32_t f_lost, uint32_t f_loss_events);
+
+    /// RSSI of both antennas over the last second
+    std::array<AntennaStats, 2> get_rssi_stats() const;
+
+    /// SNR of both antennas over the last second
+    std::array<AntennaStats, 2> get_snr_stats() const;
 
     /// Calculate signal quality based on last-second RSSI and FEC data
     SignalQuality calculate_signal_quality();
@@ -68,45 +73,56 @@ public:
     }
 
 private:
-    /// Sum up FEC data over the last 1 second
-    std::tuple<uint32_t, uint32_t, uint32_t> get_accumulated_fec_data() const;
-
-    // Helper methods to remove old entries
-    void cleanup_old_rssi_data();
-    void cleanup_old_snr_data();
-    void cleanup_old_fec_data();
-
-    // We store a timestamp for each RSSI entry
-    struct RssiEntry {
-        std::chrono::steady_clock::time_point timestamp;
-        uint8_t ant1;
-        uint8_t ant2;
-    };
+    static constexpr size_t kBucketCount = 10;
+    static constexpr std::chrono::milliseconds kBucketDuration{100};
+    static constexpr int64_t kTickUnused = -1;
+    static constexpr int64_t kTickRecycling = -2;
+
+    struct SampleAccumulator {
+        std::atomic<uint32_t> count;
+        std::atomic<int64_t> sum[2];
+        std::atomic<int32_t> min[2];
+        std::atomic<int32_t> max[2];
 
-    // We store a timestamp for each RSSI entry
-    struct SnrEntry {
-        std::chrono::steady_clock::time_point timestamp;
-        int8_t ant1;
-        int8_t ant2;
+        void reset();
+
+        void add(int ant1, int ant2);
     };
 
-    // We store a timestamp for each FEC entry
-    struct FecEntry {
-        std::chrono::steady_clock::time_point timestamp;
-        uint32_t all;
-        uint32_t recovered;
-        uint32_t lost;
+    /// Samples of one 100 ms slice. A bucket is reused once its tick falls out of the window.
+    struct alignas(64) Bucket {
+        /// The time slice this bucket holds, kTickUnused or kTickRecycling
+        std::atomic<int64_t> tick;
+
+        SampleAccumulator rssi;
+        SampleAccumulator snr;
+
+        std::atomic<uint64_t> fec_all;
+        std::atomic<uint64_t> fec_recovered;
+        std::atomic<uint64_t> fec_lost;
+        std::atomic<uint64_t> fec_loss_events;
+
+        std::atomic<uint64_t> fragments;
+        std::atomic<uint64_t> fragments_lost;
+        std::atomic<uint64_t> fragment_loss_events;
     };
 
-private:
-    const std::chrono::seconds kAveragingWindow{std::chrono::seconds(1)};
-    mutable std::recursive_mutex m_mutex;
+    static int64_t current_tick();
+
+    /// Get the bucket of the current time slice, recycling it if it holds an old one.
+    /// Returns null in the rare case another writer is recycling it right now, the sample is then dropped.
+    Bucket *current_bucket();
 
-    std::vector<RssiEntry> m_rssis;
+    /// Whether a bucket belongs to the window ending at `now_tick`.
+    static bool in_window(const Bucket &bucket, int64_t now_tick);
 
-    std::vector<SnrEntry> m_snrs;
+    std::array<AntennaStats, 2> fold(SampleAccumulator Bucket::*accumulator) const;
+
+    /// Sum up FEC data over the last 1 second
+    std::tuple<uint32_t, uint32_t, uint32_t, uint32_t> get_accumulated_fec_data() const;
 
-    std::vector<FecEntry> m_fec_data;
+    /// Sum up the fragments received, lost and loss events over the last 1 second
+    std::tuple<uint32_t, uint32_t, uint32_t> get_accumulated_fragment_data() const;
 
-    std::string m_idr_code{"aaaa"};
+    std::array<Bucket, kBucketCount> m_buckets;
 };
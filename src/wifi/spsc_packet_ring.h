@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+/// Lock-free single-producer/single-consumer ring of variable-length packets.
+/// Every packet occupies one fixed-size slot, so neither side ever allocates.
+/// The producer never blocks: when the ring is full the packet is dropped and counted.
+class SpscPacketRing {
+public:
+    /// @param slotCount Number of slots, rounded up to a power of two.
+    /// @param slotSize Max size in bytes of a single packet.
+    SpscPacketRing(size_t slotCount, size_t slotSize) : slotSize_(slotSize) {
+        size_t count = 1;
+        while (count < slotCount) {
+            count <<= 1;
+        }
+        mask_ = count - 1;
+        storage_ = std::make_unique<uint8_t[]>(count * slotSize_);
+        lengths_ = std::make_unique<uint32_t[]>(count);
+    }
+
+    SpscPacketRing(const SpscPacketRing &) = delete;
+    SpscPacketRing &operator=(const SpscPacketRing &) = delete;
+
+    /// Producer side. Returns false if the packet was dropped (ring full or packet too large).
+    bool push(const uint8_t *data, size_t size) {
+        return push(nullptr, 0, data, size);
+    }
+
+    /// Producer side. Stores `prefix` followed by `data` as one packet, so the caller needn't join them first.
+    bool push(const void *prefix, size_t prefixSize, const uint8_t *data, size_t size) {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        const uint64_t depth = head - tail_.load(std::memory_order_acquire);
+        if (prefixSize + size > slotSize_ || depth > mask_) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        const size_t slot = head & mask_;
+        uint8_t *dst = storage_.get() + slot * slotSize_;
+        if (prefixSize > 0) {
+            std::memcpy(dst, prefix, prefixSize);
+        }
+        std::memcpy(dst + prefixSize, data, size);
+        lengths_[slot] = static_cast<uint32_t>(prefixSize + size);
+        head_.store(head + 1, std::memory_order_seq_cst);
+        pushed_.fetch_add(1, std::memory_order_relaxed);
+
+        // Only the producer writes the high-water mark.
+        if (depth + 1 > highWater_.load(std::memory_order_relaxed)) {
+            highWater_.store(depth + 1, std::memory_order_relaxed);
+        }
+
+        // Only pay for the wake-up when the consumer is actually parked.
+        if (consumerWaiting_.load(std::memory_order_seq_cst)) {
+            std::lock_guard lock(waitMutex_);
+            waitCv_.notify_one();
+        }
+        return true;
+    }
+
+    /// Consumer side. Copies one packet into `out` and returns its size, or 0 if the ring is empty.
+    /// Packets larger than `capacity` are truncated.
+    size_t pop(uint8_t *out, size_t capacity) {
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return 0;
+        }
+
+        const size_t slot = tail & mask_;
+        const size_t size = std::min<size_t>(lengths_[slot], capacity);
+        std::memcpy(out, storage_.get() + slot * slotSize_, size);
+        tail_.store(tail + 1, std::memory_order_release);
+        return size;
+    }
+
+    /// Consumer side. Like pop(), but waits up to `timeout` for a packet to arrive.
+    size_t popWait(uint8_t *out, size_t capacity, std::chrono::milliseconds timeout) {
+        if (const size_t size = pop(out, capacity)) {
+            return size;
+        }
+
+        {
+            std::unique_lock lock(waitMutex_);
+            consumerWaiting_.store(true, std::memory_order_seq_cst);
+            waitCv_.wait_for(lock, timeout, [this] { return !empty(); });
+            consumerWaiting_.store(false, std::memory_order_relaxed);
+        }
+
+        return pop(out, capacity);
+    }
+
+    /// Consumer side. Drops everything currently queued, e.g. stale packets from before the consumer started.
+    void discard() {
+        tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    bool empty() const {
+        return tail_.load(std::memory_order_acquire) == head_.load(std::memory_order_acquire);
+    }
+
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return mask_ + 1;
+    }
+
+    size_t slotSize() const {
+        return slotSize_;
+    }
+
+    uint64_t pushedCount() const {
+        return pushed_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t droppedCount() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    /// Max number of packets that were queued at once.
+    uint64_t highWaterMark() const {
+        return highWater_.load(std::memory_order_relaxed);
+    }
+
+private:
+    size_t slotSize_;
+    size_t mask_;
+    std::unique_ptr<uint8_t[]> storage_;
+    std::unique_ptr<uint32_t[]> lengths_;
+
+    // Keep the producer and consumer indices on separate cache lines.
+    alignas(64) std::atomic<uint64_t> head_{0};
+    alignas(64) std::atomic<uint64_t> tail_{0};
+
+    alignas(64) std::atomic<uint64_t> pushed_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> highWater_{0};
+
+    std::atomic<bool> consumerWaiting_{false};
+    std::mutex waitMutex_;
+    std::condition_variable waitCv_;
+};
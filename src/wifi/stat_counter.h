@@ -0,0 +1,22 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/// A statistics counter on its own cache line.
+/// The RX threads bump it with a relaxed add, readers only ever need an approximate snapshot.
+struct alignas(64) StatCounter {
+    std::atomic<int64_t> value{0};
+
+    void add(int64_t n = 1) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    int64_t load() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+    void reset() {
+        value.store(0, std::memory_order_relaxed);
+    }
+};
@@ -9,6 +9,25 @@
     #include <cinttypes>
     #include <cstring>
 
+namespace {
+
+/// Fill in the 802.11 header of a wfb-ng frame and advance the sequence number.
+void writeIeeeHeader(uint8_t *ieeeHdr, uint8_t frameType, uint32_t channelId, uint16_t &sequence) {
+    std::memcpy(ieeeHdr, ieee80211_header, sizeof(ieee80211_header));
+
+    // Patch the Frame Control field, channel ID, and seq number
+    ieeeHdr[0] = frameType;
+    uint32_t channelIdBE = htonl(channelId);
+    std::memcpy(ieeeHdr + SRC_MAC_THIRD_BYTE, &channelIdBE, sizeof(uint32_t));
+    std::memcpy(ieeeHdr + DST_MAC_THIRD_BYTE, &channelIdBE, sizeof(uint32_t));
+
+    ieeeHdr[FRAME_SEQ_LB] = static_cast<uint8_t>(sequence & 0xff);
+    ieeeHdr[FRAME_SEQ_HB] = static_cast<uint8_t>((sequence >> 8) & 0xff);
+    sequence += 16;
+}
+
+} // namespace
+
 //-------------------------------------------------------------
 // Transmitter
 //-------------------------------------------------------------
@@ -23,12 +42,17 @@ Transmitter::Transmitter(int k, int n, const std::string &keypair, uint64_t epoc
     }
     fecPtr_.reset(rawFec);
 
-    // Allocate block buffers
+    // Allocate block buffers, the parity ones are accumulators and have to start zeroed
     for (int i = 0; i < fecN_; ++i) {
         block_[i] = std::unique_ptr<uint8_t[]>(new uint8_t[MAX_FEC_PAYLOAD]);
         std::memset(block_[i].get(), 0, MAX_FEC_PAYLOAD);
     }
 
+    for (int i = 0; i < fecN_ - fecK_ + 1; ++i) {
+        batchBuffers_.emplace_back(new uint8_t[MAX_FORWARDER_PACKET_SIZE]);
+    }
+    batch_.reserve(batchBuffers_.size());
+
     // Read keypair from a file
     FILE *fp = std::fopen(keypair.c_str(), "rb");
     if (!fp) {
@@ -71,37 +95,44 @@ bool Transmitter::sendPacket(const uint8_t *buf, size_t size, uint8_t flags) {
 
     size_t wpacketHdrSize = sizeof(wpacket_hdr_t);
 
-    // Copy payload
-    std::memcpy(block_[fragmentIndex_].get() + wpacketHdrSize, buf, size);
-
-    // Zero out the remainder
-    if ((wpacketHdrSize + size) < MAX_FEC_PAYLOAD) {
-        std::memset(block_[fragmentIndex_].get() + wpacketHdrSize + size, 0, MAX_FEC_PAYLOAD - (wpacketHdrSize + size));
+    // Copy payload. No zero padding needed, the parity only reads the fragment's own bytes.
+    if (size > 0) {
+        std::memcpy(block_[fragmentIndex_].get() + wpacketHdrSize, buf, size);
     }
 
-    // Send this fragment
-    sendBlockFragment(wpacketHdrSize + size);
+    // Fold it into the parity right away, so closing the block only has to send the parity
+    fec_encode_add(fecPtr_.get(),
+                   block_[fragmentIndex_].get(),
+                   fragmentIndex_,
+                   reinterpret_cast<uint8_t **>(block_.data()) + fecK_,
+                   wpacketHdrSize + size);
 
     // Track the largest data size in block
     maxPacketSize_ = std::max(maxPacketSize_, wpacketHdrSize + size);
-    fragmentIndex_++;
 
-    // If not enough fragments for FEC, we are done
-    if (fragmentIndex_ < static_cast<uint8_t>(fecK_)) {
+    // If not enough fragments for FEC, send this one on its own and we are done
+    if (fragmentIndex_ + 1 < fecK_) {
+        sendBlockFragment(wpacketHdrSize + size);
+        fragmentIndex_++;
         return true;
     }
 
-    // If we have k fragments, encode the parity
-    fec_encode(fecPtr_.get(),
-               const_cast<const uint8_t **>(reinterpret_cast<uint8_t **>(block_.data())),
-               reinterpret_cast<uint8_t **>(block_.data()) + fecK_,
-               maxPacketSize_);
-
-    // Send all FEC fragments
+    // This fragment closes the block, send it together with all FEC fragments.
+    // Parity is sized to the largest primary, shorter ones count as zero-padded.
+    batch_.clear();
+    size_t packetSize = wpacketHdrSize + size;
     while (fragmentIndex_ < static_cast<uint8_t>(fecN_)) {
-        sendBlockFragment(maxPacketSize_);
+        uint8_t *out = batchBuffers_[batch_.size()].get();
+        batch_.emplace_back(out, encryptBlockFragment(packetSize, out));
+
+        if (fragmentIndex_ >= fecK_) {
+            // Clear the accumulator for the next block
+            std::memset(block_[fragmentIndex_].get(), 0, maxPacketSize_);
+        }
         fragmentIndex_++;
+        packetSize = maxPacketSize_;
     }
+    injectBatch(batch_);
 
     // Move to the next block
     blockIndex_++;
@@ -121,19 +152,27 @@ void Transmitter::sendSessionKey() {
     injectPacket(sessionKeyPacket_, sizeof(sessionKeyPacket_));
 }
 
+void Transmitter::injectBatch(std::span<const std::span<const uint8_t>> packets) {
+    for (const auto &packet : packets) {
+        injectPacket(packet.data(), packet.size());
+    }
+}
+
 void Transmitter::sendBlockFragment(size_t packetSize) {
     // Prepare local buffer for encryption
     uint8_t cipherBuf[MAX_FORWARDER_PACKET_SIZE];
-    std::memset(cipherBuf, 0, sizeof(cipherBuf));
+    injectPacket(cipherBuf, encryptBlockFragment(packetSize, cipherBuf));
+}
 
-    auto *blockHdr = reinterpret_cast<wblock_hdr_t *>(cipherBuf);
+size_t Transmitter::encryptBlockFragment(size_t packetSize, uint8_t *out) {
+    auto *blockHdr = reinterpret_cast<wblock_hdr_t *>(out);
     blockHdr->packet_type = WFB_PACKET_DATA;
     blockHdr->data_nonce = htobe64(((blockIndex_ & BLOCK_IDX_MASK) << 8) + fragmentIndex_);
 
     unsigned long long cipherLen = 0;
 
     // AEAD encrypt
-    int rc = crypto_aead_chacha20poly1305_encrypt(cipherBuf + sizeof(wblock_hdr_t),
+    int rc = crypto_aead_chacha20poly1305_encrypt(out + sizeof(wblock_hdr_t),
                                                   &cipherLen,
                                                   block_[fragmentIndex_].get(),
                                                   packetSize,
@@ -146,8 +185,7 @@ void Transmitter::sendBlockFragment(size_t packetSize) {
         throw std::runtime_error("Unable to encrypt packet!");
     }
 
-    size_t finalSize = sizeof(wblock_hdr_t) + cipherLen;
-    injectPacket(cipherBuf, finalSize);
+    return sizeof(wblock_hdr_t) + cipherLen;
 }
 
 void Transmitter::makeSessionKey() {
@@ -245,17 +283,7 @@ void RawSocketTransmitter::injectPacket(const uint8_t *buf, size_t size) {
 
     // Build 802.11 header
     uint8_t ieeeHdr[sizeof(ieee80211_header)];
-    std::memcpy(ieeeHdr, ieee80211_header, sizeof(ieee80211_header));
-
-    // Patch the Frame Control field, channel ID, and seq number
-    ieeeHdr[0] = frameType_;
-    uint32_t channelIdBE = htonl(channelId_);
-    std::memcpy(ieeeHdr + SRC_MAC_THIRD_BYTE, &channelIdBE, sizeof(uint32_t));
-    std::memcpy(ieeeHdr + DST_MAC_THIRD_BYTE, &channelIdBE, sizeof(uint32_t));
-
-    ieeeHdr[FRAME_SEQ_LB] = static_cast<uint8_t>(ieee80211Sequence_ & 0xff);
-    ieeeHdr[FRAME_SEQ_HB] = static_cast<uint8_t>((ieee80211Sequence_ >> 8) & 0xff);
-    ieee80211Sequence_ += 16;
+    writeIeeeHeader(ieeeHdr, frameType_, channelId_, ieee80211Sequence_);
 
     // iovec for sendmsg
     struct iovec iov[3];
@@ -301,6 +329,73 @@ void RawSocketTransmitter::injectPacket(const uint8_t *buf, size_t size) {
     }
 }
 
+void RawSocketTransmitter::injectBatch(std::span<const std::span<const uint8_t>> packets) {
+    const size_t count = packets.size();
+    batchIeeeHdrs_.resize(count);
+    batchIovs_.resize(count);
+    batchMsgs_.resize(count);
+
+    for (size_t i = 0; i < count; i++) {
+        if (packets[i].size() > MAX_FORWARDER_PACKET_SIZE) {
+            throw std::runtime_error("RawSocketTransmitter::injectBatch - packet too large");
+        }
+
+        // Every frame gets its own sequence number, mirrored copies share it like in injectPacket()
+        writeIeeeHeader(batchIeeeHdrs_[i].data(), frameType_, channelId_, ieee80211Sequence_);
+
+        auto &iov = batchIovs_[i];
+        iov[0].iov_base = radiotapHeader_.get();
+        iov[0].iov_len = radiotapHeaderLen_;
+        iov[1].iov_base = batchIeeeHdrs_[i].data();
+        iov[1].iov_len = batchIeeeHdrs_[i].size();
+        iov[2].iov_base = const_cast<uint8_t *>(packets[i].data());
+        iov[2].iov_len = packets[i].size();
+
+        std::memset(&batchMsgs_[i], 0, sizeof(mmsghdr));
+        batchMsgs_[i].msg_hdr.msg_iov = iov.data();
+        batchMsgs_[i].msg_hdr.msg_iovlen = iov.size();
+    }
+
+    if (currentOutput_ >= 0) {
+        // Single-interface mode
+        sendBatch(currentOutput_, packets);
+    } else {
+        // Mirror mode: send on all interfaces
+        for (size_t i = 0; i < sockFds_.size(); i++) {
+            sendBatch(static_cast<int>(i), packets);
+        }
+    }
+}
+
+void RawSocketTransmitter::sendBatch(int output, std::span<const std::span<const uint8_t>> packets) {
+    const unsigned count = static_cast<unsigned>(packets.size());
+    unsigned sent = 0;
+    uint32_t dropped = 0;
+    uint32_t injectedBytes = 0;
+
+    uint64_t startUs = get_time_us();
+    while (sent < count) {
+        int rc = ::sendmmsg(sockFds_[output], batchMsgs_.data() + sent, count - sent, 0);
+        if (rc < 0) {
+            if (errno != ENOBUFS) {
+                throw std::runtime_error(string_format("Unable to inject packet: %s", std::strerror(errno)));
+            }
+            // The interface queue is full, skip the packet that didn't fit and carry on with the rest
+            ++dropped;
+            ++sent;
+            continue;
+        }
+
+        for (int i = 0; i < rc; i++) {
+            injectedBytes += static_cast<uint32_t>(packets[sent + i].size());
+        }
+        sent += static_cast<unsigned>(rc);
+    }
+
+    uint64_t key = (static_cast<uint64_t>(output) << 8) | 0xff;
+    antennaStat_[key].logBatch(get_time_us() - startUs, count - dropped, dropped, injectedBytes);
+}
+
 void RawSocketTransmitter::dumpStats(FILE *fp,
                                      uint64_t ts,
                                      uint32_t &injectedPackets,
@@ -308,18 +403,23 @@ void RawSocketTransmitter::dumpStats(FILE *fp,
                                      uint32_t &injectedBytes) {
     for (auto &kv : antennaStat_) {
         const auto &stats = kv.second;
-        uint64_t countAll = stats.countPacketsInjected + stats.countPacketsDropped;
-        uint64_t avgLatency = (countAll == 0) ? 0 : (stats.latencySum / countAll);
+        uint64_t avgLatency = (stats.countLatencySamples == 0) ? 0 : (stats.latencySum / stats.countLatencySamples);
+        uint64_t avgBatchLatency = (stats.countBatches == 0) ? 0 : (stats.batchLatencySum / stats.countBatches);
 
         // fprintf(fp,
-        //         "%" PRIu64 "\tTX_ANT\t%" PRIx64 "\t%u:%u:%" PRIu64 ":%" PRIu64 ":%" PRIu64 "\n",
+        //         "%" PRIu64 "\tTX_ANT\t%" PRIx64 "\t%u:%u:%" PRIu64 ":%" PRIu64 ":%" PRIu64 ":%u:%" PRIu64 ":%" PRIu64
+        //         ":%" PRIu64 "\n",
         //         ts,
         //         kv.first,
         //         stats.countPacketsInjected,
         //         stats.countPacketsDropped,
         //         stats.latencyMin,
         //         avgLatency,
-        //         stats.latencyMax);
+        //         stats.latencyMax,
+        //         stats.countBatches,
+        //         stats.batchLatencyMin,
+        //         avgBatchLatency,
+        //         stats.batchLatencyMax);
 
         injectedPackets += stats.countPacketsInjected;
         droppedPackets += stats.countPacketsDropped;
@@ -403,7 +503,8 @@ UsbTransmitter::UsbTransmitter(int k,
                                Rtl8812aDevice *device)
     : Transmitter(k, n, keypair, epoch, channelId), channelId_(channelId), currentOutput_(0), ieee80211Sequence_(0),
       radiotapHeader_(radiotapHeader), radiotapHeaderLen_(radiotapHeaderLen), frameType_(frameType),
-      rtlDevice_(device) {}
+      rtlDevice_(device),
+      txBuffer_(new uint8_t[radiotapHeaderLen + sizeof(ieee80211_header) + MAX_FORWARDER_PACKET_SIZE]) {}
 
 void UsbTransmitter::selectOutput(int idx) {
     currentOutput_ = idx;
@@ -416,18 +517,23 @@ void UsbTransmitter::dumpStats(FILE *fp,
                                uint32_t &injectedBytes) {
     for (auto &kv : antennaStat_) {
         const auto &stats = kv.second;
-        uint64_t countAll = stats.countPacketsInjected + stats.countPacketsDropped;
-        uint64_t avgLatency = (countAll == 0) ? 0 : (stats.latencySum / countAll);
+        uint64_t avgLatency = (stats.countLatencySamples == 0) ? 0 : (stats.latencySum / stats.countLatencySamples);
+        uint64_t avgBatchLatency = (stats.countBatches == 0) ? 0 : (stats.batchLatencySum / stats.countBatches);
 
         // fprintf(fp,
-        //         "%" PRIu64 "\tTX_ANT\t%" PRIx64 "\t%u:%u:%" PRIu64 ":%" PRIu64 ":%" PRIu64 "\n",
+        //         "%" PRIu64 "\tTX_ANT\t%" PRIx64 "\t%u:%u:%" PRIu64 ":%" PRIu64 ":%" PRIu64 ":%u:%" PRIu64 ":%" PRIu64
+        //         ":%" PRIu64 "\n",
         //         ts,
         //         kv.first,
         //         stats.countPacketsInjected,
         //         stats.countPacketsDropped,
         //         stats.latencyMin,
         //         avgLatency,
-        //         stats.latencyMax);
+        //         stats.latencyMax,
+        //         stats.countBatches,
+        //         stats.batchLatencyMin,
+        //         avgBatchLatency,
+        //         stats.batchLatencyMax);
 
         injectedPackets += stats.countPacketsInjected;
         droppedPackets += stats.countPacketsDropped;
@@ -442,40 +548,29 @@ void UsbTransmitter::injectPacket(const uint8_t *buf, const size_t size) {
         throw std::runtime_error("UsbTransmitter: main thread exit, should stop");
     }
 
+    uint64_t startUs = get_time_us();
+    bool result = sendFrame(buf, size);
+
+    uint64_t key = (static_cast<uint64_t>(currentOutput_) << 8) | 0xff;
+    antennaStat_[key].logLatency(get_time_us() - startUs, result, static_cast<uint32_t>(size));
+}
+
+bool UsbTransmitter::sendFrame(const uint8_t *buf, size_t size) {
     if (size > MAX_FORWARDER_PACKET_SIZE) {
         throw std::runtime_error("UsbTransmitter:: packet too large");
     }
 
-    uint8_t ieeeHdr[sizeof(ieee80211_header)];
-    std::memcpy(ieeeHdr, ieee80211_header, sizeof(ieee80211_header));
-
-    // Patch frame type
-    ieeeHdr[0] = frameType_;
-    uint32_t channelIdBE = htonl(channelId_);
-    std::memcpy(ieeeHdr + SRC_MAC_THIRD_BYTE, &channelIdBE, sizeof(uint32_t));
-    std::memcpy(ieeeHdr + DST_MAC_THIRD_BYTE, &channelIdBE, sizeof(uint32_t));
-
-    ieeeHdr[FRAME_SEQ_LB] = static_cast<uint8_t>(ieee80211Sequence_ & 0xff);
-    ieeeHdr[FRAME_SEQ_HB] = static_cast<uint8_t>((ieee80211Sequence_ >> 8) & 0xff);
-    ieee80211Sequence_ += 16;
-
-    uint64_t startUs = get_time_us();
-
     // Merge into one contiguous buffer
-    size_t totalSize = radiotapHeaderLen_ + sizeof(ieeeHdr) + size;
-    std::unique_ptr<uint8_t[]> buffer(new uint8_t[totalSize]);
+    uint8_t *frame = txBuffer_.get();
+    std::memcpy(frame, radiotapHeader_, radiotapHeaderLen_);
+    writeIeeeHeader(frame + radiotapHeaderLen_, frameType_, channelId_, ieee80211Sequence_);
+    std::memcpy(frame + radiotapHeaderLen_ + sizeof(ieee80211_header), buf, size);
 
-    std::memcpy(buffer.get(), radiotapHeader_, radiotapHeaderLen_);
-    std::memcpy(buffer.get() + radiotapHeaderLen_, ieeeHdr, sizeof(ieeeHdr));
-    std::memcpy(buffer.get() + radiotapHeaderLen_ + sizeof(ieeeHdr), buf, size);
-
-    bool result = rtlDevice_->send_packet(buffer.get(), totalSize);
+    bool result = rtlDevice_->send_packet(frame, radiotapHeaderLen_ + sizeof(ieee80211_header) + size);
     if (!result) {
         printf("Rtl8812aDevice::send_packet failed!");
     }
-
-    uint64_t key = (static_cast<uint64_t>(currentOutput_) << 8) | 0xff;
-    antennaStat_[key].logLatency(get_time_us() - startUs, result, static_cast<uint32_t>(size));
+    return result;
 }
 
 #endif
@@ -15,8 +15,10 @@ extern "C" {
     #include <unistd.h>
 
     #include <algorithm>
+    #include <array>
     #include <cerrno>
     #include <memory>
+    #include <span>
     #include <unordered_map>
     #include <vector>
 
@@ -97,8 +99,26 @@ protected:
      */
     virtual void injectPacket(const uint8_t *buf, size_t size) = 0;
 
+    /**
+     * @brief Injects several packets that are ready at the same time, in order.
+     *
+     * Called with the fragment that closes a FEC block followed by all of its parity fragments.
+     * The default implementation calls injectPacket() for each of them.
+     * @param packets The packets to send. They are only valid during the call.
+     */
+    virtual void injectBatch(std::span<const std::span<const uint8_t>> packets);
+
 private:
     void sendBlockFragment(size_t packetSize);
+
+    /**
+     * @brief Encrypts the current fragment into a wfb-ng data packet.
+     * @param packetSize Byte length of the fragment.
+     * @param out Buffer of at least MAX_FORWARDER_PACKET_SIZE bytes.
+     * @return Byte length of the data packet.
+     */
+    size_t encryptBlockFragment(size_t packetSize, uint8_t *out);
+
     void makeSessionKey();
 
 private:
@@ -110,9 +130,14 @@ private:
     // Per-block counters
     uint64_t blockIndex_;
     uint8_t fragmentIndex_;
+    /// k primary fragments followed by n - k parity accumulators, which are built up as the primaries are sent
     std::vector<std::unique_ptr<uint8_t[]>> block_;
     size_t maxPacketSize_;
 
+    // Encrypted packets of the batch that closes a block, the last primary plus the parity
+    std::vector<std::unique_ptr<uint8_t[]>> batchBuffers_;
+    std::vector<std::span<const uint8_t>> batch_;
+
     // Session properties
     const uint64_t epoch_;
     const uint32_t channelId_;
@@ -133,8 +158,9 @@ private:
 class TxAntennaItem {
 public:
     TxAntennaItem()
-        : countPacketsInjected(0), countBytesInjected(0), countPacketsDropped(0), latencySum(0), latencyMin(0),
-          latencyMax(0) {}
+        : countPacketsInjected(0), countBytesInjected(0), countPacketsDropped(0), countLatencySamples(0),
+          latencySum(0), latencyMin(0), latencyMax(0), countBatches(0), batchLatencySum(0), batchLatencyMin(0),
+          batchLatencyMax(0) {}
 
     /**
      * @brief Logs packet latency and updates injection/dropping stats.
@@ -143,7 +169,7 @@ public:
      * @param packetSize Number of bytes in the packet.
      */
     void logLatency(uint64_t latency, bool succeeded, uint32_t packetSize) {
-        if ((countPacketsInjected + countPacketsDropped) == 0) {
+        if (countLatencySamples++ == 0) {
             latencyMin = latency;
             latencyMax = latency;
         } else {
@@ -160,14 +186,44 @@ public:
         }
     }
 
+    /**
+     * @brief Logs the latency of a batch submission and updates injection/dropping stats of its packets.
+     * @param latency Microseconds elapsed for the whole batch.
+     * @param injected Packets of the batch sent successfully.
+     * @param dropped Packets of the batch dropped.
+     * @param injectedBytes Number of bytes in the injected packets.
+     */
+    void logBatch(uint64_t latency, uint32_t injected, uint32_t dropped, uint32_t injectedBytes) {
+        if (countBatches++ == 0) {
+            batchLatencyMin = latency;
+            batchLatencyMax = latency;
+        } else {
+            batchLatencyMin = std::min(latency, batchLatencyMin);
+            batchLatencyMax = std::max(latency, batchLatencyMax);
+        }
+        batchLatencySum += latency;
+
+        countPacketsInjected += injected;
+        countBytesInjected += injectedBytes;
+        countPacketsDropped += dropped;
+    }
+
     // Stats
     uint32_t countPacketsInjected;
     uint32_t countBytesInjected;
     uint32_t countPacketsDropped;
 
+    // Single packet submissions
+    uint32_t countLatencySamples;
     uint64_t latencySum;
     uint64_t latencyMin;
     uint64_t latencyMax;
+
+    // Batch submissions
+    uint32_t countBatches;
+    uint64_t batchLatencySum;
+    uint64_t batchLatencyMin;
+    uint64_t batchLatencyMax;
 };
 
 /// Map: key = (antennaIndex << 8) | 0xff, value = TxAntennaItem
@@ -207,11 +263,25 @@ public:
 private:
     void injectPacket(const uint8_t *buf, size_t size) override;
 
+    /**
+     * @brief Sends the whole batch with sendmmsg().
+     */
+    void injectBatch(std::span<const std::span<const uint8_t>> packets) override;
+
+    /**
+     * @brief Sends the prepared batch messages on one socket and logs the batch latency.
+     */
+    void sendBatch(int output, std::span<const std::span<const uint8_t>> packets);
+
 private:
     const uint32_t channelId_;
     int currentOutput_;
     uint16_t ieee80211Sequence_;
     std::vector<int> sockFds_;
+    // Reused by injectBatch(), one entry per packet
+    std::vector<std::array<uint8_t, sizeof(ieee80211_header)>> batchIeeeHdrs_;
+    std::vector<std::array<iovec, 3>> batchIovs_;
+    std::vector<mmsghdr> batchMsgs_;
     TxAntennaStat antennaStat_;
     std::shared_ptr<uint8_t[]> radiotapHeader_;
     size_t radiotapHeaderLen_;
@@ -282,6 +352,12 @@ public:
 private:
     void injectPacket(const uint8_t *buf, size_t size) override;
 
+    /**
+     * @brief Builds radiotap + 802.11 header + payload in txBuffer_ and hands it to the device.
+     * @return True if the device accepted the frame.
+     */
+    bool sendFrame(const uint8_t *buf, size_t size);
+
 private:
     const uint32_t channelId_;
     int currentOutput_;
@@ -291,6 +367,8 @@ private:
     size_t radiotapHeaderLen_;
     uint8_t frameType_;
     Rtl8812aDevice *rtlDevice_;
+    // One frame, allocated once
+    std::unique_ptr<uint8_t[]> txBuffer_;
 };
 
 #endif
@@ -3,20 +3,62 @@
     #include <linux/ip.h>
     #include <linux/random.h>
     #include <linux/udp.h>
+    #include <sys/eventfd.h>
     #include <sys/ioctl.h>
 
+    #include <array>
     #include <cinttypes>
     #include <cstring>
 
     #include "tx_frame.h"
 
-TxFrame::TxFrame() = default;
-TxFrame::~TxFrame() = default;
+TxFrame::TxFrame() {
+    submitEventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (submitEventFd_ < 0) {
+        throw std::runtime_error(string_format("Unable to create eventfd: %s", std::strerror(errno)));
+    }
+}
+
+TxFrame::~TxFrame() {
+    close(submitEventFd_);
+}
 
 void TxFrame::stop() {
     shouldStop_ = true;
 }
 
+bool TxFrame::submit(const uint8_t *data, size_t size) {
+    if (size > MAX_PAYLOAD_SIZE) {
+        return false;
+    }
+
+    const uint64_t submitTs = get_time_us();
+    {
+        std::lock_guard lock(submitMutex_);
+        if (!submitQueue_.push(&submitTs, sizeof(submitTs), data, size)) {
+            return false;
+        }
+    }
+
+    // Wake the TX thread up, several messages in a row only cost one wakeup
+    const uint64_t one = 1;
+    if (write(submitEventFd_, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        printf("TxFrame: unable to signal eventfd: %s", std::strerror(errno));
+    }
+    return true;
+}
+
+TxFrame::UplinkStats TxFrame::uplinkStats() const {
+    UplinkStats stats;
+    stats.submitted = submitQueue_.pushedCount();
+    stats.dropped = submitQueue_.droppedCount();
+    stats.injected = uplinkInjected_.load(std::memory_order_relaxed);
+    stats.ageLastUs = uplinkAgeLastUs_.load(std::memory_order_relaxed);
+    stats.ageAvgUs = stats.injected == 0 ? 0 : uplinkAgeSumUs_.load(std::memory_order_relaxed) / stats.injected;
+    stats.ageMaxUs = uplinkAgeMaxUs_.load(std::memory_order_relaxed);
+    return stats;
+}
+
 uint32_t TxFrame::extractRxqOverflow(struct msghdr *msg) {
     for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(msg, cmsg)) {
         if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
@@ -75,20 +117,49 @@ int TxFrame::open_udp_socket_for_rx(int port, int buf_size) {
     return fd;
 }
 
-uint16_t inet_csum(const void *buf, size_t hdr_len) {
-    unsigned long sum = 0;
-    const uint16_t *ip1;
-
-    ip1 = (const uint16_t *)buf;
-    while (hdr_len > 1) {
-        sum += *ip1++;
-        if (sum & 0x80000000) sum = (sum & 0xFFFF) + (sum >> 16);
-        hdr_len -= 2;
+static_assert(IpUdpHeaderTemplate::SIZE == 2 + sizeof(struct iphdr) + sizeof(struct udphdr));
+
+IpUdpHeaderTemplate::IpUdpHeaderTemplate(in_addr_t saddr, in_addr_t daddr, uint16_t sport, uint16_t dport) {
+    auto *ip = reinterpret_cast<struct iphdr *>(header_ + 2);
+    ip->saddr = saddr;
+    ip->daddr = daddr;
+    ip->ihl = 5;
+    ip->version = 4;
+    ip->tos = 0;
+    ip->frag_off = 0;
+    ip->ttl = 64;
+    ip->protocol = IPPROTO_UDP;
+
+    auto *udp = reinterpret_cast<struct udphdr *>(ip + 1);
+    udp->source = htons(sport);
+    udp->dest = htons(dport);
+    udp->check = 0;
+
+    const auto *words = reinterpret_cast<const uint16_t *>(ip);
+    for (size_t i = 0; i < sizeof(struct iphdr) / 2; i++) {
+        baseSum_ += words[i];
     }
+}
+
+void IpUdpHeaderTemplate::write(uint8_t *out, size_t payloadSize) {
+    memcpy(out, header_, SIZE);
 
-    while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+    const uint16_t ipLength = htons(static_cast<uint16_t>(SIZE - 2 + payloadSize));
+    memcpy(out, &ipLength, 2);
 
-    return ~sum;
+    auto *ip = reinterpret_cast<struct iphdr *>(out + 2);
+    ip->tot_len = ipLength;
+    ip->id = htons(nextId_++);
+
+    auto *udp = reinterpret_cast<struct udphdr *>(ip + 1);
+    udp->len = htons(static_cast<uint16_t>(sizeof(struct udphdr) + payloadSize));
+
+    // Only tot_len and id differ from the template, add them to its sum instead of summing the whole header.
+    uint32_t sum = baseSum_ + ip->tot_len + ip->id;
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    ip->check = static_cast<uint16_t>(~sum);
 }
 
 void TxFrame::dataSource(std::shared_ptr<Transmitter> &transmitter,
@@ -111,11 +182,15 @@ void TxFrame::dataSource(std::shared_ptr<Transmitter> &transmitter,
         }
     }
 
-    std::vector<pollfd> fds(nfds);
+    // The inbound sockets, followed by the eventfd of submit()
+    std::vector<pollfd> fds(nfds + 1);
     for (int i = 0; i < nfds; ++i) {
         fds[i].fd = rxFds[i];
         fds[i].events = POLLIN;
     }
+    pollfd &submitPfd = fds[nfds];
+    submitPfd.fd = submitEventFd_;
+    submitPfd.events = POLLIN;
 
     uint64_t sessionKeyAnnounceTs = 0;
     uint32_t rxqOverflowCount = 0;
@@ -133,6 +208,23 @@ void TxFrame::dataSource(std::shared_ptr<Transmitter> &transmitter,
 
     int startFdIndex = 0;
 
+    IpUdpHeaderTemplate headerTemplate(inet_addr("10.5.0.1"), inet_addr("10.5.0.10"), 54321, 9999);
+
+    // Datagrams are received right behind room for their headers, so forwarding them needs neither
+    // an allocation nor a copy.
+    constexpr size_t slotSize = IpUdpHeaderTemplate::SIZE + MAX_PAYLOAD_SIZE + 1;
+    std::vector<uint8_t> packetPool(RECV_BATCH_SIZE * slotSize);
+    std::vector<uint8_t> cmsgPool(RECV_BATCH_SIZE * CMSG_SPACE(sizeof(uint32_t)));
+    std::array<iovec, RECV_BATCH_SIZE> iovs{};
+    std::array<mmsghdr, RECV_BATCH_SIZE> msgs{};
+    for (size_t j = 0; j < RECV_BATCH_SIZE; j++) {
+        iovs[j].iov_base = packetPool.data() + j * slotSize + IpUdpHeaderTemplate::SIZE;
+        iovs[j].iov_len = MAX_PAYLOAD_SIZE + 1;
+        msgs[j].msg_hdr.msg_iov = &iovs[j];
+        msgs[j].msg_hdr.msg_iovlen = 1;
+        msgs[j].msg_hdr.msg_control = cmsgPool.data() + j * CMSG_SPACE(sizeof(uint32_t));
+    }
+
     while (true) {
         if (shouldStop_) {
             printf("TxFrame: stopping main loop");
@@ -152,7 +244,7 @@ void TxFrame::dataSource(std::shared_ptr<Transmitter> &transmitter,
             }
         }
 
-        int rc = poll(fds.data(), nfds, pollTimeout);
+        int rc = poll(fds.data(), fds.size(), pollTimeout);
         if (rc < 0) {
             if (errno == EINTR || errno == EAGAIN) {
                 continue;
@@ -207,6 +299,48 @@ void TxFrame::dataSource(std::shared_ptr<Transmitter> &transmitter,
             continue;
         }
 
+        // Messages queued in-process with submit()
+        if (submitPfd.revents & POLLIN) {
+            --rc;
+
+            uint64_t signalled;
+            if (read(submitEventFd_, &signalled, sizeof(signalled)) < 0 && errno != EAGAIN) {
+                throw std::runtime_error(string_format("eventfd error: %s", std::strerror(errno)));
+            }
+
+            transmitter->selectOutput(mirror ? -1 : 0);
+
+            // Each entry is popped so that its timestamp sits right in front of where the headers go, the
+            // message itself then already is where forwarding needs it.
+            uint8_t *packet = packetPool.data();
+            uint8_t *entry = packet + IpUdpHeaderTemplate::SIZE - sizeof(uint64_t);
+            while (size_t entrySize = submitQueue_.pop(entry, sizeof(uint64_t) + MAX_PAYLOAD_SIZE)) {
+                uint64_t submitTs;
+                std::memcpy(&submitTs, entry, sizeof(submitTs));
+                const size_t size = entrySize - sizeof(submitTs);
+
+                uint64_t nowTs = get_time_ms();
+                if (nowTs >= sessionKeyAnnounceTs) {
+                    transmitter->sendSessionKey();
+                    sessionKeyAnnounceTs = nowTs + SESSION_KEY_ANNOUNCE_MSEC;
+                }
+
+                ++countPIncoming;
+                countBIncoming += static_cast<uint32_t>(size);
+
+                headerTemplate.write(packet, size);
+                transmitter->sendPacket(packet, IpUdpHeaderTemplate::SIZE + size, 0);
+
+                const uint64_t age = get_time_us() - submitTs;
+                uplinkAgeLastUs_.store(age, std::memory_order_relaxed);
+                uplinkAgeSumUs_.fetch_add(age, std::memory_order_relaxed);
+                if (age > uplinkAgeMaxUs_.load(std::memory_order_relaxed)) {
+                    uplinkAgeMaxUs_.store(age, std::memory_order_relaxed);
+                }
+                uplinkInjected_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
         // We have events
         int i = startFdIndex;
         for (startFdIndex = 0; rc > 0; i++) {
@@ -227,44 +361,15 @@ void TxFrame::dataSource(std::shared_ptr<Transmitter> &transmitter,
                         break;
                     }
 
-                    uint8_t buf[MAX_PAYLOAD_SIZE + 1] = {};
-
-                    uint8_t cmsgbuf[CMSG_SPACE(sizeof(uint32_t))] = {};
-
-                    iovec iov = {};
-                    iov.iov_base = buf;
-                    iov.iov_len = sizeof(buf);
-
-                    msghdr msg = {};
-                    msg.msg_iov = &iov;
-                    msg.msg_iovlen = 1;
-                    msg.msg_control = cmsgbuf;
-                    msg.msg_controllen = sizeof(cmsgbuf);
-
-                    ssize_t rsize = recvmsg(pfd.fd, &msg, 0);
-                    if (rsize < 0) {
-                        if (errno != EWOULDBLOCK && errno != EAGAIN && errno != ETIMEDOUT) {
-                            continue;
-                            throw std::runtime_error(string_format("Error receiving packet: %s", std::strerror(errno)));
-                        }
-                        break;
-                    }
-
-                    // Incoming stats
-                    ++countPIncoming;
-                    countBIncoming += static_cast<uint32_t>(rsize);
-
-                    if (rsize > static_cast<ssize_t>(MAX_PAYLOAD_SIZE)) {
-                        rsize = MAX_PAYLOAD_SIZE;
-                        ++countPTruncated;
+                    for (auto &msg : msgs) {
+                        msg.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint32_t));
+                        msg.msg_len = 0;
                     }
 
-                    uint32_t curOverflow = extractRxqOverflow(&msg);
-                    if (curOverflow != rxqOverflowCount) {
-                        uint32_t diff = (curOverflow - rxqOverflowCount);
-                        countPDropped += diff;
-                        countPIncoming += diff; // All these overflows are potential incoming
-                        rxqOverflowCount = curOverflow;
+                    // Drain what is queued without blocking, poll() tells when there is more.
+                    int count = recvmmsg(pfd.fd, msgs.data(), RECV_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+                    if (count <= 0) {
+                        break;
                     }
 
                     // Possibly re-announce session key
@@ -274,57 +379,42 @@ void TxFrame::dataSource(std::shared_ptr<Transmitter> &transmitter,
                         sessionKeyAnnounceTs = nowTs + SESSION_KEY_ANNOUNCE_MSEC;
                     }
 
-                    // fixme: should move before size check
-
-                    int iphdr_len = sizeof(struct iphdr);
-                    int udphdr_len = sizeof(struct udphdr);
-
-                    // Packet size
-                    size_t packet_size = 2 + iphdr_len + udphdr_len + rsize;
-
-                    // Packet
-                    auto packet = std::vector<unsigned char>(packet_size, 0);
-
-                    uint16_t net_packet_size = htons(packet_size - 2);
-                    memcpy(packet.data(), &net_packet_size, 2);
-
-                    static int packet_id = 0;
+                    for (int j = 0; j < count; j++) {
+                        size_t rsize = msgs[j].msg_len;
 
-                    // IP header
-                    struct iphdr *ip = (struct iphdr *)(packet.data() + 2);
-                    ip->saddr = inet_addr("10.5.0.1");
-                    ip->daddr = inet_addr("10.5.0.10");
-                    ip->ihl = 5;
-                    ip->version = 4;
-                    ip->tos = 0;
-                    ip->tot_len = htons(packet_size - 2);
-                    ip->id = htons(packet_id++);
-                    ip->frag_off = 0;
-                    ip->ttl = 64;
-                    ip->protocol = IPPROTO_UDP;
-                    ip->check = 0; // Will be calculated later
+                        // Incoming stats
+                        ++countPIncoming;
+                        countBIncoming += static_cast<uint32_t>(rsize);
 
-                    // UDP header
-                    struct udphdr *udp = (struct udphdr *)(ip + 1);
-                    udp->source = htons(54321);
-                    udp->dest = htons(9999);
-                    udp->len = htons(udphdr_len + rsize);
-                    udp->check = 0;
-
-                    ip->check = inet_csum((unsigned short *)ip, iphdr_len);
+                        if (rsize > MAX_PAYLOAD_SIZE) {
+                            rsize = MAX_PAYLOAD_SIZE;
+                            ++countPTruncated;
+                        }
 
-                    // Payload
-                    uint8_t *payload_buf = (uint8_t *)(udp + 1);
-                    memcpy(payload_buf, buf, rsize);
+                        uint32_t curOverflow = extractRxqOverflow(&msgs[j].msg_hdr);
+                        if (curOverflow != rxqOverflowCount) {
+                            uint32_t diff = (curOverflow - rxqOverflowCount);
+                            countPDropped += diff;
+                            countPIncoming += diff; // All these overflows are potential incoming
+                            rxqOverflowCount = curOverflow;
+                        }
 
-                    // Forward packet
-                    transmitter->sendPacket(packet.data(), packet_size, 0);
+                        // Forward packet
+                        uint8_t *packet = packetPool.data() + j * slotSize;
+                        headerTemplate.write(packet, rsize);
+                        transmitter->sendPacket(packet, IpUdpHeaderTemplate::SIZE + rsize, 0);
+                    }
 
                     // If we've hit a log boundary inside the same poll, break to flush stats
                     if (nowTs >= logSendTs) {
                         startFdIndex = i % nfds;
                         break;
                     }
+
+                    // A short batch means the socket is drained.
+                    if (count < static_cast<int>(RECV_BATCH_SIZE)) {
+                        break;
+                    }
                 }
             }
         }
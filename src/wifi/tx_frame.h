@@ -15,8 +15,11 @@ extern "C" {
     #include <netinet/in.h>
     #include <sys/socket.h>
 
+    #include <atomic>
     #include <memory>
+    #include <mutex>
 
+    #include "spsc_packet_ring.h"
     #include "transmitter.h"
 
 // //-------------------------------------------------------------
@@ -68,6 +71,33 @@ struct TxArgs {
     std::string keypair = "tx.key";
 };
 
+/**
+ * @class IpUdpHeaderTemplate
+ * @brief The 2-byte length prefix and IPv4/UDP headers put in front of every uplink datagram.
+ *        Built once, per packet only the lengths, the IP id and the checksum are patched.
+ */
+class IpUdpHeaderTemplate {
+public:
+    /// Length prefix + IPv4 header without options + UDP header
+    static constexpr size_t SIZE = 2 + 20 + 8;
+
+    IpUdpHeaderTemplate(in_addr_t saddr, in_addr_t daddr, uint16_t sport, uint16_t dport);
+
+    /**
+     * @brief Writes the headers for a payload of `payloadSize` bytes.
+     * @param out SIZE bytes, directly in front of the payload.
+     */
+    void write(uint8_t *out, size_t payloadSize);
+
+private:
+    uint8_t header_[SIZE] = {};
+
+    /// One's complement sum of the IP header words, with tot_len, id and check left at zero
+    uint32_t baseSum_ = 0;
+
+    uint16_t nextId_ = 0;
+};
+
 /**
  * @class TxFrame
  * @brief Orchestrates the receiving of inbound packets, the creation of Transmitter(s),
@@ -111,9 +141,52 @@ public:
      */
     void stop();
 
+    /**
+     * @brief Queues an uplink message (e.g. adaptive link) for the TX thread, without going through the UDP
+     *        listener. The message is sent exactly like a datagram received on udp_port. Any thread may call this.
+     * @param data Message bytes, at most MAX_PAYLOAD_SIZE.
+     * @param size Message size in bytes.
+     * @return False if the message was dropped because the queue is full or it is too large.
+     */
+    bool submit(const uint8_t *data, size_t size);
+
+    /**
+     * @struct UplinkStats
+     * @brief Counters of the messages queued with submit().
+     */
+    struct UplinkStats {
+        uint64_t submitted = 0;
+        uint64_t dropped = 0;
+        uint64_t injected = 0;
+        /// Time from submit() until the message was handed to the radio
+        uint64_t ageLastUs = 0;
+        uint64_t ageAvgUs = 0;
+        uint64_t ageMaxUs = 0;
+    };
+
+    UplinkStats uplinkStats() const;
+
 private:
+    /// Datagrams drained per recvmmsg() call
+    static constexpr size_t RECV_BATCH_SIZE = 32;
+
+    /// Messages submit() can queue before it drops them. Adaptive link sends one every 100 ms.
+    static constexpr size_t SUBMIT_QUEUE_SIZE = 64;
+
     bool shouldStop_ = false;
 
+    /// Each entry is the submit() timestamp in us followed by the message
+    SpscPacketRing submitQueue_{SUBMIT_QUEUE_SIZE, sizeof(uint64_t) + MAX_PAYLOAD_SIZE};
+    /// The queue has a single producer side, so concurrent submit() calls take turns
+    std::mutex submitMutex_;
+    /// eventfd that wakes the TX thread up from poll() when a message is queued
+    int submitEventFd_ = -1;
+
+    std::atomic<uint64_t> uplinkInjected_ = 0;
+    std::atomic<uint64_t> uplinkAgeSumUs_ = 0;
+    std::atomic<uint64_t> uplinkAgeLastUs_ = 0;
+    std::atomic<uint64_t> uplinkAgeMaxUs_ = 0;
+
     /**
      * @brief Create a UDP socket for receiving data
      * @param port UDP port to bind to
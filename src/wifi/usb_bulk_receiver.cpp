@@ -0,0 +1,232 @@
+#include "usb_bulk_receiver.h"
+
+namespace {
+
+UsbTransferStatus toTransferStatus(libusb_transfer_status status) {
+    switch (status) {
+        case LIBUSB_TRANSFER_COMPLETED:
+            return UsbTransferStatus::Completed;
+        case LIBUSB_TRANSFER_TIMED_OUT:
+            return UsbTransferStatus::TimedOut;
+        case LIBUSB_TRANSFER_CANCELLED:
+            return UsbTransferStatus::Cancelled;
+        case LIBUSB_TRANSFER_STALL:
+            return UsbTransferStatus::Stall;
+        case LIBUSB_TRANSFER_NO_DEVICE:
+            return UsbTransferStatus::NoDevice;
+        default:
+            return UsbTransferStatus::Error;
+    }
+}
+
+void handleLibusbEvents(libusb_context *ctx, std::chrono::milliseconds timeout) {
+    timeval tv{};
+    tv.tv_sec = static_cast<long>(timeout.count() / 1000);
+    tv.tv_usec = static_cast<long>(timeout.count() % 1000 * 1000);
+    libusb_handle_events_timeout_completed(ctx, &tv, nullptr);
+}
+
+} // namespace
+
+UsbEventThread::UsbEventThread(HandleEvents handleEvents) : handleEvents_(std::move(handleEvents)) {
+    thread_ = std::thread([this] {
+        while (!stopping_.load()) {
+            handleEvents_(std::chrono::milliseconds(100));
+        }
+    });
+}
+
+UsbEventThread::UsbEventThread(libusb_context *ctx)
+    : UsbEventThread([ctx](std::chrono::milliseconds timeout) { handleLibusbEvents(ctx, timeout); }) {}
+
+UsbEventThread::~UsbEventThread() {
+    stop();
+}
+
+void UsbEventThread::stop() {
+    stopping_ = true;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool LibusbTransport::submit(UsbTransfer &transfer) {
+    auto *native = static_cast<libusb_transfer *>(transfer.native);
+    if (!native) {
+        native = libusb_alloc_transfer(0);
+        if (!native) {
+            return false;
+        }
+        transfer.native = native;
+    }
+
+    transfer.transport = this;
+    libusb_fill_bulk_transfer(native,
+                              handle_,
+                              endpoint_,
+                              transfer.buffer,
+                              static_cast<int>(transfer.capacity),
+                              &LibusbTransport::onTransferComplete,
+                              &transfer,
+                              timeoutMs_);
+
+    return libusb_submit_transfer(native) == LIBUSB_SUCCESS;
+}
+
+void LibusbTransport::cancel(UsbTransfer &transfer) {
+    if (transfer.native) {
+        // Fails harmlessly if the transfer already completed.
+        libusb_cancel_transfer(static_cast<libusb_transfer *>(transfer.native));
+    }
+}
+
+void LibusbTransport::handleEvents(std::chrono::milliseconds timeout) {
+    handleLibusbEvents(ctx_, timeout);
+}
+
+void LibusbTransport::release(UsbTransfer &transfer) {
+    if (transfer.native) {
+        libusb_free_transfer(static_cast<libusb_transfer *>(transfer.native));
+        transfer.native = nullptr;
+    }
+}
+
+void LIBUSB_CALL LibusbTransport::onTransferComplete(libusb_transfer *native) {
+    auto *transfer = static_cast<UsbTransfer *>(native->user_data);
+    transfer->actualLength = native->actual_length;
+    transfer->status = toTransferStatus(native->status);
+
+    static_cast<LibusbTransport *>(transfer->transport)->complete(*transfer);
+}
+
+UsbBulkReceiver::UsbBulkReceiver(UsbTransport &transport, const Config &config, DataCallback callback)
+    : transport_(transport), config_(config), callback_(std::move(callback)) {
+    if (config_.transferCount < 1) {
+        config_.transferCount = 1;
+    }
+}
+
+UsbBulkReceiver::~UsbBulkReceiver() {
+    stop();
+}
+
+bool UsbBulkReceiver::start() {
+    if (started_) {
+        return false;
+    }
+
+    const size_t count = config_.transferCount;
+    pool_ = std::make_unique<uint8_t[]>(count * config_.transferSize);
+    transfers_.assign(count, {});
+
+    transport_.setCompletionCallback([this](UsbTransfer &transfer) { onComplete(transfer); });
+
+    stopping_ = false;
+    failed_ = false;
+    inFlight_ = 0;
+    consecutiveErrors_ = 0;
+
+    // Completions may come in while the rest is still being submitted.
+    std::lock_guard lock(submitMutex_);
+    started_ = true;
+
+    for (size_t i = 0; i < count; i++) {
+        auto &transfer = transfers_[i];
+        transfer.buffer = pool_.get() + i * config_.transferSize;
+        transfer.capacity = config_.transferSize;
+
+        if (transport_.submit(transfer)) {
+            inFlight_++;
+        }
+    }
+
+    if (inFlight_ == 0) {
+        failed_ = true;
+        return false;
+    }
+
+    return true;
+}
+
+void UsbBulkReceiver::stop() {
+    {
+        std::unique_lock lock(submitMutex_);
+        if (!started_) {
+            return;
+        }
+        stopping_ = true;
+        for (auto &transfer : transfers_) {
+            transport_.cancel(transfer);
+        }
+
+        drained_.wait(lock, [this] { return inFlight_.load() == 0; });
+        started_ = false;
+    }
+
+    for (auto &transfer : transfers_) {
+        transport_.release(transfer);
+    }
+    transfers_.clear();
+    pool_.reset();
+}
+
+UsbBulkReceiver::Stats UsbBulkReceiver::stats() const {
+    Stats stats;
+    stats.completed = completed_.load(std::memory_order_relaxed);
+    stats.bytes = bytes_.load(std::memory_order_relaxed);
+    stats.timeouts = timeouts_.load(std::memory_order_relaxed);
+    stats.errors = errors_.load(std::memory_order_relaxed);
+    stats.inFlight = inFlight_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+bool UsbBulkReceiver::resubmit(UsbTransfer &transfer) {
+    std::lock_guard lock(submitMutex_);
+    return !stopping_ && transport_.submit(transfer);
+}
+
+void UsbBulkReceiver::onComplete(UsbTransfer &transfer) {
+    // A timed out transfer may still carry data.
+    if (transfer.actualLength > 0 &&
+        (transfer.status == UsbTransferStatus::Completed || transfer.status == UsbTransferStatus::TimedOut)) {
+        completed_.fetch_add(1, std::memory_order_relaxed);
+        bytes_.fetch_add(transfer.actualLength, std::memory_order_relaxed);
+        callback_(std::span(transfer.buffer, transfer.actualLength));
+    }
+
+    bool keep = true;
+    switch (transfer.status) {
+        case UsbTransferStatus::Completed:
+        case UsbTransferStatus::Cancelled:
+            consecutiveErrors_ = 0;
+            break;
+        case UsbTransferStatus::TimedOut:
+            timeouts_.fetch_add(1, std::memory_order_relaxed);
+            consecutiveErrors_ = 0;
+            break;
+        case UsbTransferStatus::NoDevice:
+            errors_.fetch_add(1, std::memory_order_relaxed);
+            failed_ = true;
+            keep = false;
+            break;
+        default:
+            // A stall or an error completes right away, so resubmitting forever would only spin. Give up on
+            // the transfer once they keep coming, the others then follow with their next error.
+            errors_.fetch_add(1, std::memory_order_relaxed);
+            keep = ++consecutiveErrors_ <= config_.maxConsecutiveErrors;
+            break;
+    }
+
+    // The same buffer goes straight back to the adapter.
+    if (keep && transfer.status != UsbTransferStatus::Cancelled && resubmit(transfer)) {
+        return;
+    }
+
+    std::lock_guard lock(submitMutex_);
+    if (inFlight_.fetch_sub(1) == 1) {
+        if (!stopping_) {
+            failed_ = true;
+        }
+        drained_.notify_all();
+    }
+}
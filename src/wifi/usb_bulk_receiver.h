@@ -0,0 +1,205 @@
+#pragma once
+
+#ifdef _WIN32
+    #include <libusb.h>
+#else
+    #include <libusb-1.0/libusb.h>
+#endif
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+enum class UsbTransferStatus {
+    Completed,
+    TimedOut,
+    Cancelled,
+    Stall,
+    NoDevice,
+    Error,
+};
+
+class UsbTransport;
+
+/// One bulk-in read. The buffer belongs to the receiver's pool and is reused for every resubmission.
+struct UsbTransfer {
+    uint8_t *buffer = nullptr;
+    size_t capacity = 0;
+    size_t actualLength = 0;
+    UsbTransferStatus status = UsbTransferStatus::Completed;
+    /// The transport the transfer was last submitted to
+    UsbTransport *transport = nullptr;
+    /// Owned by the transport, e.g. the libusb_transfer
+    void *native = nullptr;
+};
+
+/// Where the receiver's transfers go: libusb for a real adapter, or a stand-in without hardware.
+/// A transport completes transfers only from within handleEvents(). With libusb, that is any thread handling
+/// events on the same context, including one waiting for a synchronous transfer.
+class UsbTransport {
+public:
+    using CompletionCallback = std::function<void(UsbTransfer &transfer)>;
+
+    virtual ~UsbTransport() = default;
+
+    void setCompletionCallback(CompletionCallback callback) {
+        onComplete_ = std::move(callback);
+    }
+
+    /// Returns false if the transfer could not be queued, it then never completes.
+    virtual bool submit(UsbTransfer &transfer) = 0;
+
+    /// Ask for a queued transfer to complete early, with UsbTransferStatus::Cancelled.
+    virtual void cancel(UsbTransfer &transfer) = 0;
+
+    /// Wait up to `timeout` for completions and run their callbacks.
+    virtual void handleEvents(std::chrono::milliseconds timeout) = 0;
+
+    /// Called once a transfer won't be submitted anymore.
+    virtual void release(UsbTransfer &transfer) {}
+
+protected:
+    void complete(UsbTransfer &transfer) {
+        if (onComplete_) {
+            onComplete_(transfer);
+        }
+    }
+
+private:
+    CompletionCallback onComplete_;
+};
+
+/// Handles a transport's events on a thread of its own until stopped.
+/// libusb completes the transfers of all devices on a context from whichever thread handles its events,
+/// so there is one of these per context, shared by all the receivers on it.
+class UsbEventThread {
+public:
+    using HandleEvents = std::function<void(std::chrono::milliseconds timeout)>;
+
+    explicit UsbEventThread(HandleEvents handleEvents);
+
+    /// Handle the events of a libusb context.
+    explicit UsbEventThread(libusb_context *ctx);
+
+    ~UsbEventThread();
+
+    UsbEventThread(const UsbEventThread &) = delete;
+    UsbEventThread &operator=(const UsbEventThread &) = delete;
+
+    /// Returns once the thread is done with its last round of events.
+    void stop();
+
+private:
+    HandleEvents handleEvents_;
+    std::atomic<bool> stopping_ = false;
+    std::thread thread_;
+};
+
+/// Asynchronous bulk-in transfers through libusb.
+class LibusbTransport : public UsbTransport {
+public:
+    LibusbTransport(libusb_context *ctx, libusb_device_handle *handle, uint8_t endpoint, unsigned timeoutMs)
+        : ctx_(ctx), handle_(handle), endpoint_(endpoint), timeoutMs_(timeoutMs) {}
+
+    bool submit(UsbTransfer &transfer) override;
+
+    void cancel(UsbTransfer &transfer) override;
+
+    void handleEvents(std::chrono::milliseconds timeout) override;
+
+    void release(UsbTransfer &transfer) override;
+
+private:
+    static void LIBUSB_CALL onTransferComplete(libusb_transfer *native);
+
+    libusb_context *ctx_;
+    libusb_device_handle *handle_;
+    uint8_t endpoint_;
+    unsigned timeoutMs_;
+};
+
+/// Keeps several bulk-in transfers queued on one endpoint, so the adapter always has a buffer to
+/// fill while the previous one is being processed. Completions run on whichever thread handles the
+/// transport's events, normally a UsbEventThread, which hands the data over and resubmits the same
+/// buffer right away. libusb handles the events of a context on one thread at a time, so the
+/// completions of one receiver never overlap.
+class UsbBulkReceiver {
+public:
+    struct Config {
+        /// Transfers in flight at once
+        int transferCount = 8;
+        /// Bytes per transfer. The adapter aggregates several frames into one transfer.
+        size_t transferSize = 64 * 1024;
+        /// Failed completions in a row after which transfers aren't resubmitted anymore, so a stalled
+        /// endpoint doesn't keep the event thread spinning on errors.
+        int maxConsecutiveErrors = 32;
+    };
+
+    struct Stats {
+        uint64_t completed = 0;
+        uint64_t bytes = 0;
+        uint64_t timeouts = 0;
+        uint64_t errors = 0;
+        /// Transfers in flight right now
+        int inFlight = 0;
+    };
+
+    /// Runs on the event handling thread for every completed transfer with data.
+    /// The span is only valid during the call.
+    using DataCallback = std::function<void(std::span<uint8_t> data)>;
+
+    UsbBulkReceiver(UsbTransport &transport, const Config &config, DataCallback callback);
+
+    ~UsbBulkReceiver();
+
+    UsbBulkReceiver(const UsbBulkReceiver &) = delete;
+    UsbBulkReceiver &operator=(const UsbBulkReceiver &) = delete;
+
+    /// Allocate the buffer pool and queue all transfers.
+    bool start();
+
+    /// Cancel the transfers and return once all of them are back. Events must still be handled meanwhile.
+    void stop();
+
+    /// The device is gone, kept failing or every transfer failed to resubmit, receiving won't resume.
+    bool failed() const {
+        return failed_.load(std::memory_order_relaxed);
+    }
+
+    Stats stats() const;
+
+private:
+    void onComplete(UsbTransfer &transfer);
+
+    /// Submit unless stopping, so stop() can't miss a transfer that is resubmitted while it cancels.
+    bool resubmit(UsbTransfer &transfer);
+
+    UsbTransport &transport_;
+    Config config_;
+    DataCallback callback_;
+
+    /// One buffer per transfer, allocated once
+    std::unique_ptr<uint8_t[]> pool_;
+    std::vector<UsbTransfer> transfers_;
+
+    std::mutex submitMutex_;
+    /// Signalled when the last transfer is back
+    std::condition_variable drained_;
+    bool started_ = false;
+    bool stopping_ = false;
+    std::atomic<bool> failed_ = false;
+    std::atomic<int> inFlight_ = 0;
+    /// Only touched by completions, which don't overlap
+    int consecutiveErrors_ = 0;
+
+    std::atomic<uint64_t> completed_ = 0;
+    std::atomic<uint64_t> bytes_ = 0;
+    std::atomic<uint64_t> timeouts_ = 0;
+    std::atomic<uint64_t> errors_ = 0;
+};
@@ -270,8 +270,10 @@ void Receiver::loop_iter(void)
 Aggregator::Aggregator(const string &keypair, uint64_t epoch, uint32_t channel_id) : \
     count_p_all(0), count_b_all(0), count_p_dec_err(0), count_p_session(0), count_p_data(0), count_p_fec_recovered(0),
     count_p_lost(0), count_p_bad(0), count_p_override(0), count_p_outgoing(0), count_b_outgoing(0),
-    fec_p(NULL), fec_k(-1), fec_n(-1), seq(0), rx_ring{}, rx_ring_front(0), rx_ring_alloc(0),
-    last_known_block((uint64_t)-1), epoch(epoch), channel_id(channel_id)
+    count_f_lost(0), count_f_loss_events(0),
+    fec_p(NULL), fec_k(-1), fec_n(-1), seq(0), rx_ring{}, fragment_arena(NULL), rx_ring_front(0), rx_ring_alloc(0),
+    last_known_block((uint64_t)-1), fragment_seen(false), fragment_highest(0), fragment_checked(0),
+    fragment_last_lost(false), epoch(epoch), channel_id(channel_id)
 {
     memset(session_key, '\0', sizeof(session_key));
 
@@ -318,6 +320,15 @@ void Aggregator::init_fec(int k, int n)
     rx_ring_alloc = 0;
     last_known_block = (uint64_t)-1;
     seq = 0;
+    fragment_seen = false;
+
+    // One allocation for the whole ring instead of RX_RING_SIZE * fec_n small ones.
+    // Fragments are not zeroed here, apply_fec() pads the ones it reads.
+    fragment_arena = (uint8_t*)aligned_alloc(RX_FRAGMENT_ALIGN, RX_RING_SIZE * fec_n * RX_FRAGMENT_STRIDE);
+    if (fragment_arena == NULL)
+    {
+        throw runtime_error("Unable to allocate fragment arena");
+    }
 
     for(int ring_idx = 0; ring_idx < RX_RING_SIZE; ring_idx++)
     {
@@ -327,7 +338,7 @@ void Aggregator::init_fec(int k, int n)
         rx_ring[ring_idx].fragments = new uint8_t*[fec_n];
         for(int i=0; i < fec_n; i++)
         {
-            rx_ring[ring_idx].fragments[i] = new uint8_t[MAX_FEC_PAYLOAD];
+            rx_ring[ring_idx].fragments[i] = fragment_arena + ((size_t)ring_idx * fec_n + i) * RX_FRAGMENT_STRIDE;
         }
         rx_ring[ring_idx].fragment_map = new size_t[fec_n];
         memset(rx_ring[ring_idx].fragment_map, '\0', fec_n * sizeof(size_t));
@@ -342,14 +353,13 @@ void Aggregator::deinit_fec(void)
     {
         delete[] rx_ring[ring_idx].fragment_map;
         rx_ring[ring_idx].fragment_map = NULL;
-        for(int i=0; i < fec_n; i++)
-        {
-            delete[] rx_ring[ring_idx].fragments[i];
-        }
         delete[] rx_ring[ring_idx].fragments;
         rx_ring[ring_idx].fragments = NULL;
     }
 
+    free(fragment_arena);
+    fragment_arena = NULL;
+
     fec_free(fec_p);
     fec_p = NULL;
     fec_k = -1;
@@ -449,7 +459,7 @@ int Aggregator::rx_ring_push(void)
 }
 
 
-int Aggregator::get_block_ring_idx(uint64_t block_idx)
+int Aggregator::find_block_ring_idx(uint64_t block_idx) const
 {
     // check if block is already in the ring
     for(int i = rx_ring_front, c = rx_ring_alloc; c > 0; i = modN(i + 1, RX_RING_SIZE), c--)
@@ -460,14 +470,33 @@ int Aggregator::get_block_ring_idx(uint64_t block_idx)
     // check if block is already known and not in the ring then it is already processed
     if (last_known_block != (uint64_t)-1 && block_idx <= last_known_block)
     {
-        return -1;
+        return RING_IDX_PROCESSED;
     }
 
+    return RING_IDX_NEW;
+}
+
+
+int Aggregator::get_new_block_count(uint64_t block_idx) const
+{
     int new_blocks = (int)min(last_known_block != (uint64_t)-1 ? block_idx - last_known_block : 1, (uint64_t)RX_RING_SIZE);
     assert (new_blocks > 0);
+    return new_blocks;
+}
+
+
+int Aggregator::get_block_ring_idx(uint64_t block_idx)
+{
+    int ring_idx = find_block_ring_idx(block_idx);
+
+    if (ring_idx != RING_IDX_NEW)
+    {
+        return ring_idx;
+    }
+
+    int new_blocks = get_new_block_count(block_idx);
 
     last_known_block = block_idx;
-    int ring_idx = -1;
 
     for(int i = 0; i < new_blocks; i++)
     {
@@ -670,6 +699,9 @@ void Aggregator::process_packet(const uint8_t *buf, size_t size, uint8_t wlan_id
 
             init_fec(new_session_data->k, new_session_data->n);
 
+            // Otherwise the new session's packets would pass for duplicates until its nonces pass the old ones
+            count_p_uniq.restart();
+
             IPC_MSG("%" PRIu64 "\tSESSION\t%" PRIu64 ":%u:%d:%d\n", get_time_ms(), epoch, WFB_FEC_VDM_RS, fec_k, fec_n);
             IPC_MSG_SEND();
         }
@@ -682,18 +714,72 @@ void Aggregator::process_packet(const uint8_t *buf, size_t size, uint8_t wlan_id
         return;
     }
 
+    if (fec_p == NULL)
+    {
+        // No session key yet
+        WFB_ERR("Unable to decrypt packet #0x%" PRIx64 "\n", be64toh(((wblock_hdr_t*)buf)->data_nonce));
+        count_p_dec_err += 1;
+        return;
+    }
+
+    wblock_hdr_t *block_hdr = (wblock_hdr_t*)buf;
+    uint64_t data_nonce = be64toh(block_hdr->data_nonce);
+    uint64_t block_idx = data_nonce >> 8;
+    uint8_t fragment_idx = (uint8_t)(data_nonce & 0xff);
+
+    // Should never happend due to generating new session key on tx side
+    if (block_idx > MAX_BLOCK_IDX)
+    {
+        WFB_ERR("block_idx overflow\n");
+        count_p_bad += 1;
+        return;
+    }
+
+    if (fragment_idx >= fec_n)
+    {
+        WFB_ERR("Invalid fragment_idx: %d\n", fragment_idx);
+        count_p_bad += 1;
+        return;
+    }
+
+    // Reject duplicates (common with several antennas) before paying for decryption. The header is
+    // not authenticated yet, so only look things up here and leave the ring and the stats untouched.
+    int ring_idx = find_block_ring_idx(block_idx);
+
+    if (count_p_uniq.contains(data_nonce) || (ring_idx >= 0 && rx_ring[ring_idx].fragment_map[fragment_idx]))
+    {
+        return;
+    }
+
+    // Decrypt straight into the slot the fragment is going to occupy. For a new block that is a free
+    // slot past the allocated ones, unless the ring is full and pending blocks have to be flushed
+    // first, in which case go through a scratch buffer. A fragment of an already processed block is
+    // only decrypted to be counted.
     uint8_t decrypted[MAX_FEC_PAYLOAD];
+    uint8_t *fragment = decrypted;
     unsigned long long decrypted_len;
-    wblock_hdr_t *block_hdr = (wblock_hdr_t*)buf;
 
-    if (crypto_aead_chacha20poly1305_decrypt(decrypted, &decrypted_len,
+    if (ring_idx >= 0)
+    {
+        fragment = rx_ring[ring_idx].fragments[fragment_idx];
+    }
+    else if (ring_idx == RING_IDX_NEW)
+    {
+        int new_blocks = get_new_block_count(block_idx);
+        if (rx_ring_alloc + new_blocks <= RX_RING_SIZE)
+        {
+            fragment = rx_ring[modN(rx_ring_front + rx_ring_alloc + new_blocks - 1, RX_RING_SIZE)].fragments[fragment_idx];
+        }
+    }
+
+    if (crypto_aead_chacha20poly1305_decrypt(fragment, &decrypted_len,
                                              NULL,
                                              buf + sizeof(wblock_hdr_t), size - sizeof(wblock_hdr_t),
                                              buf,
                                              sizeof(wblock_hdr_t),
                                              (uint8_t*)(&(block_hdr->data_nonce)), session_key) != 0)
     {
-        WFB_ERR("Unable to decrypt packet #0x%" PRIx64 "\n", be64toh(block_hdr->data_nonce));
+        WFB_ERR("Unable to decrypt packet #0x%" PRIx64 "\n", data_nonce);
         count_p_dec_err += 1;
         return;
     }
@@ -704,38 +790,31 @@ void Aggregator::process_packet(const uint8_t *buf, size_t size, uint8_t wlan_id
     assert(decrypted_len >= sizeof(wpacket_hdr_t));
     assert(decrypted_len <= MAX_FEC_PAYLOAD);
 
-    uint64_t block_idx = be64toh(block_hdr->data_nonce) >> 8;
-    uint8_t fragment_idx = (uint8_t)(be64toh(block_hdr->data_nonce) & 0xff);
-
-    count_p_uniq.insert(be64toh(block_hdr->data_nonce));
-
-    // Should never happend due to generating new session key on tx side
-    if (block_idx > MAX_BLOCK_IDX)
+    if(count_p_uniq.insert(data_nonce))
     {
-        WFB_ERR("block_idx overflow\n");
-        count_p_bad += 1;
-        return;
+        count_fragment(block_idx, fragment_idx);
     }
 
-    if (fragment_idx >= fec_n)
+    if (ring_idx == RING_IDX_PROCESSED)
     {
-        WFB_ERR("Invalid fragment_idx: %d\n", fragment_idx);
-        count_p_bad += 1;
+        // Parity of a block already sent, it only counts as arrived
         return;
     }
 
-    int ring_idx = get_block_ring_idx(block_idx);
-
-    //ignore already processed blocks
-    if (ring_idx < 0) return;
+    if (ring_idx < 0)
+    {
+        ring_idx = get_block_ring_idx(block_idx);
+        assert(ring_idx >= 0);
+    }
 
     rx_ring_item_t *p = &rx_ring[ring_idx];
 
-    //ignore already processed fragments
-    if (p->fragment_map[fragment_idx]) return;
+    if (fragment == decrypted)
+    {
+        memcpy(p->fragments[fragment_idx], decrypted, decrypted_len);
+    }
 
-    memset(p->fragments[fragment_idx], '\0', MAX_FEC_PAYLOAD);
-    memcpy(p->fragments[fragment_idx], decrypted, decrypted_len);
+    assert(fragment == decrypted || fragment == p->fragments[fragment_idx]);
 
     p->fragment_map[fragment_idx] = decrypted_len;
     p->has_fragments += 1;
@@ -828,6 +907,53 @@ void Aggregator::process_packet(const uint8_t *buf, size_t size, uint8_t wlan_id
     }
 }
 
+// Count the fragments that never arrived once the stream is RX_FRAGMENT_REORDER fragments past them.
+// Unlike count_p_lost, this is the loss of the channel itself, before FEC.
+void Aggregator::count_fragment(uint64_t block_idx, uint8_t fragment_idx)
+{
+    uint64_t idx = block_idx * fec_n + fragment_idx;
+
+    if (!fragment_seen)
+    {
+        fragment_seen = true;
+        fragment_highest = idx;
+        fragment_checked = idx;
+        fragment_last_lost = false;
+        return;
+    }
+
+    if (idx <= fragment_highest)
+    {
+        return;
+    }
+    fragment_highest = idx;
+
+    // Fragments out of the nonce window can't be looked up anymore, e.g. after the link was down for a while.
+    // They were all lost, in one run.
+    uint64_t lookback = (uint64_t)(RX_NONCE_WINDOW / 256 - 1) * fec_n;
+    if (fragment_highest - fragment_checked > lookback)
+    {
+        uint64_t skipped = fragment_highest - lookback - fragment_checked;
+        count_f_lost += skipped;
+        count_f_loss_events += fragment_last_lost ? 0 : 1;
+        fragment_last_lost = true;
+        fragment_checked += skipped;
+    }
+
+    while (fragment_checked + RX_FRAGMENT_REORDER < fragment_highest)
+    {
+        uint64_t nonce = ((fragment_checked / fec_n) << 8) + fragment_checked % fec_n;
+        bool lost = !count_p_uniq.contains(nonce);
+        if (lost)
+        {
+            count_f_lost += 1;
+            count_f_loss_events += fragment_last_lost ? 0 : 1;
+        }
+        fragment_last_lost = lost;
+        fragment_checked += 1;
+    }
+}
+
 void Aggregator::send_packet(int ring_idx, int fragment_idx)
 {
     wpacket_hdr_t* packet_hdr = (wpacket_hdr_t*)(rx_ring[ring_idx].fragments[fragment_idx]);
@@ -840,6 +966,10 @@ void Aggregator::send_packet(int ring_idx, int fragment_idx)
     {
         ANDROID_IPC_MSG("PKT_LOST\t%d", (packet_seq - seq - 1));
         count_p_lost += (packet_seq - seq - 1);
+        if(loss_cb)
+        {
+            loss_cb(packet_seq - seq - 1);
+        }
     }
 
     seq = packet_seq;
@@ -896,6 +1026,18 @@ void Aggregator::apply_fec(int ring_idx)
 
     assert(max_packet_size > 0);
     assert(max_packet_size <= MAX_FEC_PAYLOAD);
+
+    // The tx side encodes primary fragments zero padded to the block's max size.
+    // Slots are not cleared on receive, so pad the ones FEC reads here.
+    for(int i=0; i < fec_k; i++)
+    {
+        size_t fragment_size = rx_ring[ring_idx].fragment_map[i];
+        if(fragment_size && fragment_size < max_packet_size)
+        {
+            memset(rx_ring[ring_idx].fragments[i] + fragment_size, '\0', max_packet_size - fragment_size);
+        }
+    }
+
     fec_decode(fec_p, (const uint8_t**)in_blocks, out_blocks, index, max_packet_size);
 }
 
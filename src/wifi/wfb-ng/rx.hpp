@@ -27,7 +27,7 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 
-#include <set>
+#include <functional>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
@@ -80,6 +80,14 @@ typedef struct {
 
 #define RX_RING_SIZE 40
 
+// find_block_ring_idx() results for blocks that are not in the ring
+#define RING_IDX_PROCESSED -1
+#define RING_IDX_NEW -2
+
+// Fragments live in one arena per ring, each at a fixed, cache line aligned stride
+#define RX_FRAGMENT_ALIGN 64
+#define RX_FRAGMENT_STRIDE ((MAX_FEC_PAYLOAD + RX_FRAGMENT_ALIGN - 1) & ~(size_t)(RX_FRAGMENT_ALIGN - 1))
+
 static inline int modN(int x, int base)
 {
     return (base + (x % base)) % base;
@@ -160,6 +168,114 @@ struct std::hash<rxAntennaKey>
 
 typedef std::unordered_map<rxAntennaKey, rxAntennaItem> rx_antenna_stat_t;
 
+// Counts unique packet nonces, like inserting them into a std::set and taking its size,
+// but in O(1) time and fixed memory. Like a replay window, it keeps a bitmap of the nonces
+// within RX_NONCE_WINDOW of the highest one seen. Anything older is treated as already seen.
+// Nonces are (block_idx << 8) + fragment_idx, so the window covers 64 blocks, more than RX_RING_SIZE.
+#define RX_NONCE_WINDOW (64 * 256)
+
+// A fragment that hasn't arrived by the time the stream is this many fragments past it is counted as lost
+// before FEC. Leaves room for fragments reordered between antennas and adapters.
+#define RX_FRAGMENT_REORDER 32
+
+class rxNonceWindow
+{
+public:
+    rxNonceWindow(void)
+    {
+        clear();
+    }
+
+    void clear(void)
+    {
+        memset(bitmap, '\0', sizeof(bitmap));
+        highest = 0;
+        unique = 0;
+        empty = true;
+    }
+
+    // A new session numbers its blocks from 0 again: forget the old nonces, but keep counting
+    void restart(void)
+    {
+        memset(bitmap, '\0', sizeof(bitmap));
+        highest = 0;
+        empty = true;
+    }
+
+    // Returns true if the nonce wasn't seen before
+    bool insert(uint64_t nonce)
+    {
+        if(empty)
+        {
+            empty = false;
+            highest = nonce;
+        }
+        else if(nonce > highest)
+        {
+            if(nonce - highest >= RX_NONCE_WINDOW)
+            {
+                memset(bitmap, '\0', sizeof(bitmap));
+            }
+            else
+            {
+                clear_range(highest + 1, nonce + 1);
+            }
+            highest = nonce;
+        }
+        else if(highest - nonce >= RX_NONCE_WINDOW)
+        {
+            return false;
+        }
+
+        uint64_t bit = nonce % RX_NONCE_WINDOW;
+        uint64_t mask = 1ULL << (bit % 64);
+        if(bitmap[bit / 64] & mask)
+        {
+            return false;
+        }
+
+        bitmap[bit / 64] |= mask;
+        unique += 1;
+        return true;
+    }
+
+    // Nonces older than the window count as not seen
+    bool contains(uint64_t nonce) const
+    {
+        if(empty || nonce > highest || highest - nonce >= RX_NONCE_WINDOW)
+        {
+            return false;
+        }
+
+        uint64_t bit = nonce % RX_NONCE_WINDOW;
+        return bitmap[bit / 64] & (1ULL << (bit % 64));
+    }
+
+    size_t size(void) const
+    {
+        return unique;
+    }
+
+private:
+    // Forget nonces in [from, to), a word at a time
+    void clear_range(uint64_t from, uint64_t to)
+    {
+        while(from < to)
+        {
+            uint64_t bit = from % RX_NONCE_WINDOW;
+            uint64_t count = std::min<uint64_t>(64 - bit % 64, to - from);
+            uint64_t mask = count == 64 ? ~0ULL : ((1ULL << count) - 1) << (bit % 64);
+            bitmap[bit / 64] &= ~mask;
+            from += count;
+        }
+    }
+
+    uint64_t bitmap[RX_NONCE_WINDOW / 64];
+    uint64_t highest;
+    size_t unique;
+    bool empty;
+};
+
 class Aggregator : public BaseAggregator
 {
 public:
@@ -170,6 +286,12 @@ public:
                                 uint8_t bandwidth, sockaddr_in *sockaddr);
     virtual void dump_stats(void);
 
+    // Called with the number of packets missing whenever the outgoing sequence has a gap
+    void set_loss_callback(std::function<void(uint32_t lost)> cb)
+    {
+        loss_cb = std::move(cb);
+    }
+
     // Make stats public for android userspace receiver
     void clear_stats(void)
     {
@@ -186,6 +308,8 @@ public:
         count_p_override = 0;
         count_p_outgoing = 0;
         count_b_outgoing = 0;
+        count_f_lost = 0;
+        count_f_loss_events = 0;
     }
 
     rx_antenna_stat_t antenna_stat;
@@ -194,13 +318,15 @@ public:
     uint32_t count_p_dec_err;
     uint32_t count_p_session;
     uint32_t count_p_data;
-    std::set<uint64_t> count_p_uniq;
+    rxNonceWindow count_p_uniq;
     uint32_t count_p_fec_recovered;
     uint32_t count_p_lost;
     uint32_t count_p_bad;
     uint32_t count_p_override;
     uint32_t count_p_outgoing;
     uint32_t count_b_outgoing;
+    uint32_t count_f_lost;  // fragments that never arrived, before FEC
+    uint32_t count_f_loss_events;  // runs of consecutive fragments that never arrived
 
 protected:
     virtual void send_to_socket(const uint8_t *payload, uint16_t packet_size) = 0;
@@ -213,8 +339,11 @@ private:
     void deinit_fec(void);
     void send_packet(int ring_idx, int fragment_idx);
     void apply_fec(int ring_idx);
+    void count_fragment(uint64_t block_idx, uint8_t fragment_idx);
     void log_rssi(const sockaddr_in *sockaddr, uint8_t wlan_idx, const uint8_t *ant, const int8_t *rssi,
                   const int8_t *noise, uint16_t freq, uint8_t mcs_index, uint8_t bandwidth);
+    int find_block_ring_idx(uint64_t block_idx) const;
+    int get_new_block_count(uint64_t block_idx) const;
     int get_block_ring_idx(uint64_t block_idx);
     int rx_ring_push(void);
     // cppcheck-suppress unusedPrivateFunction
@@ -226,9 +355,16 @@ private:
 
     uint32_t seq;
     rx_ring_item_t rx_ring[RX_RING_SIZE];
+    uint8_t *fragment_arena; // RX_RING_SIZE * fec_n fragments of RX_FRAGMENT_STRIDE bytes
     int rx_ring_front; // current packet
     int rx_ring_alloc; // number of allocated entries
     uint64_t last_known_block;  //id of last known block
+
+    // Pre-FEC fragment loss, fragments numbered block_idx * fec_n + fragment_idx
+    bool fragment_seen;  // any fragment of this session yet
+    uint64_t fragment_highest;  // highest fragment seen
+    uint64_t fragment_checked;  // fragments before this one have been counted as received or lost
+    bool fragment_last_lost;  // the fragment before fragment_checked was lost
     uint64_t epoch; // current epoch
     const uint32_t channel_id; // (link_id << 8) + port_number
 
@@ -236,6 +372,8 @@ private:
     uint8_t rx_secretkey[crypto_box_SECRETKEYBYTES];
     uint8_t tx_publickey[crypto_box_PUBLICKEYBYTES];
     uint8_t session_key[crypto_aead_chacha20poly1305_KEYBYTES];
+
+    std::function<void(uint32_t lost)> loss_cb;
 };
 
 
@@ -1,5 +1,6 @@
 ﻿#include "wfbng_link.h"
 
+#include <chrono>
 #include <iomanip>
 #include <mutex>
 #include <set>
@@ -9,6 +10,7 @@
 #include "rtp.h"
 #include "rx_frame.h"
 #include "signal_quality.h"
+#include "usb_bulk_receiver.h"
 #ifdef __linux__
     #include "tx_frame.h"
     #include "wfb-ng/rx.hpp"
@@ -30,6 +32,15 @@ static std::atomic playing = false;
 
 constexpr u8 WFB_TX_PORT = 160;
 constexpr u8 WFB_RX_PORT = 32;
+constexpr u8 WFB_VIDEO_PORT = 0;
+constexpr u8 WFB_MAVLINK_PORT = 0x10;
+constexpr uint64_t WFB_EPOCH = 0;
+
+/// Bulk-in endpoint of the RTL8812AU
+constexpr uint8_t RTL_BULK_IN_ENDPOINT = 0x81;
+
+constexpr int MAVLINK_CLIENT_PORT = 14550;
+constexpr int UDP_CLIENT_PORT = 8000;
 
 inline bool isH264(const uint8_t *data) {
     auto h264NalType = GET_H264_NAL_UNIT_TYPE(data);
@@ -49,8 +60,7 @@ public:
 
 protected:
     void send_to_socket(const uint8_t *payload, uint16_t packet_size) override {
-        GuiInterface::Instance().rtpPktCount_++;
-        GuiInterface::Instance().UpdateCount();
+        GuiInterface::Instance().rtpPktCount_.add();
 
         // if (rtlDevice->should_stop) {
         //     return;
@@ -76,10 +86,19 @@ protected:
                 GuiInterface::Instance().playerCodec = "H265";
             }
 
-            GuiInterface::Instance().NotifyRtpStream(header->pt,
-                                                     ntohl(header->ssrc),
-                                                     GuiInterface::Instance().playerPort,
-                                                     GuiInterface::Instance().playerCodec);
+            if (GuiInterface::Instance().UseInProcessRtp()) {
+                GuiInterface::Instance().NotifyInProcessRtpStream(GuiInterface::Instance().playerCodec);
+            } else {
+                GuiInterface::Instance().NotifyRtpStream(header->pt,
+                                                         ntohl(header->ssrc),
+                                                         GuiInterface::Instance().playerPort,
+                                                         GuiInterface::Instance().playerCodec);
+            }
+        }
+
+        if (GuiInterface::Instance().UseInProcessRtp()) {
+            WfbngLink::Instance().rtp_ring().push(payload, packet_size);
+            return;
         }
 
         // Send payload via socket.
@@ -160,33 +179,12 @@ std::vector<DeviceId> WfbngLink::GetDeviceList() {
     return list;
 }
 
-bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidthMode, const std::string &kPath) {
-    GuiInterface::Instance().wifiFrameCount_ = 0;
-    GuiInterface::Instance().wfbFrameCount_ = 0;
-    GuiInterface::Instance().rtpPktCount_ = 0;
-    GuiInterface::Instance().UpdateCount();
-
-    keyPath = kPath;
-
-    if (usbThread) {
-        return false;
-    }
-
-    auto logger = std::make_shared<Logger>();
-
-    int rc = libusb_init(&ctx);
-    if (rc < 0) {
-        GuiInterface::Instance().PutLog(LogLevel::Error, "Failed to initialize libusb");
-        return false;
-    }
-
-    libusb_set_option(ctx, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_ERROR);
-
+libusb_device_handle *WfbngLink::open_device(const DeviceId &deviceId) {
     // Get a list of USB devices
     libusb_device **devs;
     ssize_t count = libusb_get_device_list(ctx, &devs);
     if (count < 0) {
-        return false;
+        return nullptr;
     }
 
     libusb_device *target_dev{};
@@ -213,22 +211,18 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
         GuiInterface::Instance().PutLog(LogLevel::Error, "Invalid device ID!");
         // Free the list of devices
         libusb_free_device_list(devs, 1);
-        libusb_exit(ctx);
-        ctx = nullptr;
-        return false;
+        return nullptr;
     }
 
     // This cannot handle multiple devices with the same vendor_id and product_id.
     // devHandle = libusb_open_device_with_vid_pid(ctx, wifiDeviceVid, wifiDevicePid);
-    libusb_open(target_dev, &devHandle);
+    libusb_device_handle *handle{};
+    libusb_open(target_dev, &handle);
 
     // Free the list of devices
     libusb_free_device_list(devs, 1);
 
-    if (devHandle == nullptr) {
-        libusb_exit(ctx);
-        ctx = nullptr;
-
+    if (handle == nullptr) {
         GuiInterface::Instance().PutLog(LogLevel::Error,
                                         "Cannot open device {:04x}:{:04x} at [{:}:{:}]",
                                         deviceId.vendor_id,
@@ -236,55 +230,105 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
                                         deviceId.bus_num,
                                         deviceId.port_num);
         GuiInterface::Instance().ShowTip(FTR("invalid usb msg"));
-        return false;
+        return nullptr;
     }
 
     // Check if the kernel driver attached
-    if (libusb_kernel_driver_active(devHandle, 0)) {
+    if (libusb_kernel_driver_active(handle, 0)) {
         // Detach driver
-        rc = libusb_detach_kernel_driver(devHandle, 0);
+        libusb_detach_kernel_driver(handle, 0);
     }
 
-    rc = libusb_claim_interface(devHandle, 0);
+    int rc = libusb_claim_interface(handle, 0);
     if (rc < 0) {
-        libusb_close(devHandle);
-        devHandle = nullptr;
+        libusb_close(handle);
+
+        GuiInterface::Instance().PutLog(LogLevel::Error, "Failed to claim interface");
+        return nullptr;
+    }
+
+    return handle;
+}
+
+bool WfbngLink::start(const DeviceId &deviceId,
+                      uint8_t channel,
+                      int channelWidthMode,
+                      const std::string &kPath,
+                      const std::vector<DeviceId> &diversityDeviceIds) {
+    keyPath = kPath;
 
+    if (usbThread) {
+        return false;
+    }
+
+    // The previous run has stopped its stats publisher by now.
+    GuiInterface::Instance().ResetCount();
+
+    if (!register_channels()) {
+        return false;
+    }
+
+    auto logger = std::make_shared<Logger>();
+
+    int rc = libusb_init(&ctx);
+    if (rc < 0) {
+        GuiInterface::Instance().PutLog(LogLevel::Error, "Failed to initialize libusb");
+        return false;
+    }
+
+    libusb_set_option(ctx, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_ERROR);
+
+    devHandle = open_device(deviceId);
+    if (devHandle == nullptr) {
         libusb_exit(ctx);
         ctx = nullptr;
-
-        GuiInterface::Instance().PutLog(LogLevel::Error, "Failed to claim interface");
         return false;
     }
 
+    {
+        std::lock_guard lock(rx_adapter_counters_mutex);
+        rx_adapter_counters.clear();
+        rx_adapter_counters.push_back(std::make_unique<RxAdapterCounters>());
+        rx_adapter_counters.back()->name = deviceId.display_name;
+    }
+
+    // Extra adapters are best effort, the link runs without the ones that fail to open.
+    for (const auto &id : diversityDeviceIds) {
+        libusb_device_handle *handle = open_device(id);
+        if (handle == nullptr) {
+            continue;
+        }
+
+        auto adapter = std::make_unique<DiversityAdapter>();
+        adapter->id = id;
+        adapter->wlan_idx = diversity_adapters.size() + 1;
+        adapter->handle = handle;
+        diversity_adapters.push_back(std::move(adapter));
+
+        std::lock_guard lock(rx_adapter_counters_mutex);
+        rx_adapter_counters.push_back(std::make_unique<RxAdapterCounters>());
+        rx_adapter_counters.back()->name = id.display_name;
+    }
+
 #ifdef __linux__
     tx_frame = std::make_shared<TxFrame>();
 #endif
 
+    start_rx_workers(1 + diversity_adapters.size());
+
+    // The adapters share ctx, so a single thread handles the events of all their receivers.
+    if (usb_rx_config.transfer_count > 0) {
+        usb_event_thread = std::make_unique<UsbEventThread>(ctx);
+    }
+
+    start_stats_publisher();
+
     usbThread = std::make_shared<std::thread>([=, this]() {
         WiFiDriver wifi_driver{logger};
         try {
             rtlDevice = wifi_driver.CreateRtlDevice(devHandle);
 
 #ifdef __linux__
-            // if (!usb_event_thread) {
-            //     auto usb_event_thread_func = [this] {
-            //         while (true) {
-            //             if (devHandle == nullptr) {
-            //                 break;
-            //             }
-            //             struct timeval timeout = {0, 500000}; // 500 ms timeout
-            //             int r = libusb_handle_events_timeout(ctx, &timeout);
-            //             if (r < 0) {
-            //                 // this->log->error("Error handling events: {}", r);
-            //             }
-            //         }
-            //     };
-            //
-            //     init_thread(usb_event_thread, [=]() { return std::make_unique<std::thread>(usb_event_thread_func);
-            //     });
-            // }
-
             std::shared_ptr<TxArgs> args = std::make_shared<TxArgs>();
             args->udp_port = 8001;
             args->link_id = link_id;
@@ -317,21 +361,25 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
 
 #endif
 
-            rtlDevice->Init(
-                [](const Packet &p) {
-                    Instance().handle_80211_frame(p);
-                    GuiInterface::Instance().UpdateCount();
-                },
-                SelectedChannel{
-                    .Channel = channel,
-                    .ChannelOffset = 0,
-                    .ChannelWidth = static_cast<ChannelWidth_t>(channelWidthMode),
-                });
+            start_diversity_adapters(channel, channelWidthMode);
+
+            receive(*rtlDevice,
+                    devHandle,
+                    0,
+                    SelectedChannel{
+                        .Channel = channel,
+                        .ChannelOffset = 0,
+                        .ChannelWidth = static_cast<ChannelWidth_t>(channelWidthMode),
+                    });
         } catch (const std::runtime_error &e) {
             GuiInterface::Instance().PutLog(LogLevel::Error, e.what());
         } catch (...) {
         }
 
+        stop_diversity_adapters();
+        usb_event_thread.reset();
+        stop_rx_workers();
+
         auto rc1 = libusb_release_interface(devHandle, 0);
         if (rc1 < 0) {
             GuiInterface::Instance().PutLog(LogLevel::Error, "Failed to release interface");
@@ -342,7 +390,22 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
         tx_frame->stop();
         destroy_thread(usb_tx_thread);
         GuiInterface::Instance().PutLog(LogLevel::Info, "USB TX thread stopped");
-// destroy_thread(usb_event_thread);
+
+        auto uplink = tx_frame->uplinkStats();
+        GuiInterface::Instance().PutLog(LogLevel::Info,
+                                        "Uplink messages: {} sent, {} dropped, age avg {} us, max {} us",
+                                        uplink.injected,
+                                        uplink.dropped,
+                                        uplink.ageAvgUs,
+                                        uplink.ageMaxUs);
+
+        auto keyframes = keyframe_requester.stats();
+        GuiInterface::Instance().PutLog(LogLevel::Info,
+                                        "Keyframe requests: {} for {} loss events, latency avg {} us, max {} us",
+                                        keyframes.requests,
+                                        keyframes.losses,
+                                        keyframes.latencyAvgUs,
+                                        keyframes.latencyMaxUs);
 #endif
 
         libusb_close(devHandle);
@@ -351,6 +414,16 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
         devHandle = nullptr;
         ctx = nullptr;
 
+        // All RX threads are gone, so nobody dispatches anymore.
+        channel_dispatcher.clear();
+
+        stop_stats_publisher();
+
+#ifdef __linux__
+        // Nothing uses it anymore, and a replay run mustn't publish its stats.
+        tx_frame.reset();
+#endif
+
         usbThread.reset();
 
         GuiInterface::Instance().EmitWifiStopped();
@@ -363,42 +436,381 @@ bool WfbngLink::start(const DeviceId &deviceId, uint8_t channel, int channelWidt
     return true;
 }
 
+bool WfbngLink::start_replay(const std::string &capturePath, const std::string &kPath, double speed) {
+    keyPath = kPath;
+
+    if (usbThread) {
+        return false;
+    }
+
+    // The previous run has stopped its stats publisher by now.
+    GuiInterface::Instance().ResetCount();
+
+    if (!register_channels()) {
+        return false;
+    }
+
+    auto reader = std::make_shared<FrameCaptureReader>();
+    if (!reader->open(capturePath)) {
+        GuiInterface::Instance().PutLog(LogLevel::Error, "Invalid capture file: {}", capturePath);
+        return false;
+    }
+
+    {
+        std::lock_guard lock(rx_adapter_counters_mutex);
+        rx_adapter_counters.clear();
+    }
+
+    replay_should_stop = false;
+
+    // Replay takes the place of the USB thread, so a real adapter can't be started at the same time.
+    start_stats_publisher();
+
+    usbThread = std::make_shared<std::thread>([this, reader, speed] {
+        GuiInterface::Instance().PutLog(LogLevel::Info, "Replay started at speed {}", speed);
+
+        const auto start = std::chrono::steady_clock::now();
+
+        auto count = replayFrameCapture(
+            *reader,
+            speed,
+            [this](const CapturedFrame &frame) {
+                {
+                    // One virtual adapter per wlan_idx found in the capture.
+                    std::lock_guard lock(rx_adapter_counters_mutex);
+                    while (rx_adapter_counters.size() <= frame.wlanIdx) {
+                        rx_adapter_counters.push_back(std::make_unique<RxAdapterCounters>());
+                        rx_adapter_counters.back()->name = "replay " + std::to_string(rx_adapter_counters.size() - 1);
+                    }
+                }
+
+                Packet packet{};
+                packet.Data = std::span(const_cast<uint8_t *>(frame.data.data()), frame.data.size());
+                packet.RxAtrib.rssi[0] = frame.rssi[0];
+                packet.RxAtrib.rssi[1] = frame.rssi[1];
+                packet.RxAtrib.snr[0] = frame.snr[0];
+                packet.RxAtrib.snr[1] = frame.snr[1];
+
+                handle_80211_frame(packet, frame.wlanIdx);
+            },
+            replay_should_stop);
+
+        auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        GuiInterface::Instance().PutLog(LogLevel::Info,
+                                        "Replay stopped, {} frames in {:.2f} s ({:.0f} frames/s)",
+                                        count,
+                                        elapsed,
+                                        elapsed > 0 ? count / elapsed : 0.0);
+
+        // All RX threads are gone, so nobody dispatches anymore.
+        channel_dispatcher.clear();
+
+        stop_stats_publisher();
+
 #ifdef __linux__
+        // Nothing uses it anymore, and a replay run mustn't publish its stats.
+        tx_frame.reset();
+#endif
 
-void WfbngLink::start_link_quality_thread() {
-    GuiInterface::Instance().PutLog(LogLevel::Info, "Start alink thread");
+        usbThread.reset();
 
-    auto thread_func = [this]() {
-        std::this_thread::sleep_for(std::chrono::seconds(1));
+        GuiInterface::Instance().EmitWifiStopped();
+        playing = false;
+    });
+    usbThread->detach();
 
-        fec_controller.setEnabled(true);
+    return true;
+}
 
-        const char *ip = "127.0.0.1";
-        int port = 8001;
-        int sockfd;
+void WfbngLink::start_stats_publisher() {
+    stop_stats_publisher();
 
-        // Create UDP socket
-        if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-            printf("Socket creation failed");
-            return;
+    stats_publisher_should_stop = false;
+    stats_publisher_thread = std::thread([this] {
+        std::unique_lock lock(stats_publisher_mutex);
+        while (!stats_publisher_should_stop) {
+            stats_publisher_cv.wait_for(lock, std::chrono::milliseconds(1000 / STATS_PUBLISH_HZ));
+            publish_stats();
         }
+    });
+}
 
-        int opt = 1;
-        setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+void WfbngLink::stop_stats_publisher() {
+    if (!stats_publisher_thread.joinable()) {
+        return;
+    }
 
-        struct sockaddr_in server_addr = {};
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_port = htons(port);
+    {
+        std::lock_guard lock(stats_publisher_mutex);
+        stats_publisher_should_stop = true;
+    }
+    stats_publisher_cv.notify_all();
+    stats_publisher_thread.join();
 
-        if (inet_pton(AF_INET, ip, &server_addr.sin_addr) <= 0) {
-            printf("Invalid IP address");
-            close(sockfd);
-            return;
+    // Final counts
+    publish_stats();
+}
+
+void WfbngLink::publish_stats() {
+    UplinkStats uplink;
+#ifdef __linux__
+    // Set before the publisher starts and reset after it stopped.
+    if (tx_frame) {
+        auto stats = tx_frame->uplinkStats();
+        uplink.sent = static_cast<long long>(stats.injected);
+        uplink.dropped = static_cast<long long>(stats.dropped);
+        uplink.ageLastUs = static_cast<long long>(stats.ageLastUs);
+        uplink.ageAvgUs = static_cast<long long>(stats.ageAvgUs);
+        uplink.ageMaxUs = static_cast<long long>(stats.ageMaxUs);
+    }
+#endif
+    GuiInterface::Instance().PublishStats(uplink);
+}
+
+bool WfbngLink::start_capture(const std::string &path) {
+    if (!frame_capture.open(path)) {
+        GuiInterface::Instance().PutLog(LogLevel::Error, "Failed to open capture file: {}", path);
+        return false;
+    }
+
+    GuiInterface::Instance().PutLog(LogLevel::Info, "Capturing 802.11 frames to {}", path);
+    return true;
+}
+
+void WfbngLink::stop_capture() {
+    if (!frame_capture.isOpen()) {
+        return;
+    }
+
+    frame_capture.close();
+    GuiInterface::Instance().PutLog(LogLevel::Info, "Captured {} frames", frame_capture.frameCount());
+}
+
+void WfbngLink::start_diversity_adapters(uint8_t channel, int channelWidthMode) {
+    auto logger = std::make_shared<Logger>();
+
+    for (auto &adapter : diversity_adapters) {
+        // Create the devices up front, so stop() can always reach them.
+        WiFiDriver wifi_driver{logger};
+        try {
+            adapter->device = wifi_driver.CreateRtlDevice(adapter->handle);
+        } catch (const std::runtime_error &e) {
+            GuiInterface::Instance().PutLog(LogLevel::Error, "Diversity adapter {}: {}", adapter->id.display_name, e.what());
+            continue;
         }
 
-        const auto map_range = [](double value, double inputMin, double inputMax, double outputMin, double outputMax) {
-            return outputMin + ((value - inputMin) * (outputMax - outputMin) / (inputMax - inputMin));
-        };
+        GuiInterface::Instance().PutLog(LogLevel::Info,
+                                        "Diversity adapter {} as wlan {}",
+                                        adapter->id.display_name,
+                                        adapter->wlan_idx);
+
+        adapter->thread = std::thread([this, adapter = adapter.get(), channel, channelWidthMode] {
+            try {
+                receive(*adapter->device,
+                        adapter->handle,
+                        adapter->wlan_idx,
+                        SelectedChannel{
+                            .Channel = channel,
+                            .ChannelOffset = 0,
+                            .ChannelWidth = static_cast<ChannelWidth_t>(channelWidthMode),
+                        });
+            } catch (const std::runtime_error &e) {
+                GuiInterface::Instance().PutLog(LogLevel::Error, e.what());
+            } catch (...) {
+            }
+
+            GuiInterface::Instance().PutLog(LogLevel::Info, "Diversity adapter {} stopped", adapter->id.display_name);
+        });
+    }
+}
+
+void WfbngLink::receive(Rtl8812aDevice &device,
+                        libusb_device_handle *handle,
+                        uint8_t wlan_idx,
+                        const SelectedChannel &channel) {
+    if (!usb_event_thread) {
+        device.Init(
+            [wlan_idx](const Packet &p) {
+                Instance().enqueue_80211_frame(p, wlan_idx);
+            },
+            channel);
+        return;
+    }
+
+    // Same bring-up as Init(), minus its blocking read loop.
+    device.InitWrite(channel);
+
+    auto logger = std::make_shared<Logger>();
+    FrameParser parser{logger};
+
+    // Completions run on usb_event_thread, or on the TX thread while it waits for a synchronous transfer.
+    LibusbTransport transport(ctx, handle, RTL_BULK_IN_ENDPOINT, 0);
+    UsbBulkReceiver receiver(transport,
+                             {usb_rx_config.transfer_count, usb_rx_config.transfer_size},
+                             [&parser, wlan_idx](std::span<uint8_t> data) {
+                                 // A transfer holds several frames, each behind its own RX descriptor.
+                                 for (const auto &packet : parser.recvbuf2recvframe(data)) {
+                                     Instance().enqueue_80211_frame(packet, wlan_idx);
+                                 }
+                             });
+
+    if (!receiver.start()) {
+        throw std::runtime_error("Failed to submit USB transfers");
+    }
+
+    GuiInterface::Instance().PutLog(LogLevel::Info,
+                                    "Receiving on wlan {} with {} USB transfers of {} KB",
+                                    wlan_idx,
+                                    usb_rx_config.transfer_count,
+                                    usb_rx_config.transfer_size / 1024);
+
+    while (!device.should_stop && !receiver.failed()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+
+    receiver.stop();
+
+    auto stats = receiver.stats();
+    GuiInterface::Instance().PutLog(LogLevel::Info,
+                                    "USB RX on wlan {}: {} transfers, {:.1f} MB, {} errors{}",
+                                    wlan_idx,
+                                    stats.completed,
+                                    stats.bytes / 1e6,
+                                    stats.errors,
+                                    receiver.failed() ? ", gave up" : "");
+}
+
+void WfbngLink::stop_diversity_adapters() {
+    for (auto &adapter : diversity_adapters) {
+        if (adapter->device) {
+            adapter->device->should_stop = true;
+        }
+        if (adapter->thread.joinable()) {
+            adapter->thread.join();
+        }
+
+        libusb_release_interface(adapter->handle, 0);
+        libusb_close(adapter->handle);
+    }
+
+    diversity_adapters.clear();
+}
+
+std::vector<RxAdapterStats> WfbngLink::get_rx_adapter_stats() {
+    std::lock_guard lock(rx_adapter_counters_mutex);
+
+    std::vector<RxAdapterStats> stats;
+    for (const auto &counters : rx_adapter_counters) {
+        stats.push_back({
+            .name = counters->name,
+            .frames = counters->frames,
+            .video_packets = counters->video_packets,
+            .unique_packets = counters->unique_packets,
+        });
+    }
+
+    // Replay feeds the frames directly, without workers.
+    for (size_t i = 0; i < rx_workers.size() && i < stats.size(); i++) {
+        const auto &ring = rx_workers[i]->ring;
+        stats[i].queue_depth = ring.size();
+        stats[i].queue_high_water = ring.highWaterMark();
+        stats[i].queue_capacity = ring.capacity();
+        stats[i].queue_dropped = ring.droppedCount();
+    }
+
+    return stats;
+}
+
+void WfbngLink::start_rx_workers(size_t count) {
+#ifdef __linux__
+    static_assert(RxWorker::max_frame_size == WIFI_MTU, "RX ring slots must fit the largest wfb-ng frame");
+#endif
+
+    std::lock_guard lock(rx_adapter_counters_mutex);
+
+    rx_workers.clear();
+    for (size_t i = 0; i < count; i++) {
+        auto worker = std::make_unique<RxWorker>();
+
+        worker->thread = std::thread([this, worker = worker.get(), wlan_idx = static_cast<uint8_t>(i)] {
+            // The USB thread queues the radio info in front of the frame.
+            Packet packet{};
+            constexpr size_t info_size = sizeof(packet.RxAtrib);
+
+            std::vector<uint8_t> buffer(worker->ring.slotSize());
+
+            while (true) {
+                const size_t size = worker->ring.popWait(buffer.data(), buffer.size(), std::chrono::milliseconds(100));
+                if (size == 0) {
+                    if (worker->should_stop) {
+                        break;
+                    }
+                    continue;
+                }
+                if (size < info_size) {
+                    continue;
+                }
+
+                memcpy(&packet.RxAtrib, buffer.data(), info_size);
+                packet.Data = std::span(buffer.data() + info_size, size - info_size);
+
+                handle_80211_frame(packet, wlan_idx);
+            }
+        });
+
+        rx_workers.push_back(std::move(worker));
+    }
+}
+
+void WfbngLink::stop_rx_workers() {
+    for (size_t i = 0; i < rx_workers.size(); i++) {
+        auto &worker = rx_workers[i];
+        worker->should_stop = true;
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+
+        GuiInterface::Instance().PutLog(LogLevel::Info,
+                                        "RX queue {}: high water {}/{}, dropped {}",
+                                        i,
+                                        worker->ring.highWaterMark(),
+                                        worker->ring.capacity(),
+                                        worker->ring.droppedCount());
+    }
+
+    std::lock_guard lock(rx_adapter_counters_mutex);
+    rx_workers.clear();
+}
+
+void WfbngLink::enqueue_80211_frame(const Packet &packet, uint8_t wlan_idx) {
+    if (wlan_idx >= rx_workers.size()) {
+        handle_80211_frame(packet, wlan_idx);
+        return;
+    }
+
+    // A full ring drops the frame and counts it, the USB thread must never wait for the worker.
+    rx_workers[wlan_idx]->ring.push(&packet.RxAtrib, sizeof(packet.RxAtrib), packet.Data.data(), packet.Data.size());
+}
+
+#ifdef __linux__
+
+void WfbngLink::start_link_quality_thread() {
+    GuiInterface::Instance().PutLog(LogLevel::Info, "Start alink thread");
+
+    auto thread_func = [this]() {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+        fec_controller = makeFecController(fec_controller_name);
+        GuiInterface::Instance().PutLog(LogLevel::Info, "Using FEC controller: {}", fec_controller->name());
+
+        // Messages go straight to the TX thread, the UDP port stays open for external tools only.
+        auto tx = tx_frame;
+
+        // Lost video packets ask for a keyframe right away, not on the next tick.
+        keyframe_requester.setSender([this, tx](const std::string &idr_code) {
+            auto quality = SignalQualityCalculator::get_instance().calculate_signal_quality();
+            return send_alink_message(*tx, quality, fec_controller->value(FecController::Clock::now()), idr_code);
+        });
 
         while (!this->alink_should_stop) {
             auto quality = SignalQualityCalculator::get_instance().calculate_signal_quality();
@@ -410,94 +822,31 @@ void WfbngLink::start_link_quality_thread() {
                 GuiInterface::Instance().packet_loss_ = 100;
             }
 
-            time_t currentEpoch = time(nullptr);
-
-            // Map to 1000..2000
-            quality.quality = map_range(quality.quality, -1024, 1024, 1000, 2000);
-
-            // Prepare & send a message
-            {
-                uint32_t len;
-                char message[100];
-
-                /**
-                     1741491090:1602:1602:1:0:-70:24:num_ants:pnlt:fec_change:code
-
-                     <gs_time>:<link_score>:<link_score>:<fec>:<lost>:<rssi_dB>:<snr_dB>:<num_ants>:<noise_penalty>:<fec_change>:<idr_request_code>
-
-                    gs_time: gs clock
-                    link_score: 1000 - 2000 sent twice (already including any penalty)
-                    link_score: 1000 - 2000 sent twice (already including any penalty)
-                    fec: instantaneus fec_rec (only used by old fec_rec_pntly now disabled by default)
-                    lost: instantaneus lost (not used)
-                    rssi_dB: best antenna rssi (for osd)
-                    snr_dB: best antenna snr_dB (for osd)
-                    num_ants: number of gs antennas (for osd)
-                    noise_penalty: penalty deducted from score due to noise (for osd)
-                    fec_change: int from 0 to 5 : how much to alter fec based on noise
-                    optional idr_request_code: 4 char unique code to request 1 keyframe (no need to send special extra
-                   packets)
-                 */
-
-                // Change FEC
-                if (quality.lost_last_second > 2)
-                    fec_controller.bump(5);
-                else {
-                    if (quality.recovered_last_second > 30) {
-                        fec_controller.bump(5);
-                    }
-                    if (quality.recovered_last_second > 24) {
-                        fec_controller.bump(3);
-                    }
-                    if (quality.recovered_last_second > 22) {
-                        fec_controller.bump(2);
-                    }
-                    if (quality.recovered_last_second > 18) {
-                        fec_controller.bump(1);
-                    }
-                    if (quality.recovered_last_second < 18) {
-                        fec_controller.bump(0);
-                    }
-                }
+            // Change FEC
+            FecStats fec_stats;
+            // Unique ones, copies from other antennas and adapters don't make the channel look better
+            fec_stats.packets = quality.fragments_last_second;
+            fec_stats.recovered = quality.recovered_last_second;
+            fec_stats.lost = quality.lost_last_second;
+            fec_stats.lossEvents = quality.loss_events_last_second;
+            fec_stats.fragmentsLost = quality.fragments_lost_last_second;
+            fec_stats.fragmentLossEvents = quality.fragment_loss_events_last_second;
 
-                int fec_lvl = fec_controller.value();
-                GuiInterface::Instance().drone_fec_level_ = fec_lvl;
-
-                // Prepare the TX message
-                snprintf(message + sizeof(len),
-                         sizeof(message) - sizeof(len),
-                         "%ld:%d:%d:%d:%d:%d:%f:0:-1:%d:%s\n",
-                         static_cast<long>(currentEpoch),
-                         quality.quality,
-                         quality.quality,
-                         quality.recovered_last_second,
-                         quality.lost_last_second,
-                         quality.quality,
-                         quality.snr,
-                         fec_lvl,
-                         quality.idr_code.c_str());
-
-                len = strlen(message + sizeof(len));
-
-                // Put message length in the message header
-                uint32_t net_len = htonl(len);
-                memcpy(message, &net_len, sizeof(len));
-
-                // printf("TX message: %s", message + sizeof(len));
-
-                size_t buf_size = len + sizeof(len);
-
-                ssize_t sent =
-                    sendto(sockfd, message, buf_size, 0, (struct sockaddr *)&server_addr, sizeof(server_addr));
-                if (sent < 0) {
-                    printf("Failed to send message");
-                    break;
-                }
+            int fec_lvl = fec_controller->update(fec_stats, FecController::Clock::now());
+            GuiInterface::Instance().drone_fec_level_ = fec_lvl;
+
+            // A keyframe request held back by the rate limit
+            keyframe_requester.poll();
+
+            if (!send_alink_message(*tx, quality, fec_lvl, keyframe_requester.code())) {
+                printf("Failed to send message");
             }
+
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
 
-        close(sockfd);
+        keyframe_requester.setSender(nullptr);
+
         this->alink_should_stop = false;
     };
 
@@ -506,6 +855,60 @@ void WfbngLink::start_link_quality_thread() {
     rtlDevice->SetTxPower(alink_tx_power);
 }
 
+bool WfbngLink::send_alink_message(TxFrame &tx,
+                                   const SignalQualityCalculator::SignalQuality &quality,
+                                   int fec_lvl,
+                                   const std::string &idr_code) {
+    uint32_t len;
+    char message[100];
+
+    /**
+         1741491090:1602:1602:1:0:-70:24:num_ants:pnlt:fec_change:code
+
+         <gs_time>:<link_score>:<link_score>:<fec>:<lost>:<rssi_dB>:<snr_dB>:<num_ants>:<noise_penalty>:<fec_change>:<idr_request_code>
+
+        gs_time: gs clock
+        link_score: 1000 - 2000 sent twice (already including any penalty)
+        link_score: 1000 - 2000 sent twice (already including any penalty)
+        fec: instantaneus fec_rec (only used by old fec_rec_pntly now disabled by default)
+        lost: instantaneus lost (not used)
+        rssi_dB: best antenna rssi (for osd)
+        snr_dB: best antenna snr_dB (for osd)
+        num_ants: number of gs antennas (for osd)
+        noise_penalty: penalty deducted from score due to noise (for osd)
+        fec_change: int from 0 to 5 : how much to alter fec based on noise
+        optional idr_request_code: 4 char unique code to request 1 keyframe (no need to send special extra
+       packets)
+     */
+
+    // Map to 1000..2000
+    int link_score = map_range(quality.quality, -1024, 1024, 1000, 2000);
+
+    // Prepare the TX message
+    snprintf(message + sizeof(len),
+             sizeof(message) - sizeof(len),
+             "%ld:%d:%d:%d:%d:%d:%f:0:-1:%d:%s\n",
+             static_cast<long>(time(nullptr)),
+             link_score,
+             link_score,
+             quality.recovered_last_second,
+             quality.lost_last_second,
+             link_score,
+             quality.snr,
+             fec_lvl,
+             idr_code.c_str());
+
+    len = strlen(message + sizeof(len));
+
+    // Put message length in the message header
+    uint32_t net_len = htonl(len);
+    memcpy(message, &net_len, sizeof(len));
+
+    // printf("TX message: %s", message + sizeof(len));
+
+    return tx.submit(reinterpret_cast<const uint8_t *>(message), len + sizeof(len));
+}
+
 void WfbngLink::stop_adaptive_link() {
     GuiInterface::Instance().PutLog(LogLevel::Info, "Stop alink thread");
 
@@ -521,116 +924,203 @@ void WfbngLink::stop_adaptive_link() {
 
 #endif
 
-void WfbngLink::handle_80211_frame(const Packet &packet) {
-    GuiInterface::Instance().wifiFrameCount_++;
-    GuiInterface::Instance().UpdateCount();
+namespace {
 
-    RxFrame frame(packet.Data);
-    if (!frame.IsValidWfbFrame()) {
-        return;
+/// Both chains of the adapter, keyed by (wlan_idx, antenna) in the aggregator stats.
+struct AntennaInput {
+    uint8_t antenna[RX_ANT_MAX] = {0, 1, 0xff, 0xff};
+    int8_t rssi[RX_ANT_MAX] = {};
+    int8_t noise[RX_ANT_MAX] = {};
+
+    explicit AntennaInput(const Packet &packet) {
+        for (int i = 0; i < 2; i++) {
+            rssi[i] = static_cast<int8_t>(packet.RxAtrib.rssi[i]);
+            noise[i] = static_cast<int8_t>(rssi[i] - packet.RxAtrib.snr[i]);
+        }
     }
+};
 
-    GuiInterface::Instance().wfbFrameCount_++;
-    GuiInterface::Instance().UpdateCount();
+/// The wfb-ng packet inside an 802.11 frame, without the header and the FCS.
+const uint8_t *wfb_payload(const Packet &packet) {
+    return packet.Data.data() + sizeof(ieee80211_header);
+}
+
+size_t wfb_payload_size(const Packet &packet) {
+    return packet.Data.size() - sizeof(ieee80211_header) - 4;
+}
 
-    static uint32_t link_id = 7669206; // sha1 hash of link_domain="default"
-    static uint8_t video_radio_port = 0;
-    static uint64_t epoch = 0;
+} // namespace
 
-    static uint32_t video_channel_id_f = (link_id << 8) + video_radio_port;
-    static uint32_t video_channel_id_be = htobe32(video_channel_id_f);
+bool WfbngLink::register_channels() {
+    channel_dispatcher.clear();
 
-    static auto *video_channel_id_be8 = reinterpret_cast<uint8_t *>(&video_channel_id_be);
+    const uint32_t video_channel_id = makeWfbChannelId(link_id, WFB_VIDEO_PORT);
 
-    int mavlink_client_port = 14550;
-    uint8_t mavlink_radio_port = 0x10;
-    uint32_t mavlink_channel_id_f = (link_id << 8) + mavlink_radio_port;
-    static uint32_t mavlink_channel_id_be = htobe32(mavlink_channel_id_f);
-    auto *mavlink_channel_id_be8 = reinterpret_cast<uint8_t *>(&mavlink_channel_id_be);
+    try {
+#ifdef __linux__
+        std::shared_ptr<AggregatorX> video_aggregator = std::make_shared<AggregatorX>(
+            "127.0.0.1", GuiInterface::Instance().playerPort, keyPath, WFB_EPOCH, video_channel_id, 0);
+
+        // Runs with the video channel lock held, the requester only queues a message.
+        video_aggregator->set_loss_callback([this](uint32_t lost) {
+            SignalQualityCalculator::get_instance().add_loss_event();
+            keyframe_requester.onLoss(lost);
+        });
+#else
+        std::shared_ptr<Aggregator> video_aggregator = std::make_shared<Aggregator>(
+            keyPath, WFB_EPOCH, video_channel_id, [](uint8_t *payload, uint16_t packet_size) {
+                Instance().handle_rtp(payload, packet_size);
+            });
+#endif
 
-    int udp_client_port = 8000;
-    uint8_t udp_radio_port = WFB_RX_PORT;
-    uint32_t udp_channel_id_f = (link_id << 8) + udp_radio_port;
-    static uint32_t udp_channel_id_be = htobe32(udp_channel_id_f);
-    auto *udp_channel_id_be8 = reinterpret_cast<uint8_t *>(&udp_channel_id_be);
+        // Totals of the aggregator already added to the signal quality buckets
+        auto handle_video = [this,
+                             video_aggregator,
+                             reported_all = uint32_t(0),
+                             reported_recovered = uint32_t(0),
+                             reported_lost = uint32_t(0),
+                             reported_uniq = size_t(0),
+                             reported_f_lost = uint32_t(0),
+                             reported_f_loss_events = uint32_t(0)](const Packet &packet, uint8_t wlan_idx) mutable {
+            // Update signal quality
+            SignalQualityCalculator::get_instance().add_rssi(packet.RxAtrib.rssi[0], packet.RxAtrib.rssi[1]);
+            SignalQualityCalculator::get_instance().add_snr(packet.RxAtrib.snr[0], packet.RxAtrib.snr[1]);
+
+            RxAdapterCounters *adapter_counters = get_rx_adapter_counters(wlan_idx);
+            if (adapter_counters) {
+                adapter_counters->video_packets.fetch_add(1, std::memory_order_relaxed);
+            }
 
-    std::string client_addr = "127.0.0.1";
+            const AntennaInput input(packet);
 
 #ifdef __linux__
-    static std::unique_ptr<AggregatorX> video_aggregator =
-        std::make_unique<AggregatorX>(client_addr,
-                                      GuiInterface::Instance().playerPort,
-                                      keyPath.c_str(),
-                                      epoch,
-                                      video_channel_id_f,
-                                      0);
+            const size_t uniq_before = video_aggregator->count_p_uniq.size();
+
+            video_aggregator->process_packet(wfb_payload(packet),
+                                             wfb_payload_size(packet),
+                                             wlan_idx,
+                                             input.antenna,
+                                             input.rssi,
+                                             input.noise,
+                                             0,
+                                             0,
+                                             0,
+                                             NULL);
+
+            // A packet is credited to the adapter that delivered it first.
+            if (adapter_counters && video_aggregator->count_p_uniq.size() > uniq_before) {
+                adapter_counters->unique_packets.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // The aggregator counts since it was created, the buckets want what this packet added.
+            SignalQualityCalculator::get_instance().add_fec_data(video_aggregator->count_p_all - reported_all,
+                                                                 video_aggregator->count_p_fec_recovered -
+                                                                     reported_recovered,
+                                                                 video_aggregator->count_p_lost - reported_lost);
+            reported_all = video_aggregator->count_p_all;
+            reported_recovered = video_aggregator->count_p_fec_recovered;
+            reported_lost = video_aggregator->count_p_lost;
+
+            // Fragments before FEC, what the model FEC controller estimates the channel from
+            SignalQualityCalculator::get_instance().add_fragment_data(
+                video_aggregator->count_p_uniq.size() - reported_uniq,
+                video_aggregator->count_f_lost - reported_f_lost,
+                video_aggregator->count_f_loss_events - reported_f_loss_events);
+            reported_uniq = video_aggregator->count_p_uniq.size();
+            reported_f_lost = video_aggregator->count_f_lost;
+            reported_f_loss_events = video_aggregator->count_f_loss_events;
 #else
-    static std::unique_ptr<Aggregator> video_aggregator = std::make_unique<Aggregator>(
-        keyPath.c_str(),
-        epoch,
-        video_channel_id_f,
-        [](uint8_t *payload, uint16_t packet_size) { Instance().handle_rtp(payload, packet_size); });
+            video_aggregator->process_packet(
+                wfb_payload(packet), wfb_payload_size(packet), wlan_idx, input.antenna, input.rssi);
+
+            auto quality = SignalQualityCalculator::get_instance().calculate_signal_quality();
+            GuiInterface::Instance().link_quality_ = map_range(quality.quality, -1024, 1024, 0, 100);
 #endif
+        };
+        channel_dispatcher.add(video_channel_id, "video", handle_video);
 
-    static int8_t rssi[2] = {1, 1};
-    static uint8_t antenna[4] = {1, 1, 1, 1};
-    uint32_t freq = 0;
-    int8_t noise[4] = {1, 1, 1, 1};
+        add_forward_channel(WFB_MAVLINK_PORT, "mavlink", MAVLINK_CLIENT_PORT);
+        add_forward_channel(WFB_RX_PORT, "udp", UDP_CLIENT_PORT);
+    } catch (const std::runtime_error &e) {
+        channel_dispatcher.clear();
+        GuiInterface::Instance().PutLog(LogLevel::Error, "Failed to create aggregators: {}", e.what());
+        return false;
+    }
+
+    return true;
+}
 
-    // The aggregator is static, so we need a mutex to modify it
-    // Considering to make it non-static
-    static std::mutex agg_mutex;
-    std::lock_guard lock(agg_mutex);
+void WfbngLink::add_forward_channel(uint8_t radio_port, const std::string &name, int client_port) {
+    const uint32_t channel_id = makeWfbChannelId(link_id, radio_port);
 
-    // Video frame
-    if (frame.MatchesChannelID(video_channel_id_be8)) {
-        // Update signal quality
-        SignalQualityCalculator::get_instance().add_rssi(packet.RxAtrib.rssi[0], packet.RxAtrib.rssi[1]);
-        SignalQualityCalculator::get_instance().add_snr(packet.RxAtrib.snr[0], packet.RxAtrib.snr[1]);
+#ifdef __linux__
+    std::shared_ptr<AggregatorUDPv4> aggregator =
+        std::make_shared<AggregatorUDPv4>("127.0.0.1", client_port, keyPath, WFB_EPOCH, channel_id, 0);
+#else
+    sockaddr_in client_addr{};
+    client_addr.sin_family = AF_INET;
+    client_addr.sin_port = htons(client_port);
+    client_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    std::shared_ptr<Aggregator> aggregator = std::make_shared<Aggregator>(
+        keyPath, WFB_EPOCH, channel_id, [client_addr](uint8_t *payload, uint16_t packet_size) {
+            sendto(socketFd,
+                   reinterpret_cast<const char *>(payload),
+                   packet_size,
+                   0,
+                   (sockaddr *)&client_addr,
+                   sizeof(client_addr));
+        });
+#endif
 
+    channel_dispatcher.add(channel_id, name, [aggregator](const Packet &packet, uint8_t wlan_idx) {
+        const AntennaInput input(packet);
 #ifdef __linux__
-        video_aggregator->process_packet(packet.Data.data() + sizeof(ieee80211_header),
-                                         packet.Data.size() - sizeof(ieee80211_header) - 4,
-                                         0,
-                                         antenna,
-                                         rssi,
-                                         noise,
-                                         freq,
-                                         0,
-                                         0,
-                                         NULL);
-
-        SignalQualityCalculator::get_instance().add_fec_data(video_aggregator->count_p_all,
-                                                             video_aggregator->count_p_fec_recovered,
-                                                             video_aggregator->count_p_lost);
+        aggregator->process_packet(wfb_payload(packet),
+                                   wfb_payload_size(packet),
+                                   wlan_idx,
+                                   input.antenna,
+                                   input.rssi,
+                                   input.noise,
+                                   0,
+                                   0,
+                                   0,
+                                   NULL);
 #else
-        video_aggregator->process_packet(packet.Data.data() + sizeof(ieee80211_header),
-                                         packet.Data.size() - sizeof(ieee80211_header) - 4,
-                                         0,
-                                         antenna,
-                                         rssi);
-
-        auto quality = SignalQualityCalculator::get_instance().calculate_signal_quality();
-        GuiInterface::Instance().link_quality_ = map_range(quality.quality, -1024, 1024, 0, 100);
+        aggregator->process_packet(
+            wfb_payload(packet), wfb_payload_size(packet), wlan_idx, input.antenna, input.rssi);
 #endif
+    });
+}
 
+void WfbngLink::handle_80211_frame(const Packet &packet, uint8_t wlan_idx) {
+    GuiInterface::Instance().wifiFrameCount_.add();
+
+    if (frame_capture.isOpen()) {
+        frame_capture.write(packet.Data.data(), packet.Data.size(), wlan_idx, packet.RxAtrib.rssi, packet.RxAtrib.snr);
     }
-    // MAVLink frame
-    else if (frame.MatchesChannelID(mavlink_channel_id_be8)) {
-        // GuiInterface::Instance().PutLog(LogLevel::Warn, "Received a MAVLink frame, but we're unable to handle it!");
+
+    if (RxAdapterCounters *adapter_counters = get_rx_adapter_counters(wlan_idx)) {
+        adapter_counters->frames.fetch_add(1, std::memory_order_relaxed);
     }
-    // UDP frame
-    else if (frame.MatchesChannelID(udp_channel_id_be8)) {
-        // GuiInterface::Instance().PutLog(LogLevel::Warn, "Received a UDP frame, but we're unable to handle it!");
+
+    RxFrame frame(packet.Data);
+    if (!frame.IsValidWfbFrame()) {
+        return;
+    }
+
+    GuiInterface::Instance().wfbFrameCount_.add();
+
+    if (auto channel_id = frame.GetChannelID()) {
+        channel_dispatcher.dispatch(*channel_id, packet, wlan_idx);
     }
 }
 
 #ifdef _WIN32
 void WfbngLink::handle_rtp(uint8_t *payload, uint16_t packet_size) {
-    GuiInterface::Instance().rtpPktCount_++;
-    GuiInterface::Instance().UpdateCount();
+    GuiInterface::Instance().rtpPktCount_.add();
 
-    if (rtlDevice->should_stop) {
+    if (rtlDevice && rtlDevice->should_stop) {
         return;
     }
     if (packet_size < 12) {
@@ -652,10 +1142,19 @@ void WfbngLink::handle_rtp(uint8_t *payload, uint16_t packet_size) {
         } else {
             GuiInterface::Instance().playerCodec = "H265";
         }
-        GuiInterface::Instance().NotifyRtpStream(header->pt,
-                                                 ntohl(header->ssrc),
-                                                 GuiInterface::Instance().playerPort,
-                                                 GuiInterface::Instance().playerCodec);
+        if (GuiInterface::Instance().UseInProcessRtp()) {
+            GuiInterface::Instance().NotifyInProcessRtpStream(GuiInterface::Instance().playerCodec);
+        } else {
+            GuiInterface::Instance().NotifyRtpStream(header->pt,
+                                                     ntohl(header->ssrc),
+                                                     GuiInterface::Instance().playerPort,
+                                                     GuiInterface::Instance().playerCodec);
+        }
+    }
+
+    if (GuiInterface::Instance().UseInProcessRtp()) {
+        rtp_ring_.push(payload, packet_size);
+        return;
     }
 
     // Send payload via socket.
@@ -668,10 +1167,17 @@ void WfbngLink::handle_rtp(uint8_t *payload, uint16_t packet_size) {
 }
 #endif
 
-void WfbngLink::stop() const {
+void WfbngLink::stop() {
+    replay_should_stop = true;
+
     if (rtlDevice) {
         rtlDevice->should_stop = true;
     }
+    for (auto &adapter : diversity_adapters) {
+        if (adapter->device) {
+            adapter->device->should_stop = true;
+        }
+    }
 }
 
 bool WfbngLink::get_alink_enabled() const {
@@ -725,6 +1231,16 @@ void WfbngLink::set_alink_tx_power(int tx_power) {
 #endif
 }
 
+void WfbngLink::set_fec_controller(const std::string &name) {
+#ifdef __linux__
+    if (!makeFecController(name)) {
+        GuiInterface::Instance().PutLog(LogLevel::Warn, "Unknown FEC controller: {}", name);
+        return;
+    }
+    fec_controller_name = name;
+#endif
+}
+
 WfbngLink::WfbngLink() {
 #ifdef _WIN32
     WSADATA wsaData;
@@ -5,6 +5,8 @@
 #else
     #include <libusb-1.0/libusb.h>
 #endif
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -12,7 +14,13 @@
 
 #include "FrameParser.h"
 #include "Rtl8812aDevice.h"
+#include "channel_dispatcher.h"
 #include "fec_controller.h"
+#include "frame_capture.h"
+#include "keyframe_requester.h"
+#include "signal_quality.h"
+#include "spsc_packet_ring.h"
+#include "usb_bulk_receiver.h"
 #ifdef __linux__
     #include "tx_frame.h"
 #endif
@@ -25,7 +33,31 @@ struct DeviceId {
     uint8_t port_num;
 };
 
-/// Receive packets from a Wi-Fi adapter.
+/// Receive stats of one adapter. With diversity receive, several adapters feed the same aggregator.
+struct RxAdapterStats {
+    std::string name;
+    /// 802.11 frames received
+    uint64_t frames = 0;
+    /// Frames of the video channel
+    uint64_t video_packets = 0;
+    /// Video packets that were the first copy of their fragment to reach the aggregator (Linux only)
+    uint64_t unique_packets = 0;
+    /// Frames waiting for the decrypt/FEC worker of the adapter, and the most that ever waited at once
+    uint64_t queue_depth = 0;
+    uint64_t queue_high_water = 0;
+    uint64_t queue_capacity = 0;
+    /// Frames dropped because the worker fell behind
+    uint64_t queue_dropped = 0;
+};
+
+/// How the adapters are read.
+struct UsbRxConfig {
+    /// Bulk-in transfers kept in flight per adapter, 0 for the driver's own synchronous reads
+    int transfer_count = 0;
+    size_t transfer_size = 64 * 1024;
+};
+
+/// Receive packets from one or more Wi-Fi adapters.
 class WfbngLink {
 public:
     WfbngLink();
@@ -38,9 +70,33 @@ public:
 
     static std::vector<DeviceId> GetDeviceList();
 
-    bool start(const DeviceId &deviceId, uint8_t channel, int channelWidth, const std::string &keyPath);
+    /// @param deviceId The main adapter, which also transmits (adaptive link).
+    /// @param diversityDeviceIds Extra receive-only adapters for antenna diversity.
+    bool start(const DeviceId &deviceId,
+               uint8_t channel,
+               int channelWidth,
+               const std::string &keyPath,
+               const std::vector<DeviceId> &diversityDeviceIds = {});
+
+    /// Feed the frames of a capture file through the same path as the adapter frames, no hardware needed.
+    /// @param speed 1 for the original timing, N for N times faster, 0 for as fast as possible.
+    bool start_replay(const std::string &capturePath, const std::string &keyPath, double speed);
+
+    void stop();
 
-    void stop() const;
+    /// Applies from the next start().
+    void set_usb_rx_config(const UsbRxConfig &config) {
+        usb_rx_config = config;
+    }
+
+    /// Record every received 802.11 frame to a capture file, see frame_capture.h.
+    bool start_capture(const std::string &path);
+
+    void stop_capture();
+
+    bool is_capturing() const {
+        return frame_capture.isOpen();
+    }
 
     bool get_alink_enabled() const;
 
@@ -50,33 +106,147 @@ public:
 
     void set_alink_tx_power(int tx_power);
 
+    /// Pick the FEC controller of adaptive link by name, see makeFecController(). Takes effect on the next start.
+    void set_fec_controller(const std::string &name);
+
+    /// Queue a 802.11 frame for the worker of its adapter. Called from the USB threads, never blocks.
+    void enqueue_80211_frame(const Packet &packet, uint8_t wlan_idx = 0);
+
     /// Process a 802.11 frame
-    void handle_80211_frame(const Packet &packet);
+    /// @param wlan_idx Index of the adapter the frame came from, 0 being the main adapter.
+    void handle_80211_frame(const Packet &packet, uint8_t wlan_idx = 0);
+
+    /// Stats of all adapters in use, the main adapter first.
+    std::vector<RxAdapterStats> get_rx_adapter_stats();
 
 #ifdef _WIN32
     /// Send a RTP payload via socket.
     void handle_rtp(uint8_t *payload, uint16_t packet_size);
 #endif
 
+    /// RTP packets handed over to the in-process decoder, bypassing the UDP loopback.
+    SpscPacketRing &rtp_ring() {
+        return rtp_ring_;
+    }
+
 protected:
     libusb_context *ctx{};
+    /// Completes the bulk-in transfers of all adapters on ctx, with UsbRxConfig::transfer_count > 0
+    std::unique_ptr<UsbEventThread> usb_event_thread;
     libusb_device_handle *devHandle{};
     std::shared_ptr<std::thread> usbThread;
     std::unique_ptr<Rtl8812aDevice> rtlDevice;
     std::string keyPath;
 
+    /// sha1 hash of link_domain="default"
+    uint32_t link_id{7669206};
+
+    /// Video, MAVLink and the UDP tunnel, each with its own aggregator and lock.
+    ChannelDispatcher channel_dispatcher;
+
+    /// Create the aggregators of all channels for the current key.
+    /// Returns false if the key can't be loaded.
+    bool register_channels();
+
+    /// Register a channel whose payload is forwarded as is to a local UDP port.
+    void add_forward_channel(uint8_t radio_port, const std::string &name, int client_port);
+
+    /// Pushes the link counters to the GUI at STATS_PUBLISH_HZ while the link runs,
+    /// so the RX path only bumps atomics.
+    std::thread stats_publisher_thread;
+    std::mutex stats_publisher_mutex;
+    std::condition_variable stats_publisher_cv;
+    bool stats_publisher_should_stop = false;
+
+    void start_stats_publisher();
+
+    void stop_stats_publisher();
+
+    /// Publish the counters once, with the uplink stats of the TX thread if there is one.
+    void publish_stats();
+
+    FrameCaptureWriter frame_capture;
+    std::atomic<bool> replay_should_stop = false;
+
+    /// Room for a few frames of high bitrate video. A RTP packet never exceeds the wfb-ng MTU.
+    SpscPacketRing rtp_ring_{1024, 4096};
+
+    /// An extra receive-only adapter, running its own RX thread.
+    struct DiversityAdapter {
+        DeviceId id;
+        uint8_t wlan_idx;
+        libusb_device_handle *handle{};
+        std::unique_ptr<Rtl8812aDevice> device;
+        std::thread thread;
+    };
+    std::vector<std::unique_ptr<DiversityAdapter>> diversity_adapters;
+
+    struct alignas(64) RxAdapterCounters {
+        std::string name;
+        std::atomic<uint64_t> frames = 0;
+        std::atomic<uint64_t> video_packets = 0;
+        std::atomic<uint64_t> unique_packets = 0;
+    };
+    /// Indexed by wlan_idx. Only resized while no RX worker runs, or by the replay thread, which handles its frames
+    /// itself. So the frame handlers index it without the lock, which only keeps get_rx_adapter_stats() safe.
+    std::vector<std::unique_ptr<RxAdapterCounters>> rx_adapter_counters;
+    std::mutex rx_adapter_counters_mutex;
+
+    RxAdapterCounters *get_rx_adapter_counters(uint8_t wlan_idx) {
+        return wlan_idx < rx_adapter_counters.size() ? rx_adapter_counters[wlan_idx].get() : nullptr;
+    }
+
+    /// Takes the frame validation, decryption, FEC and output of one adapter off its USB thread,
+    /// which then only copies each frame into the ring and goes back to reading.
+    struct RxWorker {
+        /// wfb-ng's WIFI_MTU, the largest frame a wfb-ng transmitter injects
+        static constexpr size_t max_frame_size = 4045;
+        /// Room for the FCS and anything else the adapter delivers along with the frame,
+        /// as wfb-ng leaves for the radiotap header in MAX_PCAP_PACKET_SIZE
+        static constexpr size_t frame_headroom = 256;
+        /// The radio info goes in front of the frame.
+        static constexpr size_t slot_size = sizeof(Packet::RxAtrib) + max_frame_size + frame_headroom;
+
+        /// A bit more than 50 ms of frames at a high video bitrate
+        SpscPacketRing ring{512, slot_size};
+        std::thread thread;
+        std::atomic<bool> should_stop = false;
+    };
+    /// Indexed by wlan_idx. Only resized while no USB thread runs, so enqueueing needs no lock.
+    std::vector<std::unique_ptr<RxWorker>> rx_workers;
+
+    void start_rx_workers(size_t count);
+
+    /// Process what is still queued, then join the workers. The USB threads must have stopped.
+    void stop_rx_workers();
+
+    UsbRxConfig usb_rx_config;
+
+    /// Put the adapter in monitor mode and receive from it until it is told to stop.
+    void receive(Rtl8812aDevice &device,
+                 libusb_device_handle *handle,
+                 uint8_t wlan_idx,
+                 const SelectedChannel &channel);
+
+    /// Find a device, open it and claim its interface.
+    libusb_device_handle *open_device(const DeviceId &deviceId);
+
+    void start_diversity_adapters(uint8_t channel, int channelWidthMode);
+
+    void stop_diversity_adapters();
+
 #ifdef __linux__
     // Adaptive link
-    std::unique_ptr<std::thread> usb_event_thread;
     std::unique_ptr<std::thread> usb_tx_thread;
-    uint32_t link_id{7669206};
     std::recursive_mutex thread_mutex;
     std::shared_ptr<TxFrame> tx_frame;
     bool alink_enabled = true;
     bool alink_should_stop = false;
     int alink_tx_power = 30;
     std::unique_ptr<std::thread> link_quality_thread;
-    FecController fec_controller;
+    std::string fec_controller_name = "threshold";
+    std::unique_ptr<FecController> fec_controller;
+    KeyframeRequester keyframe_requester;
 
     void init_thread(std::unique_ptr<std::thread> &thread,
                      const std::function<std::unique_ptr<std::thread>()> &init_func) {
@@ -94,6 +264,12 @@ protected:
     }
     void start_link_quality_thread();
 
+    /// Queue one alink message on the uplink.
+    bool send_alink_message(TxFrame &tx,
+                            const SignalQualityCalculator::SignalQuality &quality,
+                            int fec_lvl,
+                            const std::string &idr_code);
+
     void stop_adaptive_link();
 #endif
 };
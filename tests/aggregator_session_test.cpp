@@ -0,0 +1,209 @@
+// The aggregator across a session change: the new session numbers its blocks from 0 again, and its packets must
+// count as unique and go out like those of the first one. Also the fragments it counts as lost before FEC, and
+// forged fragments, which mustn't count at all.
+
+#include <sodium.h>
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "rx.hpp"
+
+namespace {
+
+// sha1 hash of link_domain="default", same as WfbngLink
+constexpr uint32_t CHANNEL_ID = 7669206u << 8;
+
+constexpr int BLOCKS_PER_SESSION = 100;
+
+uint8_t txSecret[crypto_box_SECRETKEYBYTES];
+uint8_t rxPublic[crypto_box_PUBLICKEYBYTES];
+
+/// Write the receiver's key file and keep the transmitter's half for building packets.
+std::string writeRxKey() {
+    uint8_t txPublic[crypto_box_PUBLICKEYBYTES], rxSecret[crypto_box_SECRETKEYBYTES];
+    crypto_box_keypair(txPublic, txSecret);
+    crypto_box_keypair(rxPublic, rxSecret);
+
+    const auto path = (std::filesystem::temp_directory_path() / "aggregator_session_test.key").string();
+    FILE *fp = fopen(path.c_str(), "wb");
+    CHECK(fp);
+    CHECK(fwrite(rxSecret, sizeof(rxSecret), 1, fp) == 1);
+    CHECK(fwrite(txPublic, sizeof(txPublic), 1, fp) == 1);
+    fclose(fp);
+    return path;
+}
+
+std::vector<uint8_t> makeSessionPacket(const uint8_t *sessionKey, uint8_t k, uint8_t n) {
+    wsession_hdr_t header{};
+    header.packet_type = WFB_PACKET_SESSION;
+    randombytes_buf(header.session_nonce, sizeof(header.session_nonce));
+
+    wsession_data_t data{};
+    data.epoch = htobe64(0);
+    data.channel_id = htobe32(CHANNEL_ID);
+    data.fec_type = WFB_FEC_VDM_RS;
+    data.k = k;
+    data.n = n;
+    memcpy(data.session_key, sessionKey, sizeof(data.session_key));
+
+    std::vector<uint8_t> packet(sizeof(header) + sizeof(data) + crypto_box_MACBYTES);
+    memcpy(packet.data(), &header, sizeof(header));
+    CHECK(crypto_box_easy(packet.data() + sizeof(header),
+                          reinterpret_cast<const uint8_t *>(&data),
+                          sizeof(data),
+                          header.session_nonce,
+                          rxPublic,
+                          txSecret) == 0);
+    return packet;
+}
+
+/// A primary fragment, the packet header and a payload. Parity fragments aren't decoded unless a primary is missing.
+std::vector<uint8_t> makeDataPacket(const uint8_t *sessionKey, uint64_t block, uint8_t fragment = 0) {
+    wblock_hdr_t header{};
+    header.packet_type = WFB_PACKET_DATA;
+    header.data_nonce = htobe64((block << 8) + fragment);
+
+    uint8_t plain[sizeof(wpacket_hdr_t) + sizeof(block)];
+    wpacket_hdr_t packetHeader{};
+    packetHeader.packet_size = htobe16(sizeof(block));
+    memcpy(plain, &packetHeader, sizeof(packetHeader));
+    memcpy(plain + sizeof(packetHeader), &block, sizeof(block));
+
+    std::vector<uint8_t> packet(sizeof(header) + sizeof(plain) + crypto_aead_chacha20poly1305_ABYTES);
+    memcpy(packet.data(), &header, sizeof(header));
+    unsigned long long encryptedSize;
+    crypto_aead_chacha20poly1305_encrypt(packet.data() + sizeof(header),
+                                         &encryptedSize,
+                                         plain,
+                                         sizeof(plain),
+                                         packet.data(),
+                                         sizeof(header),
+                                         nullptr,
+                                         reinterpret_cast<const uint8_t *>(&header.data_nonce),
+                                         sessionKey);
+    packet.resize(sizeof(header) + encryptedSize);
+    return packet;
+}
+
+class CountingAggregator : public Aggregator {
+public:
+    explicit CountingAggregator(const std::string &keypair) : Aggregator(keypair, 0, CHANNEL_ID) {}
+
+    int delivered = 0;
+
+protected:
+    void send_to_socket(const uint8_t *, uint16_t) override {
+        delivered++;
+    }
+};
+
+void deliver(CountingAggregator &aggregator, const std::vector<uint8_t> &packet) {
+    const uint8_t antenna[RX_ANT_MAX] = {0, 0xff, 0xff, 0xff};
+    const int8_t rssi[RX_ANT_MAX] = {-50};
+    const int8_t noise[RX_ANT_MAX] = {-90};
+    aggregator.process_packet(packet.data(), packet.size(), 0, antenna, rssi, noise, 0, 0, 0, nullptr);
+}
+
+void runSession(CountingAggregator &aggregator) {
+    uint8_t sessionKey[crypto_aead_chacha20poly1305_KEYBYTES];
+    crypto_aead_chacha20poly1305_keygen(sessionKey);
+
+    // With k = n = 1 every block is a single primary fragment.
+    deliver(aggregator, makeSessionPacket(sessionKey, 1, 1));
+    for (uint64_t block = 0; block < BLOCKS_PER_SESSION; block++) {
+        const auto packet = makeDataPacket(sessionKey, block);
+        deliver(aggregator, packet);
+        // A copy from a second antenna
+        deliver(aggregator, packet);
+    }
+}
+
+void testTwoSessions(const std::string &keyPath) {
+    CountingAggregator aggregator(keyPath);
+
+    runSession(aggregator);
+    CHECK(aggregator.delivered == BLOCKS_PER_SESSION);
+    CHECK(aggregator.count_p_uniq.size() == BLOCKS_PER_SESSION);
+
+    runSession(aggregator);
+    CHECK(aggregator.delivered == 2 * BLOCKS_PER_SESSION);
+    CHECK(aggregator.count_p_uniq.size() == 2 * BLOCKS_PER_SESSION);
+    CHECK(aggregator.count_p_dec_err == 0);
+    CHECK(aggregator.count_f_lost == 0);
+}
+
+void testFragmentLoss(const std::string &keyPath) {
+    CountingAggregator aggregator(keyPath);
+
+    uint8_t sessionKey[crypto_aead_chacha20poly1305_KEYBYTES];
+    crypto_aead_chacha20poly1305_keygen(sessionKey);
+
+    // Blocks of one primary and two parity fragments. Only the primaries are sent, so each block loses a run of
+    // two fragments. Block 10 is lost as a whole, which makes a run of five, and block 20 arrives late.
+    deliver(aggregator, makeSessionPacket(sessionKey, 1, 3));
+    for (uint64_t block = 0; block < BLOCKS_PER_SESSION; block++) {
+        if (block == 10 || block == 20) {
+            continue;
+        }
+        deliver(aggregator, makeDataPacket(sessionKey, block));
+        if (block == 22) {
+            deliver(aggregator, makeDataPacket(sessionKey, 20));
+        }
+    }
+
+    // Fragments within RX_FRAGMENT_REORDER of the newest one aren't decided yet.
+    const uint64_t checked = (BLOCKS_PER_SESSION - 1) * 3 - RX_FRAGMENT_REORDER;
+    const uint64_t blocks = (checked + 2) / 3;
+    CHECK(aggregator.count_f_lost == checked - (blocks - 1));
+    CHECK(aggregator.count_f_loss_events == blocks - 2);
+    // Block 20 came too late for the output, but it did arrive.
+    CHECK(aggregator.count_p_lost == 2);
+}
+
+void testForgedFragment(const std::string &keyPath) {
+    CountingAggregator aggregator(keyPath);
+
+    uint8_t sessionKey[crypto_aead_chacha20poly1305_KEYBYTES];
+    crypto_aead_chacha20poly1305_keygen(sessionKey);
+
+    // The primary completes block 0, so its parity arrives for an already processed block.
+    deliver(aggregator, makeSessionPacket(sessionKey, 1, 2));
+    deliver(aggregator, makeDataPacket(sessionKey, 0));
+    CHECK(aggregator.delivered == 1);
+
+    // A parity nonce nobody sent yet, with a payload that doesn't authenticate
+    auto forged = makeDataPacket(sessionKey, 0, 1);
+    forged.back() ^= 0xff;
+    deliver(aggregator, forged);
+    CHECK(aggregator.count_p_dec_err == 1);
+    CHECK(aggregator.count_p_data == 1);
+    CHECK(aggregator.count_p_uniq.size() == 1);
+
+    // The real parity still counts, its copy is dropped before decryption.
+    const auto parity = makeDataPacket(sessionKey, 0, 1);
+    deliver(aggregator, parity);
+    deliver(aggregator, parity);
+    CHECK(aggregator.count_p_dec_err == 1);
+    CHECK(aggregator.count_p_data == 2);
+    CHECK(aggregator.count_p_uniq.size() == 2);
+    CHECK(aggregator.delivered == 1);
+}
+
+} // namespace
+
+int main() {
+    CHECK(sodium_init() >= 0);
+
+    const auto keyPath = writeRxKey();
+    testTwoSessions(keyPath);
+    testFragmentLoss(keyPath);
+    testForgedFragment(keyPath);
+
+    std::filesystem::remove(keyPath);
+    return 0;
+}
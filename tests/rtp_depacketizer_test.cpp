@@ -0,0 +1,209 @@
+// RtpDepacketizer: reassembling H.264 and H.265 access units from aggregation and fragmentation packets, dropping
+// those a sequence gap spoils, and sender restarts, i.e. a new SSRC, or the same one starting over at a sequence
+// number behind the last one.
+
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include "check.h"
+#include "rtp_depacketizer.h"
+
+namespace {
+
+// H.264 parameter sets and slices
+const std::vector<uint8_t> H264_SPS = {0x67, 0x42, 0x00, 0x1f};
+const std::vector<uint8_t> H264_PPS = {0x68, 0xce, 0x3c, 0x80};
+const std::vector<uint8_t> H264_SLICE = {0x41, 0x9a, 0x00};
+
+// H.265 parameter sets, two-byte NAL unit headers
+const std::vector<uint8_t> H265_VPS = {0x40, 0x01, 0x0c};
+const std::vector<uint8_t> H265_SPS = {0x42, 0x01, 0x01};
+const std::vector<uint8_t> H265_PPS = {0x44, 0x01, 0xc1};
+
+constexpr uint32_t SSRC = 0x1111;
+
+std::vector<uint8_t> makePacket(uint16_t sequence,
+                                uint32_t timestamp,
+                                uint32_t ssrc,
+                                bool marker,
+                                const std::vector<uint8_t> &payload = H264_SLICE) {
+    std::vector<uint8_t> packet = {0x80,
+                                   uint8_t(96 | (marker ? 0x80 : 0)),
+                                   uint8_t(sequence >> 8),
+                                   uint8_t(sequence),
+                                   uint8_t(timestamp >> 24),
+                                   uint8_t(timestamp >> 16),
+                                   uint8_t(timestamp >> 8),
+                                   uint8_t(timestamp),
+                                   uint8_t(ssrc >> 24),
+                                   uint8_t(ssrc >> 16),
+                                   uint8_t(ssrc >> 8),
+                                   uint8_t(ssrc)};
+    packet.insert(packet.end(), payload.begin(), payload.end());
+    return packet;
+}
+
+bool push(RtpDepacketizer &depacketizer, const std::vector<uint8_t> &packet) {
+    return depacketizer.push(packet.data(), packet.size());
+}
+
+/// STAP-A (H.264) or AP (H.265) payload: the payload header, then each NAL unit after its 16-bit size.
+std::vector<uint8_t> aggregate(std::vector<uint8_t> header, std::initializer_list<std::vector<uint8_t>> nals) {
+    for (const auto &nal : nals) {
+        header.push_back(uint8_t(nal.size() >> 8));
+        header.push_back(uint8_t(nal.size()));
+        header.insert(header.end(), nal.begin(), nal.end());
+    }
+    return header;
+}
+
+std::vector<uint8_t> annexB(std::initializer_list<std::vector<uint8_t>> nals) {
+    std::vector<uint8_t> out;
+    for (const auto &nal : nals) {
+        out.insert(out.end(), {0x00, 0x00, 0x00, 0x01});
+        out.insert(out.end(), nal.begin(), nal.end());
+    }
+    return out;
+}
+
+/// Feed `count` single-packet access units and return how many came out.
+int feed(RtpDepacketizer &depacketizer, uint16_t firstSequence, uint32_t ssrc, int count) {
+    int frames = 0;
+    for (int i = 0; i < count; i++) {
+        const auto packet = makePacket(firstSequence + i, 3000u * i, ssrc, true);
+        frames += depacketizer.push(packet.data(), packet.size());
+    }
+    return frames;
+}
+
+void testH264StapA() {
+    RtpDepacketizer depacketizer(false);
+
+    const std::vector<uint8_t> idr = {0x65, 0x88, 0x84};
+    CHECK(push(depacketizer, makePacket(1, 0, SSRC, true, aggregate({0x18}, {H264_SPS, H264_PPS, idr}))));
+    CHECK(depacketizer.frame() == annexB({H264_SPS, H264_PPS, idr}));
+    CHECK(depacketizer.frameIsKeyframe());
+    CHECK(depacketizer.parameterSets() == annexB({H264_SPS, H264_PPS}));
+}
+
+void testH264FuA() {
+    RtpDepacketizer depacketizer(false);
+
+    // An IDR slice (header 0x65) in three FU-A packets: FU indicator, FU header with start/end bits, payload
+    CHECK(!push(depacketizer, makePacket(1, 0, SSRC, false, {0x7c, 0x85, 0x01, 0x02})));
+    CHECK(!push(depacketizer, makePacket(2, 0, SSRC, false, {0x7c, 0x05, 0x03})));
+    CHECK(push(depacketizer, makePacket(3, 0, SSRC, true, {0x7c, 0x45, 0x04, 0x05})));
+    CHECK(depacketizer.frame() == annexB({{0x65, 0x01, 0x02, 0x03, 0x04, 0x05}}));
+    CHECK(depacketizer.frameIsKeyframe());
+    CHECK(depacketizer.stats().frames == 1);
+}
+
+void testH265ApAndFu() {
+    RtpDepacketizer depacketizer(true);
+
+    // Parameter sets in an AP, then an IDR_W_RADL slice (type 19) in two FU packets, one access unit
+    CHECK(!push(depacketizer, makePacket(1, 0, SSRC, false, aggregate({0x60, 0x01}, {H265_VPS, H265_SPS, H265_PPS}))));
+    CHECK(!push(depacketizer, makePacket(2, 0, SSRC, false, {0x62, 0x01, 0x93, 0xaf, 0x01})));
+    CHECK(push(depacketizer, makePacket(3, 0, SSRC, true, {0x62, 0x01, 0x53, 0x02, 0x03})));
+    CHECK(depacketizer.frame() == annexB({H265_VPS, H265_SPS, H265_PPS, {0x26, 0x01, 0xaf, 0x01, 0x02, 0x03}}));
+    CHECK(depacketizer.frameIsKeyframe());
+    CHECK(depacketizer.parameterSets() == annexB({H265_VPS, H265_SPS, H265_PPS}));
+}
+
+void testGapInFragmentDropsFrame() {
+    RtpDepacketizer depacketizer(false);
+
+    // The middle of the FU-A is lost, so the access unit mustn't reach the decoder.
+    CHECK(!push(depacketizer, makePacket(1, 0, SSRC, false, {0x7c, 0x85, 0x01})));
+    CHECK(!push(depacketizer, makePacket(3, 0, SSRC, true, {0x7c, 0x45, 0x03})));
+    CHECK(depacketizer.stats().lostPackets == 1);
+    CHECK(depacketizer.stats().droppedFrames == 1);
+    CHECK(depacketizer.stats().frames == 0);
+
+    // The next access unit is fine again.
+    CHECK(push(depacketizer, makePacket(4, 3000, SSRC, true)));
+    CHECK(depacketizer.frame() == annexB({H264_SLICE}));
+}
+
+void testFrameBoundaries() {
+    RtpDepacketizer depacketizer(false);
+
+    // Two slices of one picture, the marker bit ends it.
+    const std::vector<uint8_t> secondSlice = {0x41, 0x9b, 0x01};
+    CHECK(!push(depacketizer, makePacket(1, 0, SSRC, false)));
+    CHECK(push(depacketizer, makePacket(2, 0, SSRC, true, secondSlice)));
+    CHECK(depacketizer.frame() == annexB({H264_SLICE, secondSlice}));
+    CHECK(depacketizer.frameTimestamp() == 0);
+
+    // Without the marker, the next timestamp ends it.
+    CHECK(!push(depacketizer, makePacket(3, 3000, SSRC, false)));
+    CHECK(push(depacketizer, makePacket(4, 6000, SSRC, false, secondSlice)));
+    CHECK(depacketizer.frame() == annexB({H264_SLICE}));
+    CHECK(depacketizer.frameTimestamp() == 3000);
+
+    CHECK(push(depacketizer, makePacket(5, 9000, SSRC, true)));
+    CHECK(depacketizer.frame() == annexB({secondSlice}));
+    CHECK(depacketizer.frameTimestamp() == 6000);
+    CHECK(depacketizer.stats().frames == 3);
+    CHECK(depacketizer.stats().droppedFrames == 0);
+}
+
+void testNewSsrcBehind() {
+    RtpDepacketizer depacketizer(false);
+
+    CHECK(feed(depacketizer, 40000, 0x1111, 100) == 100);
+    // The restarted encoder starts behind the old sequence
+    CHECK(feed(depacketizer, 30000, 0x2222, 5000) == 5000);
+    CHECK(depacketizer.stats().resyncs == 1);
+    CHECK(depacketizer.stats().lostPackets == 0);
+}
+
+void testSameSsrcBehind() {
+    RtpDepacketizer depacketizer(false);
+
+    CHECK(feed(depacketizer, 40000, 0x1111, 100) == 100);
+    // Close behind, only taken for a restart after a run of such packets
+    const int frames = feed(depacketizer, 39990, 0x1111, 5000);
+    CHECK(frames >= 5000 - 8);
+    // Far behind, a restart right away
+    CHECK(feed(depacketizer, 10000, 0x1111, 100) == 100);
+    CHECK(depacketizer.stats().resyncs == 2);
+}
+
+void testReorderedPacketIgnored() {
+    RtpDepacketizer depacketizer(false);
+
+    CHECK(feed(depacketizer, 100, 0x1111, 10) == 10);
+    // A duplicate neither completes a frame nor restarts the stream.
+    const auto duplicate = makePacket(108, 0, 0x1111, true);
+    CHECK(!depacketizer.push(duplicate.data(), duplicate.size()));
+    const auto next = makePacket(110, 30000, 0x1111, true);
+    CHECK(depacketizer.push(next.data(), next.size()));
+    CHECK(depacketizer.stats().resyncs == 0);
+    CHECK(depacketizer.stats().lostPackets == 0);
+}
+
+void testReset() {
+    RtpDepacketizer depacketizer(false);
+
+    CHECK(feed(depacketizer, 40000, 0x1111, 100) == 100);
+    depacketizer.reset();
+    CHECK(feed(depacketizer, 39000, 0x1111, 100) == 100);
+    CHECK(depacketizer.stats().frames == 200);
+}
+
+} // namespace
+
+int main() {
+    testH264StapA();
+    testH264FuA();
+    testH265ApAndFu();
+    testGapInFragmentDropsFrame();
+    testFrameBoundaries();
+    testNewSsrcBehind();
+    testSameSsrcBehind();
+    testReorderedPacketIgnored();
+    testReset();
+    return 0;
+}